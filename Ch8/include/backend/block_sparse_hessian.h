@@ -0,0 +1,174 @@
+#ifndef MYSLAM_BACKEND_BLOCK_SPARSE_HESSIAN_H
+#define MYSLAM_BACKEND_BLOCK_SPARSE_HESSIAN_H
+
+#include <vector>
+#include "eigen_types.h"
+#include "thread_pool.h"
+
+namespace myslam {
+namespace backend {
+
+typedef unsigned long ulong;
+
+/**
+ * 按顶点 ordering 分块存储的 Hessian
+ *
+ * SLAM 问题中 pose 在前、landmark 在后，H 的结构为
+ *      | Hpp  Hpl |
+ *      | Hlp  Hll |
+ * Hpp: pose 部分，维度只与滑窗大小有关，稠密存储
+ * Hll: 块对角，每个 landmark 一个块
+ * Hpl: 只有观测到该 landmark 的 pose 对应的块非零，按 landmark 分组存储，Hlp 由对称性得到
+ *
+ * 这样内存和装配耗时只与边的数量成正比，而不是 N^2。
+ * 通用问题（没有 landmark）时，整个 H 都存放在稠密的 Hpp 中。
+ *
+ * 所有 landmark 都是 1 维（逆深度）时，Hll 及其逆都以连续的标量数组保存，
+ * 累加、schur 消元、回代等直接按秩 1 更新，不再经过 1x1 的动态矩阵。
+ */
+class BlockSparseHessian {
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+
+    /// pose 与某个 landmark 之间的非零块
+    struct PoseLandmarkBlock {
+        ulong pose_index;   // pose 在 H 中的 ordering
+        int pose_dim;
+        MatXX H;            // pose_dim x landmark_dim
+    };
+
+    BlockSparseHessian() {}
+
+    /**
+     * 重新设定矩阵结构，已有数据全部清空
+     * @param dense_dim pose 部分的总维度
+     * @param landmark_dims 各 landmark 的维度，按 ordering 顺序排列，第一个 landmark 的 ordering 为 dense_dim
+     */
+    void Resize(ulong dense_dim, const std::vector<int> &landmark_dims);
+
+    /// 登记一个 pose 与 landmark 之间的非零块（符号分析），需在多线程累加之前完成
+    void AddPoseLandmarkLink(ulong pose_index, int pose_dim, ulong landmark_index);
+
+    /// 保留结构，数值清零
+    void SetZero();
+
+    /// 返回一个结构相同、数值为零的矩阵
+    BlockSparseHessian ZeroLike() const;
+
+    /**
+     * H(index_i, index_j) += h，并维护对称部分
+     * 不允许两个不同的 landmark 之间存在非零块
+     */
+    void AddBlock(ulong index_i, int dim_i, ulong index_j, int dim_j, const MatXX &h);
+
+    /**
+     * 只累加 H(index_i, index_j) 这一块，不维护对称部分
+     * 用于按块行归属的并行累加：每个线程只写自己负责的行，对称块由另一行的负责线程写入
+     * pose 与 landmark 之间的块统一存放在 landmark 一侧，因此只能从 landmark 行累加
+     */
+    void AddRowBlock(ulong index_i, int dim_i, ulong index_j, int dim_j, const MatXX &h);
+
+    /// 对角线全部加上 lambda
+    void AddDiagonal(double lambda);
+
+    /// 两个结构相同的矩阵相加
+    BlockSparseHessian &operator+=(const BlockSparseHessian &other);
+
+    /// y = H * x
+    VecX Multiply(const VecX &x) const;
+
+    /// 对角线元素绝对值的最大值
+    double MaxDiagonal() const;
+
+    /**
+     * 消去所有 landmark，得到 pose 部分的 Schur complement
+     * H_schur = Hpp - Hpl * Hll^-1 * Hlp,  b_schur = bp - Hpl * Hll^-1 * bl
+     * Hll 的逆会被缓存，供 BackSubstitute 使用
+     * pool 不为空时，每个线程负责一部分 pose 块行，线程之间没有写冲突，结果与单线程一致
+     */
+    void SchurComplement(const VecX &b, MatXX &H_schur, VecX &b_schur, ThreadPool *pool = nullptr);
+
+    /// 已知 x 的 pose 部分，回代求 landmark 部分：xl = Hll^-1 * (bl - Hlp * xp)
+    void BackSubstitute(const VecX &b, VecX &x, ThreadPool *pool = nullptr) const;
+
+    /// 对所有 landmark 对角块求逆并缓存，SchurComplement 会自动调用
+    void InvertLandmarkBlocks(ThreadPool *pool = nullptr);
+
+    /**
+     * 不构造 H_schur，直接计算 H_schur * xp = Hpp * xp - Hpl * Hll^-1 * Hlp * xp
+     * 需先调用 InvertLandmarkBlocks
+     */
+    VecX SchurMultiply(const VecX &xp, ThreadPool *pool = nullptr) const;
+
+    /// b_schur = bp - Hpl * Hll^-1 * bl，需先调用 InvertLandmarkBlocks
+    VecX SchurRhs(const VecX &b, ThreadPool *pool = nullptr) const;
+
+    /**
+     * H_schur 的对角块，用作块 Jacobi 预条件
+     * @param pose_blocks 各 pose 顶点的 (ordering, 维度)
+     */
+    std::vector<MatXX> SchurDiagonalBlocks(const std::vector<std::pair<ulong, int>> &pose_blocks,
+                                           ThreadPool *pool = nullptr) const;
+
+    /// 转换为稠密矩阵，调试用
+    MatXX ToDense() const;
+
+    ulong Dim() const { return dense_dim_ + landmark_dim_; }
+    ulong DenseDim() const { return dense_dim_; }
+    ulong LandmarkDim() const { return landmark_dim_; }
+    size_t NumLandmarks() const { return Hpl_.size(); }
+
+    /// pose 部分
+    MatXX &DenseBlock() { return Hpp_; }
+    const MatXX &DenseBlock() const { return Hpp_; }
+
+    /// 第 l 个 landmark 的对角块
+    MatXX LandmarkBlock(size_t l) const {
+        return scalar_landmarks_ ? MatXX::Constant(1, 1, Hll_scalar_[l]) : Hll_[l];
+    }
+    /// 第 l 个 landmark 与 pose 之间的块
+    const std::vector<PoseLandmarkBlock> &PoseLandmarkBlocks(size_t l) const { return Hpl_[l]; }
+    /// 第 l 个 landmark 的 ordering
+    ulong LandmarkIndex(size_t l) const { return dense_dim_ + landmark_offsets_[l]; }
+
+    /// ordering 是否位于稠密的 pose 部分
+    bool IsDense(ulong index) const { return index < dense_dim_; }
+
+    /// 是否所有 landmark 都是 1 维，此时使用标量的快速路径
+    bool ScalarLandmarks() const { return scalar_landmarks_; }
+
+private:
+
+    /// Hll 的逆是否已经计算
+    bool LandmarksInverted() const {
+        return scalar_landmarks_ ? size_t(Hll_inv_scalar_.size()) == NumLandmarks() : Hll_inv_.size() == NumLandmarks();
+    }
+
+    /// 第 l 个 landmark 的维度
+    int LandmarkDimOf(size_t l) const { return scalar_landmarks_ ? 1 : int(Hll_[l].rows()); }
+
+    /// 由 ordering 找到 landmark 的序号
+    int LandmarkOf(ulong index) const { return landmark_of_offset_[index - dense_dim_]; }
+
+    /// 找到 (pose, landmark) 对应的块，不存在时新建
+    PoseLandmarkBlock &FindPoseLandmarkBlock(int landmark, ulong pose_index, int pose_dim);
+
+    ulong dense_dim_ = 0;
+    ulong landmark_dim_ = 0;
+
+    MatXX Hpp_;
+    std::vector<MatXX> Hll_;                // scalar_landmarks_ 时为空
+    std::vector<std::vector<PoseLandmarkBlock>> Hpl_;
+    std::vector<MatXX> Hll_inv_;            // SchurComplement 时缓存的 Hll 的逆
+    bool scalar_landmarks_ = false;         // 所有 landmark 都是 1 维
+    VecX Hll_scalar_;                       // scalar_landmarks_ 时代替 Hll_，第 l 个元素为第 l 个 landmark 的对角元
+    VecX Hll_inv_scalar_;                   // scalar_landmarks_ 时代替 Hll_inv_，第 l 个元素为 1 / Hll_scalar_[l]
+
+    std::vector<ulong> landmark_offsets_;   // 各 landmark 相对 dense_dim_ 的偏移
+    std::vector<int> landmark_of_offset_;   // 偏移 -> landmark 序号
+};
+
+}
+}
+
+#endif
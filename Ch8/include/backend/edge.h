@@ -59,7 +59,7 @@ public:
     }
 
     /// 返回所有顶点
-    std::vector<std::shared_ptr<Vertex>> Verticies() const {
+    const std::vector<std::shared_ptr<Vertex>> &Verticies() const {
         return verticies_;
     }
 
@@ -76,6 +76,17 @@ public:
     /// 本后端不支持自动求导，需要实现每个子类的雅可比计算方法
     virtual void ComputeJacobians() = 0;
 
+    /**
+     * 计算残差，need_jacobians 为 true 时同时计算雅可比
+     * 默认依次调用 ComputeResidual 和 ComputeJacobians；
+     * 子类可以重载，在一次计算中共享两者的中间结果（旋转、坐标变换等）
+     */
+    virtual void Evaluate(bool need_jacobians) {
+        ComputeResidual();
+        if (need_jacobians)
+            ComputeJacobians();
+    }
+
 //    ///计算该edge对Hession矩阵的影响，由子类实现
 //    virtual void ComputeHessionFactor() = 0;
 
@@ -87,7 +98,17 @@ public:
     VecX Residual() const { return residual_; }
 
     /// 返回雅可比
-    std::vector<MatXX> Jacobians() const { return jacobians_; }
+    virtual std::vector<MatXX> Jacobians() const { return jacobians_; }
+
+    /**
+     * 计算该边对 H 和 b 的贡献，调用前需先计算残差和雅可比
+     * 固定维度的边（FixedEdge）会重载为定长矩阵的实现
+     * @param index 各顶点的 ordering，小于 0 的顶点不参与计算
+     * @param hessians 输出 J_i^T W J_j，下标 i * n + j，n 为顶点个数
+     * @param gradients 输出 drho * J_i^T W r
+     */
+    virtual void LinearizeBlocks(const std::vector<int> &index, std::vector<MatXX> &hessians,
+                                 std::vector<VecX> &gradients) const;
 
     /// 设置信息矩阵
     void SetInformation(const MatXX &information) {
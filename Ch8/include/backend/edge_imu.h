@@ -1,69 +1,82 @@
-#ifndef MYSLAM_BACKEND_IMUEDGE_H
-#define MYSLAM_BACKEND_IMUEDGE_H
-
-#include <memory>
-#include <string>
-#include "../thirdparty/Sophus/sophus/se3.hpp"
-
-#include "eigen_types.h"
-#include "edge.h"
-#include "../factor/integration_base.h"
-
-namespace myslam {
-namespace backend {
-
-/**
- * 此边是IMU误差，此边为4元边，与之相连的顶点有：Pi Mi Pj Mj
- */
-class EdgeImu : public Edge {
-public:
-    EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
-
-    explicit EdgeImu(IntegrationBase* _pre_integration):pre_integration_(_pre_integration),
-          Edge(15, 4, std::vector<std::string>{"VertexPose", "VertexSpeedBias", "VertexPose", "VertexSpeedBias"}) {
-//        if (pre_integration_) {
-//            pre_integration_->GetJacobians(dr_dbg_, dv_dbg_, dv_dba_, dp_dbg_, dp_dba_);
-//            Mat99 cov_meas = pre_integration_->GetCovarianceMeasurement();
-//            Mat66 cov_rand_walk = pre_integration_->GetCovarianceRandomWalk();
-//            Mat1515 cov = Mat1515::Zero();
-//            cov.block<9, 9>(0, 0) = cov_meas;
-//            cov.block<6, 6>(9, 9) = cov_rand_walk;
-//            SetInformation(cov.inverse());
-//        }
-    }
-
-    /// 返回边的类型信息
-    virtual std::string TypeInfo() const override { return "EdgeImu"; }
-
-    /// 计算残差
-    virtual void ComputeResidual() override;
-
-    /// 计算雅可比
-    virtual void ComputeJacobians() override;
-
-//    static void SetGravity(const Vec3 &g) {
-//        gravity_ = g;
-//    }
-
-private:
-    enum StateOrder
-    {
-        O_P = 0,
-        O_R = 3,
-        O_V = 6,
-        O_BA = 9,
-        O_BG = 12
-    };
-    IntegrationBase* pre_integration_;
-    static Vec3 gravity_;
-
-    Mat33 dp_dba_ = Mat33::Zero();
-    Mat33 dp_dbg_ = Mat33::Zero();
-    Mat33 dr_dbg_ = Mat33::Zero();
-    Mat33 dv_dba_ = Mat33::Zero();
-    Mat33 dv_dbg_ = Mat33::Zero();
-};
-
-}
-}
-#endif
+#ifndef MYSLAM_BACKEND_IMUEDGE_H
+#define MYSLAM_BACKEND_IMUEDGE_H
+
+#include <memory>
+#include <string>
+#include "../thirdparty/Sophus/sophus/se3.hpp"
+
+#include "eigen_types.h"
+#include "fixed_edge.h"
+#include "../factor/integration_base.h"
+
+namespace myslam {
+namespace backend {
+
+/**
+ * 此边是IMU误差，此边为4元边，与之相连的顶点有：Pi Mi Pj Mj
+ */
+class EdgeImu : public FixedEdge<15, 6, 9, 6, 9> {
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+
+    explicit EdgeImu(IntegrationBase* _pre_integration):pre_integration_(_pre_integration),
+          FixedEdge(VertexTypes()) {
+//        if (pre_integration_) {
+//            pre_integration_->GetJacobians(dr_dbg_, dv_dbg_, dv_dba_, dp_dbg_, dp_dba_);
+//            Mat99 cov_meas = pre_integration_->GetCovarianceMeasurement();
+//            Mat66 cov_rand_walk = pre_integration_->GetCovarianceRandomWalk();
+//            Mat1515 cov = Mat1515::Zero();
+//            cov.block<9, 9>(0, 0) = cov_meas;
+//            cov.block<6, 6>(9, 9) = cov_rand_walk;
+//            SetInformation(cov.inverse());
+//        }
+    }
+
+    /// 返回边的类型信息
+    virtual std::string TypeInfo() const override { return "EdgeImu"; }
+
+    /// 计算残差
+    virtual void ComputeResidual() override { Evaluate(false); }
+
+    /// 计算雅可比
+    virtual void ComputeJacobians() override { Evaluate(true); }
+
+    /// 残差和雅可比共享状态量和预积分的零偏修正，信息矩阵只在预积分协方差变化时重新计算
+    virtual void Evaluate(bool need_jacobians) override;
+
+    /// 该边使用的预积分
+    IntegrationBase* PreIntegration() const { return pre_integration_; }
+
+//    static void SetGravity(const Vec3 &g) {
+//        gravity_ = g;
+//    }
+
+private:
+    /// 顶点类型只构造一次，创建边时不再分配临时的字符串
+    static const std::vector<std::string> &VertexTypes() {
+        static const std::vector<std::string> types{"VertexPose", "VertexSpeedBias", "VertexPose", "VertexSpeedBias"};
+        return types;
+    }
+
+    enum StateOrder
+    {
+        O_P = 0,
+        O_R = 3,
+        O_V = 6,
+        O_BA = 9,
+        O_BG = 12
+    };
+    IntegrationBase* pre_integration_;
+    static Vec3 gravity_;
+
+    Mat1515 information_covariance_ = Mat1515::Zero();   // 当前信息矩阵对应的预积分协方差
+    Mat33 dp_dba_ = Mat33::Zero();
+    Mat33 dp_dbg_ = Mat33::Zero();
+    Mat33 dr_dbg_ = Mat33::Zero();
+    Mat33 dv_dba_ = Mat33::Zero();
+    Mat33 dv_dbg_ = Mat33::Zero();
+};
+
+}
+}
+#endif
@@ -11,7 +11,7 @@
 #include <Eigen/Dense>
 
 #include "eigen_types.h"
-#include "edge.h"
+#include "fixed_edge.h"
 
 
 namespace myslam {
@@ -20,12 +20,12 @@ namespace backend {
 /**
 * EdgeSE3Prior，此边为 1 元边，与之相连的顶点有：Ti
 */
-class EdgeSE3Prior : public Edge {
+class EdgeSE3Prior : public FixedEdge<6, 6> {
 public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
 
     EdgeSE3Prior(const Vec3 &p, const Qd &q) :
-            Edge(6, 1, std::vector<std::string>{"VertexPose"}),
+            FixedEdge(std::vector<std::string>{"VertexPose"}),
             Pp_(p), Qp_(q) {}
 
     /// 返回边的类型信息
@@ -37,6 +37,8 @@ public:
     /// 计算雅可比
     virtual void ComputeJacobians() override;
 
+    const Vec3 &Pp() const { return Pp_; }
+    const Qd &Qp() const { return Qp_; }
 
 private:
     Vec3 Pp_;   // pose prior
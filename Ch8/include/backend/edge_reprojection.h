@@ -1,113 +1,144 @@
-#ifndef MYSLAM_BACKEND_VISUALEDGE_H
-#define MYSLAM_BACKEND_VISUALEDGE_H
-
-#include <memory>
-#include <string>
-
-#include <Eigen/Dense>
-
-#include "eigen_types.h"
-#include "edge.h"
-
-namespace myslam {
-namespace backend {
-
-/**
- * 此边是视觉重投影误差，此边为三元边，与之相连的顶点有：
- * 路标点的逆深度InveseDepth、第一次观测到该路标点的source Camera的位姿T_World_From_Body1，
- * 和观测到该路标点的mearsurement Camera位姿T_World_From_Body2。
- * 注意：verticies_顶点顺序必须为InveseDepth、T_World_From_Body1、T_World_From_Body2。
- */
-class EdgeReprojection : public Edge {
-public:
-    EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
-
-    EdgeReprojection(const Vec3 &pts_i, const Vec3 &pts_j)
-        : Edge(2, 4, std::vector<std::string>{"VertexInverseDepth", "VertexPose", "VertexPose", "VertexPose"}) {
-        pts_i_ = pts_i;
-        pts_j_ = pts_j;
-    }
-
-    /// 返回边的类型信息
-    virtual std::string TypeInfo() const override { return "EdgeReprojection"; }
-
-    /// 计算残差
-    virtual void ComputeResidual() override;
-
-    /// 计算雅可比
-    virtual void ComputeJacobians() override;
-
-//    void SetTranslationImuFromCamera(Eigen::Quaterniond &qic_, Vec3 &tic_);
-
-private:
-    //Translation imu from camera
-//    Qd qic;
-//    Vec3 tic;
-
-    //measurements
-    Vec3 pts_i_, pts_j_;
-};
-
-/**
-* 此边是视觉重投影误差，此边为二元边，与之相连的顶点有：
-* 路标点的世界坐标系XYZ、观测到该路标点的 Camera 的位姿T_World_From_Body1
-* 注意：verticies_顶点顺序必须为 XYZ、T_World_From_Body1。
-*/
-class EdgeReprojectionXYZ : public Edge {
-public:
-    EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
-
-    EdgeReprojectionXYZ(const Vec3 &pts_i)
-        : Edge(2, 2, std::vector<std::string>{"VertexXYZ", "VertexPose"}) {
-        obs_ = pts_i;
-    }
-
-    /// 返回边的类型信息
-    virtual std::string TypeInfo() const override { return "EdgeReprojectionXYZ"; }
-
-    /// 计算残差
-    virtual void ComputeResidual() override;
-
-    /// 计算雅可比
-    virtual void ComputeJacobians() override;
-
-    void SetTranslationImuFromCamera(Eigen::Quaterniond &qic_, Vec3 &tic_);
-
-private:
-    //Translation imu from camera
-    Qd qic;
-    Vec3 tic;
-
-    //measurements
-    Vec3 obs_;
-};
-
-/**
- * 仅计算重投影pose的例子
- */
-class EdgeReprojectionPoseOnly : public Edge {
-public:
-    EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
-
-    EdgeReprojectionPoseOnly(const Vec3 &landmark_world, const Mat33 &K) :
-        Edge(2, 1, std::vector<std::string>{"VertexPose"}),
-        landmark_world_(landmark_world), K_(K) {}
-
-    /// 返回边的类型信息
-    virtual std::string TypeInfo() const override { return "EdgeReprojectionPoseOnly"; }
-
-    /// 计算残差
-    virtual void ComputeResidual() override;
-
-    /// 计算雅可比
-    virtual void ComputeJacobians() override;
-
-private:
-    Vec3 landmark_world_;
-    Mat33 K_;
-};
-
-}
-}
-
-#endif
+#ifndef MYSLAM_BACKEND_VISUALEDGE_H
+#define MYSLAM_BACKEND_VISUALEDGE_H
+
+#include <memory>
+#include <string>
+
+#include <Eigen/Dense>
+
+#include "eigen_types.h"
+#include "fixed_edge.h"
+#include "edge_reprojection_batch.h"
+
+namespace myslam {
+namespace backend {
+
+/**
+ * 此边是视觉重投影误差，此边为三元边，与之相连的顶点有：
+ * 路标点的逆深度InveseDepth、第一次观测到该路标点的source Camera的位姿T_World_From_Body1，
+ * 和观测到该路标点的mearsurement Camera位姿T_World_From_Body2。
+ * 注意：verticies_顶点顺序必须为InveseDepth、T_World_From_Body1、T_World_From_Body2。
+ */
+class EdgeReprojection : public FixedEdge<2, 1, 6, 6, 6> {
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+
+    EdgeReprojection(const Vec3 &pts_i, const Vec3 &pts_j)
+        : FixedEdge(VertexTypes()) {
+        pts_i_ = pts_i;
+        pts_j_ = pts_j;
+    }
+
+    /// 返回边的类型信息
+    virtual std::string TypeInfo() const override { return "EdgeReprojection"; }
+
+    /// 计算残差
+    virtual void ComputeResidual() override { Evaluate(false); }
+
+    /// 计算雅可比
+    virtual void ComputeJacobians() override { Evaluate(true); }
+
+    /// 残差和雅可比共享位姿和点的坐标变换，只在需要雅可比时才转换旋转矩阵
+    virtual void Evaluate(bool need_jacobians) override;
+
+    /// 将顶点参数和观测写入 batch 的第 lane 条边，供 EvaluateReprojectionBatch 批量计算
+    void PackBatch(ReprojectionBatch &batch, int lane) const;
+
+    /// 从 batch 的第 lane 条边读回残差（和雅可比），效果与 Evaluate(need_jacobians) 相同
+    void UnpackBatch(const ReprojectionBatch &batch, int lane, bool need_jacobians);
+
+    /**
+     * 混合精度：用双精度计算各顶点的梯度，并把对称化的鲁棒信息矩阵写入 batch 的第 lane 条边，
+     * 之后由 EvaluateReprojectionHessianBatch 用 float 计算 J^T W J
+     */
+    void PackHessianBatch(ReprojectionBatch &batch, int lane, const std::vector<int> &index,
+                          std::vector<VecX> &gradients) const;
+
+    /// 从 batch 的第 lane 条边读回 J^T W J，按 LinearizeBlocks 的格式写入各块
+    void UnpackHessianBatch(const ReprojectionBatch &batch, int lane, const std::vector<int> &index,
+                            std::vector<MatXX> &hessians) const;
+
+//    void SetTranslationImuFromCamera(Eigen::Quaterniond &qic_, Vec3 &tic_);
+
+    /// 起始帧和当前帧中的归一化坐标
+    const Vec3 &PtsI() const { return pts_i_; }
+    const Vec3 &PtsJ() const { return pts_j_; }
+
+private:
+    /// 顶点类型只构造一次，创建边时不再分配临时的字符串
+    static const std::vector<std::string> &VertexTypes() {
+        static const std::vector<std::string> types{"VertexInverseDepth", "VertexPose", "VertexPose", "VertexPose"};
+        return types;
+    }
+
+    //Translation imu from camera
+//    Qd qic;
+//    Vec3 tic;
+
+    //measurements
+    Vec3 pts_i_, pts_j_;
+};
+
+/**
+* 此边是视觉重投影误差，此边为二元边，与之相连的顶点有：
+* 路标点的世界坐标系XYZ、观测到该路标点的 Camera 的位姿T_World_From_Body1
+* 注意：verticies_顶点顺序必须为 XYZ、T_World_From_Body1。
+*/
+class EdgeReprojectionXYZ : public FixedEdge<2, 3, 6> {
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+
+    EdgeReprojectionXYZ(const Vec3 &pts_i)
+        : FixedEdge(std::vector<std::string>{"VertexXYZ", "VertexPose"}) {
+        obs_ = pts_i;
+    }
+
+    /// 返回边的类型信息
+    virtual std::string TypeInfo() const override { return "EdgeReprojectionXYZ"; }
+
+    /// 计算残差
+    virtual void ComputeResidual() override;
+
+    /// 计算雅可比
+    virtual void ComputeJacobians() override;
+
+    void SetTranslationImuFromCamera(Eigen::Quaterniond &qic_, Vec3 &tic_);
+
+private:
+    //Translation imu from camera
+    Qd qic;
+    Vec3 tic;
+
+    //measurements
+    Vec3 obs_;
+};
+
+/**
+ * 仅计算重投影pose的例子
+ */
+class EdgeReprojectionPoseOnly : public FixedEdge<2, 6> {
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+
+    EdgeReprojectionPoseOnly(const Vec3 &landmark_world, const Mat33 &K) :
+        FixedEdge(std::vector<std::string>{"VertexPose"}),
+        landmark_world_(landmark_world), K_(K) {}
+
+    /// 返回边的类型信息
+    virtual std::string TypeInfo() const override { return "EdgeReprojectionPoseOnly"; }
+
+    /// 计算残差
+    virtual void ComputeResidual() override;
+
+    /// 计算雅可比
+    virtual void ComputeJacobians() override;
+
+private:
+    Vec3 landmark_world_;
+    Mat33 K_;
+};
+
+}
+}
+
+#endif
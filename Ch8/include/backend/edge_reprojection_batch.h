@@ -0,0 +1,70 @@
+#ifndef MYSLAM_BACKEND_EDGE_REPROJECTION_BATCH_H
+#define MYSLAM_BACKEND_EDGE_REPROJECTION_BATCH_H
+
+#include <vector>
+
+namespace myslam {
+namespace backend {
+
+/**
+ * 一批 EdgeReprojection 的输入和输出，按分量分开存放（SoA），第 k 条边的数据在各数组的第 k 个元素
+ *
+ * 只使用 double 数组，不包含 Eigen 类型。计算时转换为 ReprojectionBatchData 的裸指针，
+ * 交给运行时按 CPU 选择的 SIMD 实现（见 edge_reprojection_kernel.h）。
+ */
+struct ReprojectionBatch {
+    static const int kResidualDimension = 2;
+    static const int kJacobianCols = 19;    // 逆深度 1 + pose_i 6 + pose_j 6 + 外参 6，与 EdgeReprojection 的顶点顺序一致
+    static const int kHessianSize = kJacobianCols * (kJacobianCols + 1) / 2;
+
+    /// J^T W J 的上三角元素 (a, b)，a <= b，在 hessian 中的下标
+    static int HessianIndex(int a, int b) { return b * (b + 1) / 2 + a; }
+
+    /// 重新设定边数，已有数据不保留
+    void Resize(int n);
+    int Size() const { return size_; }
+
+    // 输入，四元数按 x y z w 排列
+    std::vector<double> inv_dep;
+    std::vector<double> pts_i[3];
+    std::vector<double> pts_j[2];
+    std::vector<double> qi[4], pi[3];
+    std::vector<double> qj[4], pj[3];
+    std::vector<double> qic[4], tic[3];
+
+    // 输出
+    std::vector<double> residual[kResidualDimension];
+    /// 雅可比 (r, c) 存放在 jacobian[c * 2 + r]，与 FixedEdge 列主序的定长雅可比一致
+    std::vector<double> jacobian[kResidualDimension * kJacobianCols];
+
+    // 混合精度的输入：鲁棒核加权后的信息矩阵 W（对称），按 W00 W01 W11 存放
+    std::vector<double> weight[3];
+    // 混合精度的输出：float 计算的 J^T W J 的上三角
+    std::vector<float> hessian[kHessianSize];
+
+private:
+    int size_ = 0;
+};
+
+/**
+ * 批量计算重投影残差和雅可比，结果与 EdgeReprojection::Evaluate 在舍入误差内一致
+ * 每次处理 ReprojectionBatchWidth() 条边，不足一组的尾部按标量计算
+ */
+void EvaluateReprojectionBatch(ReprojectionBatch &batch, bool need_jacobians);
+
+/**
+ * 混合精度：用 float 批量计算 J^T W J 的上三角，每条指令处理的边数是 double 的两倍
+ * 需先由 EvaluateReprojectionBatch 计算雅可比，并填好 weight
+ */
+void EvaluateReprojectionHessianBatch(ReprojectionBatch &batch);
+
+/// 每条指令处理的边数：AVX-512 为 8，AVX2 为 4，标量实现为 1
+int ReprojectionBatchWidth();
+
+/// 运行时选用的指令集，"AVX-512"、"AVX2" 或 "scalar"
+const char *ReprojectionBatchIsa();
+
+}
+}
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef MYSLAM_BACKEND_EDGE_REPROJECTION_KERNEL_H
+#define MYSLAM_BACKEND_EDGE_REPROJECTION_KERNEL_H
+
+namespace myslam {
+namespace backend {
+
+/**
+ * ReprojectionBatch 各数组的裸指针，传给按指令集分开编译的批量计算函数
+ *
+ * 不包含任何标准库和 Eigen 类型：以 -mavx2 等参数编译的源文件只通过它访问数据，
+ * 不会实例化出与其余代码同名、但用了更高指令集的 inline 函数。
+ */
+struct ReprojectionBatchData {
+    static const int kResidualDimension = 2;
+    static const int kJacobianCols = 19;
+    static const int kHessianSize = kJacobianCols * (kJacobianCols + 1) / 2;
+
+    int size;
+
+    const double *inv_dep;
+    const double *pts_i[3];
+    const double *pts_j[2];
+    const double *qi[4], *pi[3];
+    const double *qj[4], *pj[3];
+    const double *qic[4], *tic[3];
+
+    double *residual[kResidualDimension];
+    double *jacobian[kResidualDimension * kJacobianCols];
+
+    const double *weight[3];
+    float *hessian[kHessianSize];
+};
+
+/*
+ * 各指令集的实现，每个函数处理整批数据（包括不足一组的尾部）
+ * AVX2 和 AVX-512 版本只在打开对应的编译选项时存在，由 EvaluateReprojectionBatch 在运行时按 CPU 选择
+ */
+void EvaluateReprojectionScalar(const ReprojectionBatchData &data, bool need_jacobians);
+void EvaluateReprojectionHessianScalar(const ReprojectionBatchData &data);
+
+void EvaluateReprojectionAvx2(const ReprojectionBatchData &data, bool need_jacobians);
+void EvaluateReprojectionHessianAvx2(const ReprojectionBatchData &data);
+
+void EvaluateReprojectionAvx512(const ReprojectionBatchData &data, bool need_jacobians);
+void EvaluateReprojectionHessianAvx512(const ReprojectionBatchData &data);
+
+}
+}
+
+#endif
@@ -0,0 +1,377 @@
+#ifndef MYSLAM_BACKEND_EDGE_REPROJECTION_KERNEL_IMPL_H
+#define MYSLAM_BACKEND_EDGE_REPROJECTION_KERNEL_IMPL_H
+
+/*
+ * 重投影边批量计算的模板实现，只由各指令集的 edge_reprojection_batch*.cc 包含
+ * 全部放在匿名命名空间中：每个源文件得到自己的一份实例，不同编译参数的代码不会在链接时互相替换
+ */
+
+#include "edge_reprojection_kernel.h"
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace myslam {
+namespace backend {
+namespace {
+
+/*
+ * 每个 Packet 同时保存 kWidth 条边的同一个分量，计算过程只用到加减乘除，
+ * 同一份模板代码分别实例化为标量、AVX2 和 AVX-512 版本
+ */
+struct PacketScalar {
+    static const int kWidth = 1;
+    double v;
+    PacketScalar() {}
+    PacketScalar(double x) : v(x) {}
+    static PacketScalar Load(const double *p) { return PacketScalar(*p); }
+    void Store(double *p) const { *p = v; }
+};
+inline PacketScalar operator+(PacketScalar a, PacketScalar b) { return PacketScalar(a.v + b.v); }
+inline PacketScalar operator-(PacketScalar a, PacketScalar b) { return PacketScalar(a.v - b.v); }
+inline PacketScalar operator*(PacketScalar a, PacketScalar b) { return PacketScalar(a.v * b.v); }
+inline PacketScalar operator/(PacketScalar a, PacketScalar b) { return PacketScalar(a.v / b.v); }
+inline PacketScalar operator-(PacketScalar a) { return PacketScalar(-a.v); }
+
+#ifdef __AVX2__
+struct PacketAvx2 {
+    static const int kWidth = 4;
+    __m256d v;
+    PacketAvx2() {}
+    PacketAvx2(__m256d x) : v(x) {}
+    PacketAvx2(double x) : v(_mm256_set1_pd(x)) {}
+    static PacketAvx2 Load(const double *p) { return PacketAvx2(_mm256_loadu_pd(p)); }
+    void Store(double *p) const { _mm256_storeu_pd(p, v); }
+};
+inline PacketAvx2 operator+(PacketAvx2 a, PacketAvx2 b) { return PacketAvx2(_mm256_add_pd(a.v, b.v)); }
+inline PacketAvx2 operator-(PacketAvx2 a, PacketAvx2 b) { return PacketAvx2(_mm256_sub_pd(a.v, b.v)); }
+inline PacketAvx2 operator*(PacketAvx2 a, PacketAvx2 b) { return PacketAvx2(_mm256_mul_pd(a.v, b.v)); }
+inline PacketAvx2 operator/(PacketAvx2 a, PacketAvx2 b) { return PacketAvx2(_mm256_div_pd(a.v, b.v)); }
+inline PacketAvx2 operator-(PacketAvx2 a) { return PacketAvx2(_mm256_xor_pd(a.v, _mm256_set1_pd(-0.0))); }
+#endif
+
+#ifdef __AVX512F__
+struct PacketAvx512 {
+    static const int kWidth = 8;
+    __m512d v;
+    PacketAvx512() {}
+    PacketAvx512(__m512d x) : v(x) {}
+    PacketAvx512(double x) : v(_mm512_set1_pd(x)) {}
+    static PacketAvx512 Load(const double *p) { return PacketAvx512(_mm512_loadu_pd(p)); }
+    void Store(double *p) const { _mm512_storeu_pd(p, v); }
+};
+inline PacketAvx512 operator+(PacketAvx512 a, PacketAvx512 b) { return PacketAvx512(_mm512_add_pd(a.v, b.v)); }
+inline PacketAvx512 operator-(PacketAvx512 a, PacketAvx512 b) { return PacketAvx512(_mm512_sub_pd(a.v, b.v)); }
+inline PacketAvx512 operator*(PacketAvx512 a, PacketAvx512 b) { return PacketAvx512(_mm512_mul_pd(a.v, b.v)); }
+inline PacketAvx512 operator/(PacketAvx512 a, PacketAvx512 b) { return PacketAvx512(_mm512_div_pd(a.v, b.v)); }
+inline PacketAvx512 operator-(PacketAvx512 a) { return PacketAvx512(_mm512_sub_pd(_mm512_setzero_pd(), a.v)); }
+#endif
+
+/*
+ * float 版本的 Packet，只用于 J^T W J：从 double 数组读入时转换，结果写入 float 数组
+ */
+struct PacketScalarF {
+    static const int kWidth = 1;
+    float v;
+    PacketScalarF() {}
+    PacketScalarF(float x) : v(x) {}
+    static PacketScalarF Load(const double *p) { return PacketScalarF(static_cast<float>(*p)); }
+    void Store(float *p) const { *p = v; }
+};
+inline PacketScalarF operator+(PacketScalarF a, PacketScalarF b) { return PacketScalarF(a.v + b.v); }
+inline PacketScalarF operator*(PacketScalarF a, PacketScalarF b) { return PacketScalarF(a.v * b.v); }
+
+#ifdef __AVX2__
+struct PacketAvx2F {
+    static const int kWidth = 8;
+    __m256 v;
+    PacketAvx2F() {}
+    PacketAvx2F(__m256 x) : v(x) {}
+    static PacketAvx2F Load(const double *p) {
+        __m128 lo = _mm256_cvtpd_ps(_mm256_loadu_pd(p));
+        __m128 hi = _mm256_cvtpd_ps(_mm256_loadu_pd(p + 4));
+        return PacketAvx2F(_mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1));
+    }
+    void Store(float *p) const { _mm256_storeu_ps(p, v); }
+};
+inline PacketAvx2F operator+(PacketAvx2F a, PacketAvx2F b) { return PacketAvx2F(_mm256_add_ps(a.v, b.v)); }
+inline PacketAvx2F operator*(PacketAvx2F a, PacketAvx2F b) { return PacketAvx2F(_mm256_mul_ps(a.v, b.v)); }
+#endif
+
+#ifdef __AVX512F__
+struct PacketAvx512F {
+    static const int kWidth = 16;
+    __m512 v;
+    PacketAvx512F() {}
+    PacketAvx512F(__m512 x) : v(x) {}
+    static PacketAvx512F Load(const double *p) {
+        // 全选的 maskz 版本结果不变，不带 mask 的版本在 GCC 12 的头文件中会误报未初始化
+        __m256 lo = _mm512_maskz_cvtpd_ps(0xFF, _mm512_loadu_pd(p));
+        __m256 hi = _mm512_maskz_cvtpd_ps(0xFF, _mm512_loadu_pd(p + 8));
+        __m512d both = _mm512_maskz_insertf64x4(0xFF, _mm512_castpd256_pd512(_mm256_castps_pd(lo)),
+                                                _mm256_castps_pd(hi), 1);
+        return PacketAvx512F(_mm512_castpd_ps(both));
+    }
+    void Store(float *p) const { _mm512_storeu_ps(p, v); }
+};
+inline PacketAvx512F operator+(PacketAvx512F a, PacketAvx512F b) { return PacketAvx512F(_mm512_add_ps(a.v, b.v)); }
+inline PacketAvx512F operator*(PacketAvx512F a, PacketAvx512F b) { return PacketAvx512F(_mm512_mul_ps(a.v, b.v)); }
+#endif
+
+/// 与 ReprojectionBatch::HessianIndex 相同
+inline int HessianIndex(int a, int b) { return b * (b + 1) / 2 + a; }
+
+template <typename P>
+struct V3 {
+    P x, y, z;
+};
+
+template <typename P>
+struct M3 {
+    P m[3][3];
+};
+
+template <typename P>
+struct Quat {
+    P x, y, z, w;
+};
+
+template <typename P>
+inline V3<P> Add(const V3<P> &a, const V3<P> &b) { return V3<P>{a.x + b.x, a.y + b.y, a.z + b.z}; }
+
+template <typename P>
+inline V3<P> Sub(const V3<P> &a, const V3<P> &b) { return V3<P>{a.x - b.x, a.y - b.y, a.z - b.z}; }
+
+template <typename P>
+inline V3<P> Cross(const V3<P> &a, const V3<P> &b) {
+    return V3<P>{a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+
+/// 与 Eigen 的 Quaternion * Vector3 相同：v + w * 2(u x v) + u x 2(u x v)
+template <typename P>
+inline V3<P> Rotate(const Quat<P> &q, const V3<P> &v) {
+    V3<P> u{q.x, q.y, q.z};
+    V3<P> uv = Cross(u, v);
+    uv = Add(uv, uv);
+    V3<P> u_uv = Cross(u, uv);
+    return V3<P>{v.x + q.w * uv.x + u_uv.x, v.y + q.w * uv.y + u_uv.y, v.z + q.w * uv.z + u_uv.z};
+}
+
+/// 与 Eigen 的 Quaternion::inverse 相同：共轭除以模的平方
+template <typename P>
+inline Quat<P> Inverse(const Quat<P> &q) {
+    P n2 = q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w;
+    return Quat<P>{-q.x / n2, -q.y / n2, -q.z / n2, q.w / n2};
+}
+
+/// 与 Eigen 的 Quaternion::toRotationMatrix 相同
+template <typename P>
+inline M3<P> ToRotationMatrix(const Quat<P> &q) {
+    P tx = q.x + q.x, ty = q.y + q.y, tz = q.z + q.z;
+    P twx = tx * q.w, twy = ty * q.w, twz = tz * q.w;
+    P txx = tx * q.x, txy = ty * q.x, txz = tz * q.x;
+    P tyy = ty * q.y, tyz = tz * q.y, tzz = tz * q.z;
+    P one(1.);
+    M3<P> R;
+    R.m[0][0] = one - (tyy + tzz);
+    R.m[0][1] = txy - twz;
+    R.m[0][2] = txz + twy;
+    R.m[1][0] = txy + twz;
+    R.m[1][1] = one - (txx + tzz);
+    R.m[1][2] = tyz - twx;
+    R.m[2][0] = txz - twy;
+    R.m[2][1] = tyz + twx;
+    R.m[2][2] = one - (txx + tyy);
+    return R;
+}
+
+template <typename P>
+inline M3<P> Mul(const M3<P> &a, const M3<P> &b) {
+    M3<P> c;
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            c.m[i][j] = a.m[i][0] * b.m[0][j] + a.m[i][1] * b.m[1][j] + a.m[i][2] * b.m[2][j];
+        }
+    }
+    return c;
+}
+
+template <typename P>
+inline V3<P> Mul(const M3<P> &a, const V3<P> &v) {
+    return V3<P>{a.m[0][0] * v.x + a.m[0][1] * v.y + a.m[0][2] * v.z,
+                 a.m[1][0] * v.x + a.m[1][1] * v.y + a.m[1][2] * v.z,
+                 a.m[2][0] * v.x + a.m[2][1] * v.y + a.m[2][2] * v.z};
+}
+
+template <typename P>
+inline M3<P> Transpose(const M3<P> &a) {
+    M3<P> t;
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            t.m[i][j] = a.m[j][i];
+        }
+    }
+    return t;
+}
+
+template <typename P>
+inline M3<P> Hat(const V3<P> &v) {
+    P zero(0.);
+    M3<P> h;
+    h.m[0][0] = zero;  h.m[0][1] = -v.z;  h.m[0][2] = v.y;
+    h.m[1][0] = v.z;   h.m[1][1] = zero;  h.m[1][2] = -v.x;
+    h.m[2][0] = -v.y;  h.m[2][1] = v.x;   h.m[2][2] = zero;
+    return h;
+}
+
+template <typename P>
+inline V3<P> LoadV3(const double *const *a, int i) {
+    return V3<P>{P::Load(a[0] + i), P::Load(a[1] + i), P::Load(a[2] + i)};
+}
+
+template <typename P>
+inline Quat<P> LoadQuat(const double *const *a, int i) {
+    return Quat<P>{P::Load(a[0] + i), P::Load(a[1] + i), P::Load(a[2] + i), P::Load(a[3] + i)};
+}
+
+/// reduce * M 的第 col 到 col + 2 列，reduce = [a 0 b0; 0 a b1]
+template <typename P>
+inline void StoreReduced(const ReprojectionBatchData &data, int i, int col, const P &a, const P &b0, const P &b1,
+                         const M3<P> &M) {
+    for (int c = 0; c < 3; ++c) {
+        (a * M.m[0][c] + b0 * M.m[2][c]).Store(&data.jacobian[(col + c) * 2][i]);
+        (a * M.m[1][c] + b1 * M.m[2][c]).Store(&data.jacobian[(col + c) * 2 + 1][i]);
+    }
+}
+
+/// 计算第 i 到 i + P::kWidth - 1 条边，公式与 EdgeReprojection::Evaluate 一致
+template <typename P>
+void EvaluateLanes(const ReprojectionBatchData &data, int i, bool need_jacobians) {
+    P inv_dep_i = P::Load(&data.inv_dep[i]);
+    V3<P> pts_i = LoadV3<P>(data.pts_i, i);
+    Quat<P> Qi = LoadQuat<P>(data.qi, i);
+    V3<P> Pi = LoadV3<P>(data.pi, i);
+    Quat<P> Qj = LoadQuat<P>(data.qj, i);
+    V3<P> Pj = LoadV3<P>(data.pj, i);
+    Quat<P> qic = LoadQuat<P>(data.qic, i);
+    V3<P> tic = LoadV3<P>(data.tic, i);
+
+    V3<P> pts_camera_i{pts_i.x / inv_dep_i, pts_i.y / inv_dep_i, pts_i.z / inv_dep_i};
+    V3<P> pts_imu_i = Add(Rotate(qic, pts_camera_i), tic);
+    V3<P> pts_w = Add(Rotate(Qi, pts_imu_i), Pi);
+    V3<P> pts_imu_j = Rotate(Inverse(Qj), Sub(pts_w, Pj));
+    V3<P> pts_camera_j = Rotate(Inverse(qic), Sub(pts_imu_j, tic));
+
+    P dep_j = pts_camera_j.z;
+    (pts_camera_j.x / dep_j - P::Load(&data.pts_j[0][i])).Store(&data.residual[0][i]);
+    (pts_camera_j.y / dep_j - P::Load(&data.pts_j[1][i])).Store(&data.residual[1][i]);
+
+    if (!need_jacobians)
+        return;
+
+    M3<P> Ri = ToRotationMatrix(Qi);
+    M3<P> Rj = ToRotationMatrix(Qj);
+    M3<P> ric = ToRotationMatrix(qic);
+    M3<P> ricT = Transpose(ric);
+    M3<P> RjT = Transpose(Rj);
+    P dep_j2 = dep_j * dep_j;
+    P a = P(1.) / dep_j;
+    P b0 = -pts_camera_j.x / dep_j2;
+    P b1 = -pts_camera_j.y / dep_j2;
+
+    M3<P> ricT_RjT = Mul(ricT, RjT);
+    M3<P> ricT_RjT_Ri = Mul(ricT_RjT, Ri);
+    M3<P> tmp_r = Mul(ricT_RjT_Ri, ric);
+
+    // 逆深度
+    V3<P> f = Mul(tmp_r, pts_i);
+    P scale = P(-1.) / (inv_dep_i * inv_dep_i);
+    ((a * f.x + b0 * f.z) * scale).Store(&data.jacobian[0][i]);
+    ((a * f.y + b1 * f.z) * scale).Store(&data.jacobian[1][i]);
+
+    // pose_i
+    StoreReduced(data, i, 1, a, b0, b1, ricT_RjT);
+    StoreReduced(data, i, 4, a, b0, b1, Mul(ricT_RjT_Ri, Hat(V3<P>{-pts_imu_i.x, -pts_imu_i.y, -pts_imu_i.z})));
+
+    // pose_j
+    M3<P> neg_ricT_RjT;
+    for (int r = 0; r < 3; ++r) {
+        for (int c = 0; c < 3; ++c) {
+            neg_ricT_RjT.m[r][c] = -ricT_RjT.m[r][c];
+        }
+    }
+    StoreReduced(data, i, 7, a, b0, b1, neg_ricT_RjT);
+    StoreReduced(data, i, 10, a, b0, b1, Mul(ricT, Hat(pts_imu_j)));
+
+    // 外参
+    M3<P> RjT_Ri = Mul(RjT, Ri);
+    for (int r = 0; r < 3; ++r) {
+        RjT_Ri.m[r][r] = RjT_Ri.m[r][r] - P(1.);
+    }
+    StoreReduced(data, i, 13, a, b0, b1, Mul(ricT, RjT_Ri));
+
+    M3<P> term0 = Mul(tmp_r, Hat(pts_camera_i));
+    M3<P> term1 = Hat(Mul(tmp_r, pts_camera_i));
+    V3<P> t = Sub(Mul(RjT, Sub(Add(Mul(Ri, tic), Pi), Pj)), tic);
+    M3<P> term2 = Hat(Mul(ricT, t));
+    M3<P> jaco_ex_r;
+    for (int r = 0; r < 3; ++r) {
+        for (int c = 0; c < 3; ++c) {
+            jaco_ex_r.m[r][c] = -term0.m[r][c] + term1.m[r][c] + term2.m[r][c];
+        }
+    }
+    StoreReduced(data, i, 16, a, b0, b1, jaco_ex_r);
+}
+
+/// 第 i 到 i + P::kWidth - 1 条边的 J^T W J，雅可比转换为 float 后只读一次
+template <typename P>
+void HessianLanes(const ReprojectionBatchData &data, int i) {
+    const int kCols = ReprojectionBatchData::kJacobianCols;
+    P w00 = P::Load(&data.weight[0][i]);
+    P w01 = P::Load(&data.weight[1][i]);
+    P w11 = P::Load(&data.weight[2][i]);
+    P J0[kCols], J1[kCols], WJ0[kCols], WJ1[kCols];
+    for (int c = 0; c < kCols; ++c) {
+        J0[c] = P::Load(&data.jacobian[c * 2][i]);
+        J1[c] = P::Load(&data.jacobian[c * 2 + 1][i]);
+        WJ0[c] = w00 * J0[c] + w01 * J1[c];
+        WJ1[c] = w01 * J0[c] + w11 * J1[c];
+    }
+    for (int b = 0; b < kCols; ++b) {
+        for (int a = 0; a <= b; ++a) {
+            (J0[a] * WJ0[b] + J1[a] * WJ1[b]).Store(&data.hessian[HessianIndex(a, b)][i]);
+        }
+    }
+}
+
+/// 整批计算：按 P 每次处理 P::kWidth 条边，不足一组的尾部按标量计算
+template <typename P>
+void EvaluateRange(const ReprojectionBatchData &data, bool need_jacobians) {
+    int n = data.size;
+    int i = 0;
+    for (; i + P::kWidth <= n; i += P::kWidth) {
+        EvaluateLanes<P>(data, i, need_jacobians);
+    }
+    for (; i < n; ++i) {
+        EvaluateLanes<PacketScalar>(data, i, need_jacobians);
+    }
+}
+
+template <typename P>
+void HessianRange(const ReprojectionBatchData &data) {
+    int n = data.size;
+    int i = 0;
+    for (; i + P::kWidth <= n; i += P::kWidth) {
+        HessianLanes<P>(data, i);
+    }
+    for (; i < n; ++i) {
+        HessianLanes<PacketScalarF>(data, i);
+    }
+}
+
+}
+}
+}
+
+#endif
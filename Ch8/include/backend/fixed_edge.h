@@ -0,0 +1,202 @@
+#ifndef MYSLAM_BACKEND_FIXED_EDGE_H
+#define MYSLAM_BACKEND_FIXED_EDGE_H
+
+#include <cassert>
+#include "edge.h"
+#include "vertex.h"
+
+namespace myslam {
+namespace backend {
+
+namespace internal {
+
+/// 各顶点维度之和
+template <int... Dims>
+struct DimSum;
+template <>
+struct DimSum<> {
+    static const int value = 0;
+};
+template <int D, int... Rest>
+struct DimSum<D, Rest...> {
+    static const int value = D + DimSum<Rest...>::value;
+};
+
+/// 第 I 个顶点的维度
+template <int I, int... Dims>
+struct DimAt;
+template <int D, int... Rest>
+struct DimAt<0, D, Rest...> {
+    static const int value = D;
+};
+template <int I, int D, int... Rest>
+struct DimAt<I, D, Rest...> {
+    static const int value = DimAt<I - 1, Rest...>::value;
+};
+
+/// 第 I 个顶点之前所有顶点的维度之和
+template <int I, int... Dims>
+struct DimOffset;
+template <int D, int... Rest>
+struct DimOffset<0, D, Rest...> {
+    static const int value = 0;
+};
+template <int I, int D, int... Rest>
+struct DimOffset<I, D, Rest...> {
+    static const int value = D + DimOffset<I - 1, Rest...>::value;
+};
+
+}
+
+/**
+ * @brief 残差维度和顶点维度在编译期确定的边
+ *
+ * 各顶点的雅可比按顶点顺序拼成一个定长的 ResDim x sum(VertexDims) 矩阵 jacobian_，
+ * 子类在 ComputeJacobians 中通过 Jacobian<I>() 写入第 I 个顶点的雅可比。
+ * LinearizeBlocks 使用定长矩阵计算 J^T W J 和 J^T W r，计算过程中不需要分配内存。
+ *
+ * residual_ 和 information_ 仍使用基类的动态矩阵存放（构造时分配，尺寸不变），
+ * 这里通过 Map 以定长类型访问。
+ *
+ * @tparam ResDim 残差维度
+ * @tparam VertexDims 各顶点的本地参数化维度，顺序与 verticies_ 一致
+ */
+template <int ResDim, int... VertexDims>
+class FixedEdge : public Edge {
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+
+    static const int kResidualDimension = ResDim;
+    static const int kNumVertices = sizeof...(VertexDims);
+    static const int kJacobianCols = internal::DimSum<VertexDims...>::value;
+
+    typedef Eigen::Matrix<double, ResDim, 1> ResidualType;
+    typedef Eigen::Matrix<double, ResDim, ResDim> InformationType;
+    typedef Eigen::Matrix<double, ResDim, kJacobianCols> JacobianType;
+
+    /// 第 I 个顶点的本地维度
+    template <int I>
+    struct VertexDimension {
+        static const int value = internal::DimAt<I, VertexDims...>::value;
+    };
+
+    /// 第 I 个顶点的雅可比在 jacobian_ 中的起始列
+    template <int I>
+    struct VertexOffset {
+        static const int value = internal::DimOffset<I, VertexDims...>::value;
+    };
+
+    explicit FixedEdge(const std::vector<std::string> &verticies_types = std::vector<std::string>())
+        : Edge(ResDim, kNumVertices, verticies_types) {
+        sqrt_information_ = InformationType::Identity();
+        jacobian_.setZero();
+    }
+
+    /// 第 I 个顶点的雅可比，ResDim x VertexDimension<I>
+    template <int I>
+    Eigen::Block<JacobianType, ResDim, VertexDimension<I>::value> Jacobian() {
+        return Eigen::Block<JacobianType, ResDim, VertexDimension<I>::value>(jacobian_, 0, VertexOffset<I>::value);
+    }
+
+    /// 所有顶点的雅可比拼成的矩阵
+    const JacobianType &StackedJacobian() const { return jacobian_; }
+
+    virtual std::vector<MatXX> Jacobians() const override {
+        const int dims[] = {VertexDims...};
+        std::vector<MatXX> jacobians(kNumVertices);
+        for (int i = 0, offset = 0; i < kNumVertices; offset += dims[i], ++i) {
+            jacobians[i] = jacobian_.middleCols(offset, dims[i]);
+        }
+        return jacobians;
+    }
+
+    /**
+     * 鲁棒核函数加权后的信息矩阵 W（与 Edge::RobustInfo 相同）和核函数的一阶导数 drho，
+     * LinearizeBlocks 中 H = J^T W J
+     */
+    InformationType RobustInformation(double &drho) const {
+        Eigen::Map<const ResidualType> residual(residual_.data());
+        Eigen::Map<const InformationType> information(information_.data());
+        drho = 1.;
+        if (!lossfunction_)
+            return information;
+
+        double e2 = residual.dot(information * residual);
+        Eigen::Vector3d rho;
+        lossfunction_->Compute(e2, rho);
+        ResidualType weight_err = Eigen::Map<const InformationType>(sqrt_information_.data()) * residual;
+
+        InformationType robust = rho[1] * InformationType::Identity();
+        if (rho[1] + 2 * rho[2] * e2 > 0.)
+            robust += 2 * rho[2] * weight_err * weight_err.transpose();
+        drho = rho[1];
+        return robust * information;
+    }
+
+    /// 只计算各顶点的梯度 drho * J_i^T W r，H 的各块在别处计算时使用
+    void LinearizeGradients(const std::vector<int> &index, double drho, std::vector<VecX> &gradients) const {
+        assert(index.size() == size_t(kNumVertices));
+        Eigen::Map<const ResidualType> residual(residual_.data());
+        Eigen::Map<const InformationType> information(information_.data());
+        Eigen::Matrix<double, kJacobianCols, 1> g = jacobian_.transpose() * (drho * information * residual);
+
+        const int dims[] = {VertexDims...};
+        for (int i = 0, offset = 0; i < kNumVertices; offset += dims[i], ++i) {
+            if (index[i] >= 0)
+                gradients[i] = g.segment(offset, dims[i]);
+        }
+    }
+
+    virtual void LinearizeBlocks(const std::vector<int> &index, std::vector<MatXX> &hessians,
+                                 std::vector<VecX> &gradients) const override {
+        assert(index.size() == size_t(kNumVertices));
+        Eigen::Map<const ResidualType> residual(residual_.data());
+        Eigen::Map<const InformationType> information(information_.data());
+
+        double drho;
+        InformationType robust_info = RobustInformation(drho);
+
+        Eigen::Matrix<double, kJacobianCols, ResDim> JtW = jacobian_.transpose() * robust_info;
+        Eigen::Matrix<double, kJacobianCols, kJacobianCols> H = JtW * jacobian_;
+        Eigen::Matrix<double, kJacobianCols, 1> g = jacobian_.transpose() * (drho * information * residual);
+
+        const int dims[] = {VertexDims...};
+        int offsets[kNumVertices];
+        for (int i = 0, offset = 0; i < kNumVertices; offset += dims[i], ++i) {
+            offsets[i] = offset;
+        }
+
+        const int n = kNumVertices;
+        for (int i = 0; i < n; ++i) {
+            if (index[i] < 0) continue;
+            for (int j = i; j < n; ++j) {
+                if (index[j] < 0) continue;
+                hessians[i * n + j] = H.block(offsets[i], offsets[j], dims[i], dims[j]);
+                if (j != i)
+                    hessians[j * n + i] = hessians[i * n + j].transpose();
+            }
+            gradients[i] = g.segment(offsets[i], dims[i]);
+        }
+    }
+
+protected:
+    /// 以定长向量的形式访问第 i 个顶点的参数，Dim 为顶点自身维度
+    template <int Dim>
+    Eigen::Map<const Eigen::Matrix<double, Dim, 1>> VertexParameters(int i) const {
+        assert(verticies_[i]->Dimension() == Dim);
+        return Eigen::Map<const Eigen::Matrix<double, Dim, 1>>(verticies_[i]->Parameters().data());
+    }
+
+    /// 设置定长的信息矩阵，用于每次计算残差都会更新信息矩阵的边，避免动态分配
+    void SetFixedInformation(const InformationType &information) {
+        information_ = information;
+        sqrt_information_ = Eigen::LLT<InformationType>(information).matrixL().transpose();
+    }
+
+    JacobianType jacobian_;     // 各顶点的雅可比，按顶点顺序拼接
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef MYSLAM_BACKEND_FIXED_VERTEX_H
+#define MYSLAM_BACKEND_FIXED_VERTEX_H
+
+#include "vertex.h"
+
+namespace myslam {
+namespace backend {
+
+/**
+ * @brief 维度在编译期确定的顶点
+ *
+ * 变量仍存放在基类的 VecX 中（构造时分配一次，之后不再分配），
+ * 通过 FixedParameters() 以定长类型访问，避免每次读参数时拷贝出一个 VecX。
+ *
+ * @tparam Dim 顶点自身维度
+ * @tparam LocalDim 本地参数化维度
+ */
+template <int Dim, int LocalDim = Dim>
+class FixedVertex : public Vertex {
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+
+    static const int kDimension = Dim;
+    static const int kLocalDimension = LocalDim;
+
+    typedef Eigen::Matrix<double, Dim, 1> ParameterType;
+    typedef Eigen::Matrix<double, LocalDim, 1> DeltaType;
+
+    FixedVertex() : Vertex(Dim, LocalDim) {}
+
+    /// 以定长向量的形式访问参数
+    Eigen::Map<ParameterType> FixedParameters() {
+        return Eigen::Map<ParameterType>(parameters_.data());
+    }
+    Eigen::Map<const ParameterType> FixedParameters() const {
+        return Eigen::Map<const ParameterType>(parameters_.data());
+    }
+};
+
+}
+}
+
+#endif
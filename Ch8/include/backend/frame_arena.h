@@ -0,0 +1,103 @@
+#ifndef MYSLAM_BACKEND_FRAME_ARENA_H
+#define MYSLAM_BACKEND_FRAME_ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace myslam {
+namespace backend {
+
+/**
+ * 后端顶点和边的内存池
+ *
+ * 从大块内存中按 64 字节对齐依次切分，释放的小块按大小挂到空闲链表上，供之后的同尺寸分配复用，
+ * 不归还给系统。所有分配都释放后（例如重置 problem），整体回退到第一个内存块，相当于一次性释放。
+ *
+ * 滑窗中的顶点和边会跨越多帧存活，不能按帧整体释放，因此按帧统计分配次数和字节数，
+ * 由 EndFrame 取出并清零。
+ *
+ * 只在一个线程中分配和释放（estimator 的后端线程），不加锁。
+ */
+class FrameArena {
+public:
+    static const size_t kAlignment = 64;
+
+    struct Stats {
+        size_t allocations = 0;         // 本帧的分配次数
+        size_t bytes = 0;               // 本帧分配的字节数（按对齐后的大小计）
+        size_t reused = 0;              // 其中从空闲链表复用的次数
+        size_t system_allocations = 0;  // 本帧向系统申请内存的次数
+        size_t live_bytes = 0;          // 仍在使用的字节数
+        size_t reserved_bytes = 0;      // 向系统申请的内存总量
+    };
+
+    explicit FrameArena(size_t block_bytes = 256 * 1024);
+    ~FrameArena();
+
+    FrameArena(const FrameArena &) = delete;
+    FrameArena &operator=(const FrameArena &) = delete;
+
+    /// 按 kAlignment 对齐分配，超过内存块四分之一的请求直接向系统申请
+    void *Allocate(size_t bytes);
+    /// bytes 必须与分配时相同。最后一个分配释放时回退所有内存块
+    void Deallocate(void *p, size_t bytes);
+
+    /// 本帧到目前为止的统计
+    Stats CurrentFrame() const;
+    /// 结束一帧：返回本帧的统计并清零计数
+    Stats EndFrame();
+
+private:
+    static size_t RoundUp(size_t bytes) { return (bytes + kAlignment - 1) / kAlignment * kAlignment; }
+    void Rewind();
+
+    size_t block_bytes_;
+    std::vector<char *> blocks_;
+    size_t block_index_ = 0;            // 当前切分的内存块
+    char *cursor_ = nullptr;
+    char *end_ = nullptr;
+    std::vector<void *> free_lists_;    // 第 k 个链表存放 (k + 1) * kAlignment 字节的空闲块
+    size_t live_allocations_ = 0;
+    size_t live_bytes_ = 0;
+    size_t reserved_bytes_ = 0;
+    Stats frame_;
+};
+
+/// 从 FrameArena 分配的 STL 分配器，持有 arena 的引用计数，最后一个对象释放之前 arena 不会析构
+template <typename T>
+class ArenaAllocator {
+public:
+    typedef T value_type;
+
+    explicit ArenaAllocator(const std::shared_ptr<FrameArena> &arena) : arena_(arena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena_(other.arena_) {}
+
+    T *allocate(size_t n) { return static_cast<T *>(arena_->Allocate(n * sizeof(T))); }
+    void deallocate(T *p, size_t n) { arena_->Deallocate(p, n * sizeof(T)); }
+
+    std::shared_ptr<FrameArena> arena_;
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) { return a.arena_ == b.arena_; }
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) { return a.arena_ != b.arena_; }
+
+/**
+ * 在 arena 中构造对象，对象和 shared_ptr 的控制块在同一次分配中
+ * arena 为空时退回到 new，与原先的创建方式相同
+ */
+template <typename T, typename... Args>
+std::shared_ptr<T> MakeArenaShared(const std::shared_ptr<FrameArena> &arena, Args &&... args) {
+    if (!arena)
+        return std::shared_ptr<T>(new T(std::forward<Args>(args)...));
+    return std::allocate_shared<T>(ArenaAllocator<T>(arena), std::forward<Args>(args)...);
+}
+
+}
+}
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef MYSLAM_BACKEND_HESSIAN_BUILD_TUNER_H
+#define MYSLAM_BACKEND_HESSIAN_BUILD_TUNER_H
+
+#include <map>
+#include <vector>
+
+namespace myslam {
+namespace backend {
+
+/**
+ * 为 Hessian 构建方式自动选择最快的实现
+ *
+ * 按 (边数, 变量维数) 分桶记录各实现的实测耗时：
+ * 每个桶内先把所有候选各跑几次，之后选择平均耗时最小的，并定期重新测一次其它候选以适应负载变化。
+ * 滑窗较小时多线程的调度开销占主导，单线程更快；滑窗较大时多线程收益明显。
+ *
+ * 统计信息需要在多个 Problem 之间保留，因此由 Estimator 持有并传给每一帧的 Problem。
+ * 非线程安全，同一时刻只应被一个 Problem 使用。
+ */
+class HessianBuildTuner {
+public:
+    /// candidates: 参与比较的实现编号，与 Problem::HessianBuildStrategy 一致
+    explicit HessianBuildTuner(const std::vector<int> &candidates);
+
+    /// 根据问题规模选择本次使用的实现
+    int Select(unsigned long num_edges, unsigned long dim);
+
+    /// 记录一次实测耗时 (ms)
+    void Record(unsigned long num_edges, unsigned long dim, int strategy, double time_ms);
+
+private:
+    struct Timing {
+        int count = 0;
+        double mean_ms = 0.;    // 指数滑动平均
+    };
+
+    /// 边数和维数都按 2 的幂分桶
+    static int Bucket(unsigned long num_edges, unsigned long dim);
+
+    static const int kWarmupRuns = 3;       // 每个候选至少测量的次数
+    static const int kExploreInterval = 50; // 每隔多少次重新测量非最优的候选
+
+    std::vector<int> candidates_;
+    std::map<int, std::map<int, Timing>> timings_;  // bucket -> strategy -> timing
+    std::map<int, int> calls_;                      // bucket -> 调用次数
+};
+
+}
+}
+
+#endif
@@ -59,6 +59,8 @@ namespace backend {
 
         virtual void Compute(double err2, Eigen::Vector3d& rho) const override;
 
+        double Delta() const { return delta_; }
+
     private:
         double delta_;
 
@@ -75,6 +77,8 @@ namespace backend {
 
         virtual void Compute(double err2, Eigen::Vector3d& rho) const override;
 
+        double Delta() const { return delta_; }
+
     private:
         double delta_;
     };
@@ -86,6 +90,8 @@ namespace backend {
 
         virtual void Compute(double err2, Eigen::Vector3d& rho) const override;
 
+        double Delta() const { return delta_; }
+
     private:
         double delta_;
     };
@@ -12,22 +12,29 @@
 #include <functional>
 #include <condition_variable> // 条件变量/
 
+#include <Eigen/Sparse>
+
 #include "eigen_types.h"
 #include "edge.h"
 #include "vertex.h"
+#include "block_sparse_hessian.h"
+#include "thread_pool.h"
+#include "hessian_build_tuner.h"
+#include "solver_statistics.h"
+#include "edge_reprojection_batch.h"
 
 using namespace std;
 
 typedef unsigned long ulong;
 
+class IntegrationBase;
+
 namespace myslam {
 namespace backend {
 
 typedef unsigned long ulong;
 //    typedef std::unordered_map<unsigned long, std::shared_ptr<Vertex>> HashVertex;
 typedef std::map<unsigned long, std::shared_ptr<Vertex>> HashVertex;
-typedef std::unordered_map<unsigned long, std::shared_ptr<Edge>> HashEdge;
-typedef std::unordered_multimap<unsigned long, std::shared_ptr<Edge>> HashVertexIdToEdge;
 
 class Problem {
 public:
@@ -45,6 +52,35 @@ public:
         GENERIC_PROBLEM
     };
 
+    /// 构建 Hessian 的方式，编号与配置文件中的 hessian_strategy 一致
+    enum class HessianBuildStrategy {
+        SINGLE_THREAD = 0,  // 单线程
+        MULTI_THREAD,       // 线程池 + 互斥锁累加
+        OPENMP,             // OpenMP reduction
+        LOCK_FREE,          // 线程池，按块行归属无锁累加
+        AUTO                // 根据实测耗时自动选择
+    };
+
+    /// 求解消去 landmark 后的 pose 部分的方式，编号与配置文件中的 linear_solver 一致
+    enum class LinearSolverType {
+        LDLT = 0,       // 构造 H_schur，稠密 LDLT 分解
+        PCG,            // 不构造 H_schur，块 Jacobi 预条件共轭梯度
+        SPARSE_LDLT     // 构造 H_schur，按 pose 块的稀疏结构做 AMD 排序的稀疏 LDLT 分解
+    };
+
+    /// DogLeg 求解中信赖域步长的计算方式，编号与配置文件中的 trust_region_step 一致
+    enum class TrustRegionStep {
+        DOGLEG = 0,     // 完整求解高斯牛顿步，再与最速下降步组合
+        STEIHAUG_CG     // 在 schur 之后的 pose 部分上做 Steihaug-Toint 截断共轭梯度，到达信赖域边界或遇到负曲率时停止
+    };
+
+    /// 上一次求解结束的原因
+    enum class SolveStatus {
+        CONVERGED = 0,      // 误差不再下降
+        MAX_ITERATIONS,     // 达到最大迭代次数
+        TIME_BUDGET         // 预计下一次迭代会超出时间预算，停在最后一次被接受的结果上
+    };
+
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
 
     Problem(ProblemType problemType);
@@ -74,26 +110,30 @@ public:
      * 
      * @param iterations 最大迭代次数 
      * @param type 采用的求解器类型，0-LM，1-DogLeg
+     * @param max_time_ms 时间预算(ms)，<= 0 不限制。根据已有迭代的耗时预测下一次迭代，
+     *                    会超出预算时提前结束，结束原因见 GetSolveStatus
      * @return true 
      * @return false 
      */
-    bool Solve(int type, int iterations = 10);
+    bool Solve(int type, int iterations = 10, double max_time_ms = 0.);
     /**
      * @brief 采用LM策略求解
      * 
      * @param iterations 
+     * @param max_time_ms 
      * @return true 
      * @return false 
      */
-    bool SolveLM(int iterations = 10);
+    bool SolveLM(int iterations = 10, double max_time_ms = 0.);
     /**
      * @brief 采用DogLeg策略求解
      * 
      * @param iterations 
+     * @param max_time_ms 
      * @return true 
      * @return false 
      */
-    bool SolveDogLeg(int iterations = 10);
+    bool SolveDogLeg(int iterations = 10, double max_time_ms = 0.);
 
     /// 边缘化一个frame和以它为host的landmark
     bool Marginalize(std::shared_ptr<Vertex> frameVertex,
@@ -118,8 +158,117 @@ public:
     void TestComputePrior();
     // 返回求解器耗时
     double getSolverCost(){return solve_cost_;}
+    SolveStatus GetSolveStatus() const {return solve_status_;}
+
+    /**
+     * @brief 设置后端使用的线程池，多个 Problem 可以共享同一个线程池
+     * 未设置时，第一次需要时创建一个 4 线程的线程池
+     */
+    void SetThreadPool(const std::shared_ptr<ThreadPool> &pool){thread_pool_ = pool;}
+    std::shared_ptr<ThreadPool> GetThreadPool();
+
+    /// 设置构建 Hessian 的方式，线程数与线程池一致
+    void SetHessianBuildStrategy(HessianBuildStrategy strategy){hessian_strategy_ = strategy;}
+    HessianBuildStrategy GetHessianBuildStrategy() const {return hessian_strategy_;}
+    /**
+     * @brief 设置 AUTO 模式使用的统计信息，多个 Problem 共享同一个 tuner 才能积累耗时统计
+     * 未设置时，第一次需要时创建一个
+     */
+    void SetHessianBuildTuner(const std::shared_ptr<HessianBuildTuner> &tuner){hessian_tuner_ = tuner;}
+    std::shared_ptr<HessianBuildTuner> GetHessianBuildTuner();
+    /**
+     * @brief 确定性模式：MULTI_THREAD 和 OPENMP 按固定的划分累加到各自的缓冲区，再按固定顺序两两归约，
+     * 结果与线程的执行先后无关，只取决于线程数。AUTO 不再按耗时选择，固定使用 LOCK_FREE
+     * SINGLE_THREAD 和 LOCK_FREE 本身就是确定的
+     */
+    void SetDeterministic(bool deterministic){deterministic_ = deterministic;}
+    bool GetDeterministic() const {return deterministic_;}
+    /// 创建一个以所有构建方式为候选的 tuner
+    static std::shared_ptr<HessianBuildTuner> CreateHessianBuildTuner();
+
+    /// 设置 SLAM 问题中 pose 部分线性方程的求解方式，滑窗较大、共视较多时 PCG 更快
+    void SetLinearSolverType(LinearSolverType type){linear_solver_type_ = type; schur_valid_ = false;}
+    LinearSolverType GetLinearSolverType() const {return linear_solver_type_;}
+
+    /// 设置 DogLeg 的步长计算方式，STEIHAUG_CG 只对 SLAM 问题生效，信赖域只约束 pose 部分的步长
+    void SetTrustRegionStep(TrustRegionStep step){trust_region_step_ = step;}
+    TrustRegionStep GetTrustRegionStep() const {return trust_region_step_;}
+
+    /**
+     * @brief LM 每次迭代同时尝试 num_candidates 个 lambda（lambda/ni, lambda, lambda*ni, ...），接受 chi2 最小的一个
+     * 只对 SLAM 问题生效，小于等于 1 时为普通的 LM
+     */
+    void SetSpeculativeLM(int num_candidates){speculative_lm_candidates_ = num_candidates;}
+    int GetSpeculativeLM() const {return speculative_lm_candidates_;}
+
+    /**
+     * @brief 惰性重线性化（iSAM2 的 wildfire 阈值）
+     * 同一次求解中，除第一次外构建 H 时只重新线性化与“移动较大”的顶点相连的边：顶点自上次重线性化以来
+     * 被接受的更新量之和（无穷范数）超过其类型的阈值时，从 H、b 中减去这些边旧的贡献并加上新的贡献，
+     * 其余边保持原来的线性化，b 按线性模型更新。只有 LOCK_FREE 实现，打开时总是使用 LOCK_FREE 构建
+     */
+    void SetLazyRelinearization(bool enable){lazy_relinearization_ = enable;}
+    bool GetLazyRelinearization() const {return lazy_relinearization_;}
+    /**
+     * @brief 混合精度：LOCK_FREE 构建时重投影边的 J^T W J 用 float 批量计算，残差、梯度和求解仍为双精度
+     * 雅可比按 float 保存。求解后检查残差 r = b - (H + lambda) x（H x 按保存的雅可比逐边计算），
+     * |r| / |b| 超过 refinement_tolerance 时用已有的分解求修正量，最多 refinement_steps 次。
+     * 只对 LDLT 和 SPARSE_LDLT 生效。只有 LOCK_FREE 实现，打开时总是使用 LOCK_FREE 构建
+     */
+    void SetMixedPrecision(bool enable, int refinement_steps = 1, double refinement_tolerance = 1e-6){
+        mixed_precision_ = enable;
+        mixed_refinement_steps_ = refinement_steps;
+        mixed_refinement_tolerance_ = refinement_tolerance;
+    }
+    bool GetMixedPrecision() const {return mixed_precision_;}
+
+    /// 设置某类顶点（Vertex::TypeInfo）的重线性化阈值，未设置的类型每次都重新线性化
+    void SetRelinearizeThreshold(const std::string &vertex_type, double threshold){relinearize_thresholds_[vertex_type] = threshold;}
+
+    /// 设置求解器统计信息，每次迭代和每次求解都会写入一条记录；未设置时不记录
+    void SetSolverStatistics(const std::shared_ptr<SolverStatistics> &stats){solver_stats_ = stats;}
+    std::shared_ptr<SolverStatistics> GetSolverStatistics() const {return solver_stats_;}
+
+    /// 把顶点、边和先验写入二进制快照，用于离线复现某一次求解或边缘化
+    bool SaveSnapshot(std::ostream &os) const;
+    bool SaveSnapshot(const std::string &path) const;
+    /**
+     * 从快照恢复问题，只能在空的 problem 上调用。含 IMU 边时会把全局的 G 设为快照中的值
+     * vertices 不为空时，按快照中的顺序（即原来的 id 顺序）返回恢复出的顶点
+     */
+    bool LoadSnapshot(std::istream &is, std::vector<std::shared_ptr<Vertex>> *vertices = nullptr);
+    bool LoadSnapshot(const std::string &path, std::vector<std::shared_ptr<Vertex>> *vertices = nullptr);
 
 private:
+    /// 一条边线性化的结果，供 MakeHessianLockFree 使用
+    struct EdgeLinearization {
+        std::vector<int> index;         // 各顶点的 ordering，固定的顶点为 -1
+        std::vector<int> dim;
+        std::vector<MatXX> hessians;    // J_i^T W J_j，下标 i * n + j
+        std::vector<VecX> gradients;    // drho * J_i^T W r
+        VecX step_sum;                  // 线性化时各非固定顶点的 relin_step_sum_，按顶点顺序拼接
+        Eigen::MatrixXf jacobian;       // 混合精度时保存 float 的雅可比（按顶点拼接）和对称的 W 的上三角，用于迭代细化
+        Vec3 robust_info;               // 不是混合精度计算的边 jacobian 为空
+    };
+    /// 按具体类型静态分发的边，其余类型通过虚函数计算
+    enum class EdgeKernel {
+        REPROJECTION,
+        IMU,
+        GENERIC
+    };
+    /// edge_arena_ 中连续的一段同类型的边 [begin, end)
+    struct EdgeGroup {
+        EdgeKernel kernel;
+        int begin;
+        int end;
+    };
+    /// 与一个非固定顶点相连的边
+    struct VertexEdges {
+        int index;                          // 顶点的 ordering
+        int dim;
+        double relinearize_threshold;       // 惰性重线性化的阈值，小于 0 时每次都重新线性化
+        std::vector<std::pair<int, int>> edges; // (边在 edge_arena_ 中的下标, 顶点在边中的序号)
+    };
 
     /// Solve的实现，解通用问题
     bool SolveGenericProblem(int iterations);
@@ -133,6 +282,9 @@ private:
     /// set ordering for new vertex in slam problem
     void AddOrderingSLAM(std::shared_ptr<Vertex> v);
 
+    /// 根据当前的 ordering 和边，确定 Hessian 的稀疏结构
+    void BuildHessianStructure();
+
     /// 构造Hessian矩阵，总函数
     void MakeHessian();
     /// 构造大H矩阵，单线程
@@ -143,27 +295,102 @@ private:
     void thdCalcHessian(int thd_id, int thd_num);
     /// 构造大矩阵，采用OpenMP
     void MakeHessianOpenMP();
+    /**
+     * @brief 确定性模式下 MakeHessianMulti 和 MakeHessianOpenMP 的实现
+     * 边按下标均分为线程数段，第 k 段累加到 partial_H_[k]，之后按固定的树形顺序归约
+     */
+    void MakeHessianDeterministic(bool use_openmp);
+    /**
+     * @brief 构造大矩阵，无锁并行
+     * 先并行线性化所有边，再按顶点（H 的块行）分配给各线程累加，每个块只有一个线程写入
+     */
+    void MakeHessianLockFree();
+    /**
+     * @brief 在上一次构建的基础上增量更新 H 和 b，只重新线性化与移动超过阈值的顶点相连的边
+     * 需要重新线性化的边超过一半时退回 MakeHessianLockFree
+     */
+    void MakeHessianLazy();
+    /// 按顶点顺序拼接 lin 中非固定顶点对应的 relin_step_sum_
+    VecX GatherStepSum(const EdgeLinearization &lin) const;
+    /// 计算一条边的残差、雅可比及其对 H 和 b 的贡献，结果存放在 lin 中
+    void LinearizeEdge(const std::shared_ptr<Edge> &edge, EdgeLinearization &lin);
+    /// 线性化 edge_arena_ 中 [begin, end) 的边，按类型分段，每段内不经过虚函数
+    void LinearizeEdges(int thd_id, int begin, int end);
+    template <typename EdgeType>
+    void LinearizeEdgeRange(int begin, int end);
+    /// [begin, end) 中的边重新计算残差后的 chi2 之和
+    double EdgesChi(int thd_id, int begin, int end);
+    template <typename EdgeType>
+    double EdgesChiRange(int begin, int end);
+    /// 重投影边按 SoA 打包后批量计算（SIMD），need_jacobians 为 false 时只计算残差并返回 chi2 之和
+    double EvaluateReprojectionRange(ReprojectionBatch &batch, int begin, int end, bool need_jacobians);
+    /**
+     * @brief 双精度的 H * x（H 不含阻尼），用于混合精度的迭代细化
+     * 混合精度的边按 J^T W (J x) 计算，其余边用保存的块，另加上先验
+     */
+    VecX MultiplyLinearizedHessian(const VecX &x);
+    /**
+     * @brief 混合精度的迭代细化：x += solve_schur(r 消去 landmark 后的 pose 部分)，r = b - (H + lambda) x
+     * solve_schur 复用已有的分解，landmark 部分回代
+     */
+    void RefineMixedPrecision(const VecX &b, VecX &delta_x, double lambda,
+                              const std::function<VecX(const VecX &)> &solve_schur);
+    /// 将与顶点相连的所有边的贡献累加到该顶点对应的块行
+    void AccumulateVertexRow(const VertexEdges &vertex_edges);
+    /**
+     * @brief 计算一条边的残差和雅可比，并将其信息累加到 H 和 b 中
+     *
+     * @param scratch 存放各块的缓冲区，每个线程一份。边按类型排序，相邻的边块大小相同，复用时不再分配内存
+     * @param skip_fixed 是否跳过固定的顶点
+     * @param m_hessian 多线程累加时使用的互斥锁，为空时不加锁
+     */
+    void AddEdgeToHessian(const std::shared_ptr<Edge> &edge, EdgeLinearization &scratch, BlockSparseHessian &H,
+                          VecX &b, bool skip_fixed = true, std::mutex *m_hessian = nullptr);
+    /// 保证 edge_scratch_ 至少有 num 份
+    void ReserveEdgeScratch(size_t num) { if (edge_scratch_.size() < num) edge_scratch_.resize(num); }
+    /// 将先验加入 Hessian_ 和 b_ 中
+    void AddPriorToHessian();
+    /// 重新计算所有边的残差，返回 robust chi2 之和（不含先验）
+    double ComputeEdgesChi();
 
     /// schur求解SBA
     void SchurSBA();
 
     /// 解线性方程
     void SolveLinearSystem();
-    /// 求解Dogleg步长
-    void SolveDogLegStep();
+    /// 求解Dogleg步长，梯度已经为零（无法下降）时返回 false
+    bool SolveDogLegStep();
+    /**
+     * @brief Steihaug-CG 求解信赖域子问题 min -b_schur^T x + 0.5 x^T H_schur x, |x| <= radius
+     * 结果写入 delta_x_（landmark 部分回代），模型下降量写入 steihaug_model_decrease_
+     * 梯度低于收敛阈值时不迭代，返回 false
+     */
+    bool SolveSteihaugStep();
+    /// 计算消去 landmark 的中间结果并缓存：LDLT 时为 H_pp_schur_，PCG 时为 landmark 块的逆和预条件块
+    void UpdateSchurCache(BlockSparseHessian &Hessian, const VecX &b);
     /**
      * @brief 使用Schur complement加速求解线性方程组Hdelta_x=b（针对类slam问题，即存在主对角线上存在分块对角矩阵）
      * 
-     * @param Hessian： H矩阵 
+     * @param Hessian： 分块存储的H矩阵，landmark 部分会被消去
      * @param b ：b
      * @param x ：x
-     * @param reserve_num：保留的变量数目 
-     * @param schur_num ：schur的变量数目
-     * @param schur_vertices：schur变量的顶点map, std::map<unsigned long, std::shared_ptr<Vertex>>
-     * @param lambda ：是否添加阻尼
+     * @param lambda ：加到 schur 后 pose 部分对角线上的阻尼
+     */
+    void SolveLinearWithSchur(BlockSparseHessian &Hessian, const VecX &b, VecX &delta_x, double lambda = 0.);
+    /**
+     * @brief 与 SolveLinearWithSchur 相同，但 pose 部分用 PCG 求解
+     * 每次迭代通过 landmark 块隐式地计算 H_schur * p，预条件为 H_schur 按 pose 顶点划分的对角块
+     */
+    void SolveLinearWithPCG(BlockSparseHessian &Hessian, const VecX &b, VecX &delta_x, double lambda = 0.);
+    /// 用稠密 LDLT 求解 (H_pp_schur_ + lambda I) x = b_pp_schur_，只读取缓存，可以并发调用
+    VecX SolveDenseLDLT(double lambda) const;
+    /// H_pp_schur_ + lambda I 的稠密 LDLT 分解
+    Eigen::LDLT<MatXX> FactorizeDenseLDLT(double lambda) const;
+    /**
+     * @brief 用稀疏 LDLT 求解 (H_schur + lambda I) x = b_schur
+     * 只保留 pose 顶点之间不全为零的块，AMD 排序和符号分析在块结构不变时复用（跨迭代、跨帧）
      */
-    void SolveLinearWithSchur(MatXX & Hessian, VecX &b, VecX & delta_x, int reserve_size, int schur_size,
-                        std::map<unsigned long, std::shared_ptr<Vertex>> & schur_vertices,  double lambda = 0.);
+    VecX SolveSparseLDLT(const MatXX &H_schur, const VecX &b_schur, double lambda);
 
     /// 更新状态变量
     void UpdateStates();
@@ -190,6 +417,12 @@ private:
     /// 获取某个顶点连接到的边
     std::vector<std::shared_ptr<Edge>> GetConnectedEdges(std::shared_ptr<Vertex> vertex);
 
+    /**
+     * @brief 增删顶点或边之后，压缩 arena 并重建顶点到边的 CSR 邻接表，拓扑未变化时什么都不做
+     * 顶点按 id 排序，边按类型、id 排序，并据此划分 edge_groups_
+     */
+    void CompactTopology();
+
     /// Levenberg
     /// 计算LM算法的初始Lambda
     void ComputeLambdaInitLM();
@@ -203,15 +436,25 @@ private:
 
     /// LM 算法中用于判断 Lambda 在上次迭代中是否可以，以及Lambda怎么缩放
     bool IsGoodStepInLM();
+    /// 更新状态之后 LM 的目标函数值 0.5 * (chi2 + 先验残差)
+    double ComputeStepChiLM();
+    /// delta_x_ 对应的实际下降与模型预测下降之比
+    double GainRatioLM(double tempChi, double lambda) const;
+    /// 根据 rho 缩放 lambda，返回这一步是否被接受
+    bool UpdateLambdaLM(double rho, double tempChi);
+    /// 同时求解多个 lambda 的更新量，接受其中 chi2 最小且下降的一个
+    bool SpeculativeStepLM(SolverRecord &record);
     /// DogLeg 算法中用于判断上次迭代效果及信赖域半径如何缩放
     bool IsGoodStepInDogLeg();
     /// PCG 迭代线性求解器
     VecX PCGSolver(const MatXX &A, const VecX &b, int maxIter);
-    /// 存储时间
-    void saveCost(initializer_list<double> times);
+    /// 补全问题规模后写入统计信息，未设置统计信息时什么都不做
+    void RecordStatistics(SolverRecord record);
 
     double currentChi_;
     double solve_cost_; // 求解器每次迭代耗时
+    SolveStatus solve_status_ = SolveStatus::CONVERGED;
+    double step_solve_ms_ = 0.; // 上一次求解中每次尝试的平均线性求解加残差计算耗时，用于预测首次尝试
     // DogLeg 相关参数
     double currentRadius_;
     double stopThresholdDogLeg_;
@@ -220,8 +463,10 @@ private:
     VecX h_dl_; // DogLeg步长
     double alpha_ = 0.0;
     double beta_ = 0.0;
+    TrustRegionStep trust_region_step_ = TrustRegionStep::DOGLEG;
+    double steihaug_model_decrease_ = 0.;   // Steihaug 步长对应的二次模型下降量，用于计算 rho
     // LM相关参数
-    double currentLambda_;
+    double currentLambda_ = 0.;
     double stopThresholdLM_;    // LM 迭代退出阈值条件
     double ni_;                 //控制 Lambda 缩放大小
     double L_up_ = 6.;
@@ -229,17 +474,55 @@ private:
 
     ProblemType problemType_;
 
-    /// 整个信息矩阵
-    MatXX Hessian_;
-    MatXX diagHessian_;
+    /// 整个信息矩阵，按块稀疏存储
+    BlockSparseHessian Hessian_;
     VecX b_;
     VecX delta_x_;
 
     /// 用于多线程计算的变量
-    MatXX multi_H_;
+    BlockSparseHessian multi_H_;
     VecX multi_b_;
     mutex m_hessian_;
-    vector<unsigned long> edges_idx_;
+    bool deterministic_ = false;
+    std::vector<BlockSparseHessian> partial_H_;    // 确定性模式下每段边的部分和
+    std::vector<VecX> partial_b_;
+    std::vector<EdgeGroup> edge_groups_;
+    std::shared_ptr<ThreadPool> thread_pool_;
+    HessianBuildStrategy hessian_strategy_ = HessianBuildStrategy::LOCK_FREE;
+    std::shared_ptr<HessianBuildTuner> hessian_tuner_;
+    LinearSolverType linear_solver_type_ = LinearSolverType::LDLT;
+    int speculative_lm_candidates_ = 1;
+    std::shared_ptr<SolverStatistics> solver_stats_;
+
+    /// 从快照恢复的边所引用的预积分和核函数，由 problem 持有
+    std::vector<std::shared_ptr<IntegrationBase>> snapshot_pre_integrations_;
+    std::vector<std::shared_ptr<LossFunction>> snapshot_losses_;
+
+    /// 用于无锁并行构建 Hessian 的变量
+    std::vector<EdgeLinearization> edge_linearizations_;
+    std::vector<VertexEdges> vertex_edges_;
+    /// 其余构建方式和边缘化中 AddEdgeToHessian 的缓冲区，每个线程一份
+    std::vector<EdgeLinearization> edge_scratch_;
+    /// 重投影边批量计算的缓冲区，每个线程一份，跨迭代、跨求解复用
+    std::vector<ReprojectionBatch> reprojection_batches_;
+
+    /// 惰性重线性化，状态只在一次求解内有效，BuildHessianStructure 时重置
+    bool lazy_relinearization_ = false;
+    std::map<std::string, double> relinearize_thresholds_;
+    bool lazy_ready_ = false;           // lin_hessian_ 等与当前的 edge_linearizations_ 一致，可以增量更新
+    VecX relin_step_sum_;               // 本次求解中被接受的更新量之和
+    VecX relin_step_sum_backup_;
+    VecX relin_step_sum_built_;         // 上一次构建 H 时的 relin_step_sum_
+    VecX relin_vertex_base_;            // 各顶点上一次重新线性化时的 relin_step_sum_
+    BlockSparseHessian lin_hessian_;    // 不含先验的 H 和 b
+    VecX lin_b_;
+
+    /// 混合精度
+    bool mixed_precision_ = false;
+    int mixed_refinement_steps_ = 1;
+    double mixed_refinement_tolerance_ = 1e-6;
+    bool mixed_hessian_ = false;        // 当前的 Hessian_ 中有 float 计算的块，求解后需要迭代细化
+    MatXX H_prior_masked_;              // 加入 Hessian_ 的先验（固定顶点部分已置零），混合精度时保存
 
     /// 先验部分信息
     MatXX H_prior_;
@@ -253,20 +536,38 @@ private:
     /// SBA的Pose部分
     MatXX H_pp_schur_;
     VecX b_pp_schur_;
-    // Heesian 的 Landmark 和 pose 部分
-    MatXX H_pp_;
-    VecX b_pp_;
-    MatXX H_ll_;
-    VecX b_ll_;
-
-    /// all vertices
-    HashVertex verticies_;
+    /**
+     * 阻尼只加在 schur 之后 pose 部分的对角线上，消去 landmark 的结果与 lambda 无关。
+     * H_pp_schur_ 保存未加阻尼的结果（PCG 时为 schur_diag_blocks_），LM 拒绝一步后换 lambda 重解时直接复用，
+     * 只有 MakeHessian 重新线性化后才失效
+     */
+    bool schur_valid_ = false;
+    std::vector<std::pair<ulong, int>> schur_pose_blocks_;  // PCG 预条件的 pose 块 (ordering, 维度)
+    std::vector<MatXX> schur_diag_blocks_;                  // 未加阻尼的 H_schur 对角块
 
-    /// all edges
-    HashEdge edges_;
+    /// SPARSE_LDLT 使用：H_schur 的下三角稀疏矩阵，以及与其块结构对应的符号分析结果
+    Eigen::SparseMatrix<double> sparse_schur_;
+    Eigen::SimplicialLDLT<Eigen::SparseMatrix<double>, Eigen::Lower, Eigen::AMDOrdering<int>> sparse_ldlt_;
+    std::vector<std::pair<ulong, int>> sparse_pose_blocks_;     // 符号分析时的 pose 块 (ordering, 维度)
+    std::vector<std::pair<int, int>> sparse_block_pattern_;     // 符号分析时的非零块 (行块, 列块)，列块 <= 行块
 
-    /// 由vertex id查询edge
-    HashVertexIdToEdge vertexToEdge_;
+    /**
+     * 所有顶点和边按下标连续存放。删除时只把对应位置置空，CompactTopology 时再压缩，
+     * 压缩后 edge_arena_ 的下标即为线性化、并行划分时使用的边的下标
+     */
+    std::vector<std::shared_ptr<Vertex>> vertex_arena_;
+    std::vector<std::shared_ptr<Edge>> edge_arena_;
+    /// id 到 arena 下标，只在增删时查询
+    std::unordered_map<ulong, int> vertex_slot_;
+    std::unordered_map<ulong, int> edge_slot_;
+    int num_vertices_ = 0;
+    int num_edges_ = 0;
+    bool topology_changed_ = false;
+
+    /// 顶点到边的 CSR 邻接表：vertex_arena_[v] 连接的边为 adjacency_edges_[adjacency_offsets_[v], adjacency_offsets_[v + 1])
+    std::vector<int> adjacency_offsets_;
+    std::vector<int> adjacency_edges_;
+    int adjacency_num_edges_ = 0;   // 建表时的边数，此后新增的边位于 edge_arena_ 尾部，查询时逐条检查
 
     /// Ordering related
     ulong ordering_poses_ = 0;
@@ -280,6 +581,7 @@ private:
 
     bool bDebug = false;
     double t_hessian_cost_ = 0.0;
+    double t_schur_cost_ = 0.0;
     double t_PCGsovle_cost_ = 0.0;
 };
 
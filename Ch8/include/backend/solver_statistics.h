@@ -0,0 +1,115 @@
+#ifndef MYSLAM_BACKEND_SOLVER_STATISTICS_H
+#define MYSLAM_BACKEND_SOLVER_STATISTICS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace myslam {
+namespace backend {
+
+/**
+ * 求解器的一条统计记录，每次迭代尝试一条，每次求解结束再写一条汇总
+ *
+ * 二进制文件直接按此结构体写入，字段按 8 字节、4 字节的顺序排列，没有填充，
+ * tools/time_compare.py 中的 dtype 与这里保持一致
+ */
+struct SolverRecord {
+    enum Type {
+        ITERATION = 0,
+        SOLVE = 1
+    };
+
+    double chi2 = 0.;           // 本次尝试之后的 chi2，SOLVE 为最终的 chi2
+    double lambda = 0.;         // LM 的 lambda 或 DogLeg 的信赖域半径（本次尝试使用的值）
+    double hessian_ms = 0.;     // 构建 Hessian 的耗时
+    double schur_ms = 0.;       // 消去 landmark 的耗时（Schur 补或 PCG 的预处理），包含在 linear_ms 中
+    double linear_ms = 0.;      // 解线性方程的耗时
+    double residual_ms = 0.;    // 更新状态并重新计算残差的耗时
+    double total_ms = 0.;       // SOLVE: 整个求解的耗时
+    uint64_t solve_id = 0;
+    int32_t type = ITERATION;
+    int32_t solver = 0;         // 0 LM, 1 DogLeg
+    int32_t iteration = 0;      // SOLVE: 总迭代次数
+    int32_t accepted = 0;       // 这一步是否被接受，SOLVE: 是否在达到最大迭代次数之前收敛
+    int32_t pose_dim = 0;
+    int32_t landmark_dim = 0;
+    int32_t num_edges = 0;
+    int32_t num_vertices = 0;
+};
+
+/**
+ * 求解器统计信息
+ *
+ * 记录存放在单生产者单消费者的无锁环形缓冲区中：求解器线程 Push，不加锁也不做 IO，
+ * 缓冲区满时丢弃新记录并计数，不会阻塞求解器。
+ * 消费者可以是进程内的查询（Pop/Drain），也可以是 StartFlush 启动的后台线程，二者只能选其一。
+ */
+class SolverStatistics {
+public:
+    enum class FileFormat {
+        CSV,
+        BINARY
+    };
+
+    /// capacity 会向上取整为 2 的幂
+    explicit SolverStatistics(size_t capacity = 4096);
+    ~SolverStatistics();
+
+    SolverStatistics(const SolverStatistics &) = delete;
+    SolverStatistics &operator=(const SolverStatistics &) = delete;
+
+    /// 生产者：分配一个求解序号
+    uint64_t BeginSolve() { return solve_count_++; }
+
+    /// 生产者：写入一条记录，缓冲区满时返回 false
+    bool Push(const SolverRecord &record);
+
+    /// 消费者：取出一条记录
+    bool Pop(SolverRecord &record);
+    /// 消费者：取出当前所有记录，追加到 records 后面，返回条数
+    size_t Drain(std::vector<SolverRecord> &records);
+
+    /// 因缓冲区满而丢弃的记录数
+    unsigned long Dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+    /**
+     * 启动后台线程，每隔 period_ms 把缓冲区中的记录追加到文件，文件在启动时清空
+     * 之后不能再在进程内 Pop/Drain
+     */
+    bool StartFlush(const std::string &path, FileFormat format = FileFormat::CSV, int period_ms = 100);
+    /// 停止后台线程，并把剩余记录写入文件
+    void StopFlush();
+
+    static void WriteCsvHeader(std::ostream &os);
+    static void WriteCsv(std::ostream &os, const SolverRecord &record);
+
+private:
+    void FlushLoop(int period_ms);
+    void FlushOnce();
+
+    std::vector<SolverRecord> buffer_;
+    size_t mask_;
+    std::atomic<size_t> head_;      // 下一个写入位置，只由生产者修改
+    std::atomic<size_t> tail_;      // 下一个读取位置，只由消费者修改
+    std::atomic<unsigned long> dropped_;
+    std::atomic<uint64_t> solve_count_;
+
+    std::thread flush_thread_;
+    std::mutex flush_mutex_;
+    std::condition_variable flush_cv_;
+    bool stop_flush_ = false;
+    std::ofstream file_;
+    FileFormat format_ = FileFormat::CSV;
+    std::vector<SolverRecord> flush_records_;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef MYSLAM_BACKEND_THREAD_POOL_H
+#define MYSLAM_BACKEND_THREAD_POOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <condition_variable>
+
+namespace myslam {
+namespace backend {
+
+/**
+ * 常驻线程池，供后端的 Hessian 构建、残差计算和 Schur 消元使用
+ *
+ * 线程在构造时创建，析构时回收，避免每次构建 Hessian 都创建/销毁 std::thread。
+ * 调用 Run 的线程本身作为 0 号线程参与计算，因此只额外创建 num_threads - 1 个线程。
+ * Run 会阻塞直到所有线程完成，同一时刻只能有一个 Run 在执行。
+ */
+class ThreadPool {
+public:
+    /// thd_id: 当前线程序号，thd_num: 线程总数
+    typedef std::function<void(int thd_id, int thd_num)> Task;
+
+    /// num_threads <= 0 时使用硬件支持的线程数
+    explicit ThreadPool(int num_threads = 4);
+
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    int NumThreads() const { return num_threads_; }
+
+    /// 所有线程各执行一次 task，阻塞直到全部完成
+    void Run(const Task &task);
+
+    /**
+     * 将 [0, n) 均分为 NumThreads() 段并行执行 func(thd_id, begin, end)
+     * 分段只与 n 和线程数有关，结果可复现
+     */
+    void ParallelFor(int n, const std::function<void(int thd_id, int begin, int end)> &func);
+
+private:
+    void WorkerLoop(int thd_id);
+
+    int num_threads_;
+    std::vector<std::thread> workers_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_task_;   // 通知 worker 有新任务
+    std::condition_variable cv_done_;   // 通知调用者任务完成
+    const Task *task_ = nullptr;
+    unsigned long generation_ = 0;      // 每次 Run 加一，worker 据此判断是否有新任务
+    int pending_ = 0;                   // 尚未完成的 worker 数
+    bool stop_ = false;
+};
+
+}
+}
+
+#endif
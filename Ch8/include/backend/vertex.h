@@ -46,8 +46,8 @@ public:
     void RollBackParameters() { parameters_ = parameters_backup_; }
 
     /// 加法，可重定义
-    /// 默认是向量加
-    virtual void Plus(const VecX &delta);
+    /// 默认是向量加。delta 可以直接是 delta_x 中的一段，不需要拷贝
+    virtual void Plus(const Eigen::Ref<const VecX> &delta);
 
     /// 返回顶点的名称，在子类中实现
     virtual std::string TypeInfo() const = 0;
@@ -1,7 +1,7 @@
 #ifndef MYSLAM_BACKEND_INVERSE_DEPTH_H
 #define MYSLAM_BACKEND_INVERSE_DEPTH_H
 
-#include "vertex.h"
+#include "fixed_vertex.h"
 
 namespace myslam {
 namespace backend {
@@ -9,11 +9,11 @@ namespace backend {
 /**
  * 以逆深度形式存储的顶点
  */
-class VertexInverseDepth : public Vertex {
+class VertexInverseDepth : public FixedVertex<1> {
 public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
 
-    VertexInverseDepth() : Vertex(1) {}
+    VertexInverseDepth() {}
 
     virtual std::string TypeInfo() const { return "VertexInverseDepth"; }
 };
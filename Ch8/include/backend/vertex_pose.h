@@ -2,7 +2,7 @@
 #define MYSLAM_BACKEND_POSEVERTEX_H
 
 #include <memory>
-#include "vertex.h"
+#include "fixed_vertex.h"
 
 namespace myslam {
 namespace backend {
@@ -14,15 +14,15 @@ namespace backend {
  *
  * pose is represented as Twb in VIO case
  */
-class VertexPose : public Vertex {
+class VertexPose : public FixedVertex<7, 6> {
 public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
 
-    VertexPose() : Vertex(7, 6) {}
+    VertexPose() {}
 
     /// 加法，可重定义
     /// 默认是向量加
-    virtual void Plus(const VecX &delta) override;
+    virtual void Plus(const Eigen::Ref<const VecX> &delta) override;
 
     std::string TypeInfo() const {
         return "VertexPose";
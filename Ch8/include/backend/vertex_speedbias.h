@@ -2,7 +2,7 @@
 #define MYSLAM_BACKEND_SPEEDBIASVERTEX_H
 
 #include <memory>
-#include "vertex.h"
+#include "fixed_vertex.h"
 
 namespace myslam {
 namespace backend {
@@ -12,11 +12,11 @@ namespace backend {
  * parameters: v, ba, bg 9 DoF
  * 
  */
-class VertexSpeedBias : public Vertex {
+class VertexSpeedBias : public FixedVertex<9> {
 public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
 
-    VertexSpeedBias() : Vertex(9) {}
+    VertexSpeedBias() {}
 
     std::string TypeInfo() const {
         return "VertexSpeedBias";
@@ -12,6 +12,12 @@
 #include "factor/integration_base.h"
 
 #include "backend/problem.h"
+#include "backend/vertex_inverse_depth.h"
+#include "backend/vertex_pose.h"
+#include "backend/vertex_speedbias.h"
+#include "backend/edge_reprojection.h"
+#include "backend/edge_imu.h"
+#include "backend/frame_arena.h"
 
 #include <unordered_map>
 #include <queue>
@@ -46,6 +52,19 @@ class Estimator
     void MargOldFrame();
     void MargNewFrame();
 
+    // 后端 problem 在各帧之间复用，只增量地增删变化的顶点和边
+    void resetBackendProblem();
+    void syncBackendStates();
+    void syncBackendProblem();
+    void removeBackendFrameEdges(int frame);
+    void slideBackendProblem();
+
+    // 上一次后端求解的结束原因，以及因超出 max_solver_time 而提前结束的累计次数
+    myslam::backend::Problem::SolveStatus solveStatus() const { return solve_status_; }
+    int solveCutoffCount() const { return solve_cutoff_count_; }
+    // 上一帧后端顶点和边在 backend_arena_ 中的分配统计
+    const myslam::backend::FrameArena::Stats &backendArenaStats() const { return backend_arena_stats_; }
+
     void vector2double();
     void double2vector();
     bool failureDetection();
@@ -69,6 +88,33 @@ class Estimator
     MatXX Jprior_inv_;
 
     Eigen::Matrix2d project_sqrt_info_;
+    std::shared_ptr<myslam::backend::ThreadPool> thread_pool_;  // 后端线程池，各帧的 problem 共享
+    std::shared_ptr<myslam::backend::HessianBuildTuner> hessian_tuner_;  // Hessian 构建方式的耗时统计
+    std::shared_ptr<myslam::backend::SolverStatistics> solver_stats_;    // 求解器统计，后台写入 ./solver_stats.csv
+    int snapshot_count_ = 0;    // 已保存的慢求解快照数，快照写入 ./problem_snapshot_<n>.bin
+    myslam::backend::Problem::SolveStatus solve_status_ = myslam::backend::Problem::SolveStatus::CONVERGED;  // 上一次后端求解的结束原因
+    int solve_cutoff_count_ = 0;    // 因超出 max_solver_time 而提前结束的求解次数
+
+    /// 后端 problem 中一个特征对应的逆深度顶点及其重投影边
+    struct BackendLandmark
+    {
+        std::shared_ptr<myslam::backend::VertexInverseDepth> vertex;
+        std::shared_ptr<myslam::backend::Vertex> host;      // 首次观测帧的位姿顶点
+        std::vector<std::shared_ptr<myslam::backend::Vertex>> targets;
+        std::vector<std::shared_ptr<myslam::backend::EdgeReprojection>> edges;  // 与 targets 一一对应
+        int stamp;
+    };
+    std::shared_ptr<myslam::backend::FrameArena> backend_arena_;   // 后端顶点和边的内存池，跨帧复用
+    myslam::backend::FrameArena::Stats backend_arena_stats_;       // 上一帧在 backend_arena_ 中的分配统计
+    std::shared_ptr<myslam::backend::Problem> backend_problem_;
+    std::shared_ptr<myslam::backend::LossFunction> backend_loss_;
+    std::shared_ptr<myslam::backend::VertexPose> backend_ext_;
+    std::shared_ptr<myslam::backend::VertexPose> backend_cams_[(WINDOW_SIZE + 1)];
+    std::shared_ptr<myslam::backend::VertexSpeedBias> backend_vbs_[(WINDOW_SIZE + 1)];
+    std::shared_ptr<myslam::backend::EdgeImu> backend_imu_edges_[(WINDOW_SIZE + 1)];  // [j] 连接 j-1 和 j 帧
+    std::unordered_map<int, BackendLandmark> backend_landmarks_;                       // feature_id -> landmark
+    std::vector<std::shared_ptr<myslam::backend::VertexInverseDepth>> backend_features_; // 与 para_Feature 顺序一致
+    int backend_stamp_;
 //////////////// OUR SOLVER //////////////////
     SolverFlag solver_flag;
     MarginalizationFlag  marginalization_flag;
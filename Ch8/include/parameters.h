@@ -61,6 +61,15 @@ extern int ESTIMATE_TD;
 extern int ROLLING_SHUTTER;
 extern double ROW, COL;
 extern int SOLVER_TYPE;
+extern int NUM_THREADS;
+extern int HESSIAN_STRATEGY;
+extern int DETERMINISTIC;
+extern int LINEAR_SOLVER;
+extern int SPECULATIVE_LM;
+extern double RELINEARIZE_THRESHOLD;
+extern int MIXED_PRECISION;
+extern int TRUST_REGION_STEP;
+extern double SNAPSHOT_THRESHOLD;
 
 // void readParameters(ros::NodeHandle &n);
 
@@ -34,10 +34,7 @@ System::System(string sConfig_file_)
     {
         cerr << "ofs_pose is not open" << endl;
     }
-    // 判断文件是否存在，存在则删除
-    filename = "./solver_cost.txt";
-    if(stat(filename.c_str(), &buffer) == 0)
-        system(("rm " + filename).c_str());
+    // 求解器统计由 estimator 在后台写入 ./solver_stats.csv，启动时清空
     // thread thd_RunBackend(&System::process,this);
     // thd_RunBackend.detach();
     cout << "2 System() end" << endl;
@@ -361,7 +358,10 @@ void System::ProcessBackEnd()
                 p_wi = estimator.Ps[WINDOW_SIZE];
                 vPath_to_draw.push_back(p_wi);
                 double dStamp = estimator.Headers[WINDOW_SIZE];
-                cout << "1 BackEnd processImage dt: " << fixed << t_processImage.toc() << " stamp: " <<  dStamp << " p_wi: " << p_wi.transpose() << endl;
+                cout << "1 BackEnd processImage dt: " << fixed << t_processImage.toc() << " stamp: " <<  dStamp << " p_wi: " << p_wi.transpose()
+                     << " solver cutoff: " << estimator.solveCutoffCount()
+                     << " arena bytes: " << estimator.backendArenaStats().bytes
+                     << " allocs: " << estimator.backendArenaStats().allocations << endl;
                 ofs_pose << fixed << dStamp << " " 
                         << p_wi.x() << " " << p_wi.y() << " " << p_wi.z() << " "
                         << q_wi.x() << " " << q_wi.y() << " " << q_wi.z() << " " << q_wi.w() << endl;
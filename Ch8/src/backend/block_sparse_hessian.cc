@@ -0,0 +1,428 @@
+#include <cassert>
+#include <eigen3/Eigen/Dense>
+#include "backend/block_sparse_hessian.h"
+
+namespace myslam {
+namespace backend {
+
+void BlockSparseHessian::Resize(ulong dense_dim, const std::vector<int> &landmark_dims) {
+    dense_dim_ = dense_dim;
+    Hpp_.setZero(dense_dim, dense_dim);
+
+    size_t num_landmarks = landmark_dims.size();
+    Hpl_.assign(num_landmarks, std::vector<PoseLandmarkBlock>());
+    Hll_inv_.clear();
+    Hll_inv_scalar_.resize(0);
+    landmark_offsets_.resize(num_landmarks);
+
+    landmark_dim_ = 0;
+    scalar_landmarks_ = num_landmarks > 0;
+    for (size_t l = 0; l < num_landmarks; ++l) {
+        landmark_offsets_[l] = landmark_dim_;
+        landmark_dim_ += landmark_dims[l];
+        scalar_landmarks_ = scalar_landmarks_ && landmark_dims[l] == 1;
+    }
+
+    if (scalar_landmarks_) {
+        Hll_.clear();
+        Hll_scalar_.setZero(num_landmarks);
+    } else {
+        Hll_.resize(num_landmarks);
+        for (size_t l = 0; l < num_landmarks; ++l) {
+            Hll_[l].setZero(landmark_dims[l], landmark_dims[l]);
+        }
+        Hll_scalar_.resize(0);
+    }
+
+    landmark_of_offset_.resize(landmark_dim_);
+    for (size_t l = 0; l < num_landmarks; ++l) {
+        for (int k = 0; k < landmark_dims[l]; ++k) {
+            landmark_of_offset_[landmark_offsets_[l] + k] = l;
+        }
+    }
+}
+
+void BlockSparseHessian::AddPoseLandmarkLink(ulong pose_index, int pose_dim, ulong landmark_index) {
+    FindPoseLandmarkBlock(LandmarkOf(landmark_index), pose_index, pose_dim);
+}
+
+BlockSparseHessian::PoseLandmarkBlock &
+BlockSparseHessian::FindPoseLandmarkBlock(int landmark, ulong pose_index, int pose_dim) {
+    // 一个 landmark 只被窗口内少数几帧观测到，线性查找即可
+    std::vector<PoseLandmarkBlock> &blocks = Hpl_[landmark];
+    for (auto &block : blocks) {
+        if (block.pose_index == pose_index)
+            return block;
+    }
+    PoseLandmarkBlock block;
+    block.pose_index = pose_index;
+    block.pose_dim = pose_dim;
+    block.H.setZero(pose_dim, LandmarkDimOf(landmark));
+    blocks.push_back(block);
+    return blocks.back();
+}
+
+void BlockSparseHessian::SetZero() {
+    Hpp_.setZero();
+    Hll_scalar_.setZero();
+    for (auto &Hll : Hll_) {
+        Hll.setZero();
+    }
+    for (size_t l = 0; l < Hpl_.size(); ++l) {
+        for (auto &block : Hpl_[l]) {
+            block.H.setZero();
+        }
+    }
+}
+
+BlockSparseHessian BlockSparseHessian::ZeroLike() const {
+    BlockSparseHessian H(*this);
+    H.SetZero();
+    H.Hll_inv_.clear();
+    H.Hll_inv_scalar_.resize(0);
+    return H;
+}
+
+void BlockSparseHessian::AddBlock(ulong index_i, int dim_i, ulong index_j, int dim_j, const MatXX &h) {
+    bool dense_i = IsDense(index_i);
+    bool dense_j = IsDense(index_j);
+
+    if (dense_i && dense_j) {
+        Hpp_.block(index_i, index_j, dim_i, dim_j).noalias() += h;
+        if (index_i != index_j) {
+            // 对称的下三角
+            Hpp_.block(index_j, index_i, dim_j, dim_i).noalias() += h.transpose();
+        }
+    } else if (dense_i) {
+        FindPoseLandmarkBlock(LandmarkOf(index_j), index_i, dim_i).H.noalias() += h;
+    } else if (dense_j) {
+        FindPoseLandmarkBlock(LandmarkOf(index_i), index_j, dim_j).H.noalias() += h.transpose();
+    } else {
+        int l = LandmarkOf(index_i);
+        assert(l == LandmarkOf(index_j) && "landmark-landmark blocks are not supported");
+        if (scalar_landmarks_)
+            Hll_scalar_[l] += h(0, 0);
+        else
+            Hll_[l].noalias() += h;
+    }
+}
+
+void BlockSparseHessian::AddRowBlock(ulong index_i, int dim_i, ulong index_j, int dim_j, const MatXX &h) {
+    bool dense_i = IsDense(index_i);
+    bool dense_j = IsDense(index_j);
+
+    if (dense_i && dense_j) {
+        Hpp_.block(index_i, index_j, dim_i, dim_j).noalias() += h;
+    } else if (dense_j) {
+        FindPoseLandmarkBlock(LandmarkOf(index_i), index_j, dim_j).H.noalias() += h.transpose();
+    } else {
+        assert(!dense_i && "pose-landmark blocks must be added from the landmark row");
+        int l = LandmarkOf(index_i);
+        assert(l == LandmarkOf(index_j) && "landmark-landmark blocks are not supported");
+        if (scalar_landmarks_)
+            Hll_scalar_[l] += h(0, 0);
+        else
+            Hll_[l].noalias() += h;
+    }
+}
+
+void BlockSparseHessian::AddDiagonal(double lambda) {
+    Hpp_.diagonal().array() += lambda;
+    Hll_scalar_.array() += lambda;
+    for (auto &Hll : Hll_) {
+        Hll.diagonal().array() += lambda;
+    }
+}
+
+BlockSparseHessian &BlockSparseHessian::operator+=(const BlockSparseHessian &other) {
+    assert(other.dense_dim_ == dense_dim_ && other.NumLandmarks() == NumLandmarks());
+    Hpp_ += other.Hpp_;
+    Hll_scalar_ += other.Hll_scalar_;
+    for (size_t l = 0; l < Hll_.size(); ++l) {
+        Hll_[l] += other.Hll_[l];
+    }
+    for (size_t l = 0; l < Hpl_.size(); ++l) {
+        for (const auto &block : other.Hpl_[l]) {
+            FindPoseLandmarkBlock(l, block.pose_index, block.pose_dim).H += block.H;
+        }
+    }
+    return *this;
+}
+
+VecX BlockSparseHessian::Multiply(const VecX &x) const {
+    assert(ulong(x.size()) == Dim());
+    VecX y(VecX::Zero(Dim()));
+    y.head(dense_dim_).noalias() = Hpp_ * x.head(dense_dim_);
+
+    if (scalar_landmarks_)
+        y.tail(landmark_dim_) = Hll_scalar_.cwiseProduct(x.tail(landmark_dim_));
+    for (size_t l = 0; l < Hpl_.size(); ++l) {
+        ulong idx = LandmarkIndex(l);
+        int dim = LandmarkDimOf(l);
+        if (!scalar_landmarks_)
+            y.segment(idx, dim).noalias() += Hll_[l] * x.segment(idx, dim);
+        for (const auto &block : Hpl_[l]) {
+            y.segment(block.pose_index, block.pose_dim).noalias() += block.H * x.segment(idx, dim);
+            y.segment(idx, dim).noalias() += block.H.transpose() * x.segment(block.pose_index, block.pose_dim);
+        }
+    }
+    return y;
+}
+
+double BlockSparseHessian::MaxDiagonal() const {
+    double max_diagonal = 0;
+    if (dense_dim_ > 0)
+        max_diagonal = Hpp_.diagonal().cwiseAbs().maxCoeff();
+    if (Hll_scalar_.size() > 0)
+        max_diagonal = std::max(max_diagonal, Hll_scalar_.cwiseAbs().maxCoeff());
+    for (const auto &Hll : Hll_) {
+        max_diagonal = std::max(max_diagonal, Hll.diagonal().cwiseAbs().maxCoeff());
+    }
+    return max_diagonal;
+}
+
+void BlockSparseHessian::SchurComplement(const VecX &b, MatXX &H_schur, VecX &b_schur, ThreadPool *pool) {
+    H_schur = Hpp_;
+    b_schur = b.head(dense_dim_);
+
+    InvertLandmarkBlocks(pool);
+    int num_landmarks = static_cast<int>(NumLandmarks());
+
+    // 按 pose 块行分配给各线程，每个线程只写自己的行
+    std::vector<int> pose_block_order(dense_dim_, -1);
+    for (const auto &blocks : Hpl_) {
+        for (const auto &block : blocks) {
+            pose_block_order[block.pose_index] = 0;
+        }
+    }
+    int num_pose_blocks = 0;
+    for (auto &order : pose_block_order) {
+        if (order >= 0)
+            order = num_pose_blocks++;
+    }
+
+    // 1 维 landmark：Hpl 的块都是列向量，H_schur(a, c) -= h_a * h_c^T / Hll，按列做 axpy，不产生临时矩阵
+    auto eliminate_scalar = [&](int thd_id, int thd_num) {
+        for (int l = 0; l < num_landmarks; ++l) {
+            const std::vector<PoseLandmarkBlock> &blocks = Hpl_[l];
+            double inv = Hll_inv_scalar_[l];
+            double Hll_inv_bl = inv * b[LandmarkIndex(l)];
+            for (const auto &block_a : blocks) {
+                if (pose_block_order[block_a.pose_index] % thd_num != thd_id) continue;
+                const auto h_a = block_a.H.col(0);
+                b_schur.segment(block_a.pose_index, block_a.pose_dim).noalias() -= Hll_inv_bl * h_a;
+                for (const auto &block_c : blocks) {
+                    auto H_ac = H_schur.block(block_a.pose_index, block_c.pose_index, block_a.pose_dim, block_c.pose_dim);
+                    for (int j = 0; j < block_c.pose_dim; ++j) {
+                        H_ac.col(j).noalias() -= (inv * block_c.H(j, 0)) * h_a;
+                    }
+                }
+            }
+        }
+    };
+    if (scalar_landmarks_) {
+        if (pool)
+            pool->Run(eliminate_scalar);
+        else
+            eliminate_scalar(0, 1);
+        return;
+    }
+
+    auto eliminate = [&](int thd_id, int thd_num) {
+        for (int l = 0; l < num_landmarks; ++l) {
+            const std::vector<PoseLandmarkBlock> &blocks = Hpl_[l];
+            VecX Hll_inv_bl;
+            for (const auto &block_a : blocks) {
+                if (pose_block_order[block_a.pose_index] % thd_num != thd_id) continue;
+                if (Hll_inv_bl.size() == 0)
+                    Hll_inv_bl = Hll_inv_[l] * b.segment(LandmarkIndex(l), Hll_[l].rows());
+
+                MatXX tempH = block_a.H * Hll_inv_[l];
+                b_schur.segment(block_a.pose_index, block_a.pose_dim).noalias() -= block_a.H * Hll_inv_bl;
+                for (const auto &block_c : blocks) {
+                    H_schur.block(block_a.pose_index, block_c.pose_index, block_a.pose_dim, block_c.pose_dim).noalias()
+                        -= tempH * block_c.H.transpose();
+                }
+            }
+        }
+    };
+    if (pool)
+        pool->Run(eliminate);
+    else
+        eliminate(0, 1);
+}
+
+void BlockSparseHessian::BackSubstitute(const VecX &b, VecX &x, ThreadPool *pool) const {
+    assert(LandmarksInverted() && "SchurComplement must be called before BackSubstitute");
+    auto substitute = [&](int thd_id, int begin, int end) {
+        for (int l = begin; l < end; ++l) {
+            ulong idx = LandmarkIndex(l);
+            if (scalar_landmarks_) {
+                double bl = b[idx];
+                for (const auto &block : Hpl_[l]) {
+                    bl -= block.H.col(0).dot(x.segment(block.pose_index, block.pose_dim));
+                }
+                x[idx] = Hll_inv_scalar_[l] * bl;
+                continue;
+            }
+            int dim = LandmarkDimOf(l);
+            VecX bl = b.segment(idx, dim);
+            for (const auto &block : Hpl_[l]) {
+                bl.noalias() -= block.H.transpose() * x.segment(block.pose_index, block.pose_dim);
+            }
+            x.segment(idx, dim).noalias() = Hll_inv_[l] * bl;
+        }
+    };
+    int num_landmarks = static_cast<int>(NumLandmarks());
+    if (pool)
+        pool->ParallelFor(num_landmarks, substitute);
+    else
+        substitute(0, 0, num_landmarks);
+}
+
+void BlockSparseHessian::InvertLandmarkBlocks(ThreadPool *pool) {
+    // Hll 是块对角的，直接对每个小块求逆
+    int num_landmarks = static_cast<int>(NumLandmarks());
+    if (scalar_landmarks_) {
+        // 对角元本身就是连续数组，整体取倒数（Eigen 按 SIMD 向量化）
+        Hll_inv_scalar_ = Hll_scalar_.cwiseInverse();
+        Hll_inv_.clear();
+        return;
+    }
+    Hll_inv_.resize(num_landmarks);
+    auto invert = [this](int thd_id, int begin, int end) {
+        for (int l = begin; l < end; ++l) {
+            Hll_inv_[l] = Hll_[l].inverse();
+        }
+    };
+    if (pool)
+        pool->ParallelFor(num_landmarks, invert);
+    else
+        invert(0, 0, num_landmarks);
+}
+
+VecX BlockSparseHessian::SchurMultiply(const VecX &xp, ThreadPool *pool) const {
+    assert(LandmarksInverted() && "InvertLandmarkBlocks must be called before SchurMultiply");
+    // 每个线程处理一部分 landmark，结果写到各自的缓冲区里最后求和
+    int thd_num = pool ? pool->NumThreads() : 1;
+    std::vector<VecX> partial(thd_num, VecX::Zero(dense_dim_));
+    auto multiply = [&](int thd_id, int begin, int end) {
+        VecX &y = partial[thd_id];
+        for (int l = begin; l < end; ++l) {
+            if (scalar_landmarks_) {
+                double t = 0.;
+                for (const auto &block : Hpl_[l]) {
+                    t += block.H.col(0).dot(xp.segment(block.pose_index, block.pose_dim));
+                }
+                double u = Hll_inv_scalar_[l] * t;
+                for (const auto &block : Hpl_[l]) {
+                    y.segment(block.pose_index, block.pose_dim).noalias() -= u * block.H.col(0);
+                }
+                continue;
+            }
+            VecX t = VecX::Zero(LandmarkDimOf(l));
+            for (const auto &block : Hpl_[l]) {
+                t.noalias() += block.H.transpose() * xp.segment(block.pose_index, block.pose_dim);
+            }
+            VecX u = Hll_inv_[l] * t;
+            for (const auto &block : Hpl_[l]) {
+                y.segment(block.pose_index, block.pose_dim).noalias() -= block.H * u;
+            }
+        }
+    };
+    int num_landmarks = static_cast<int>(NumLandmarks());
+    if (pool)
+        pool->ParallelFor(num_landmarks, multiply);
+    else
+        multiply(0, 0, num_landmarks);
+
+    VecX y = Hpp_ * xp;
+    for (const auto &p : partial) {
+        y += p;
+    }
+    return y;
+}
+
+VecX BlockSparseHessian::SchurRhs(const VecX &b, ThreadPool *pool) const {
+    assert(LandmarksInverted() && "InvertLandmarkBlocks must be called before SchurRhs");
+    int thd_num = pool ? pool->NumThreads() : 1;
+    std::vector<VecX> partial(thd_num, VecX::Zero(dense_dim_));
+    auto reduce = [&](int thd_id, int begin, int end) {
+        VecX &y = partial[thd_id];
+        for (int l = begin; l < end; ++l) {
+            if (scalar_landmarks_) {
+                double u = Hll_inv_scalar_[l] * b[LandmarkIndex(l)];
+                for (const auto &block : Hpl_[l]) {
+                    y.segment(block.pose_index, block.pose_dim).noalias() -= u * block.H.col(0);
+                }
+                continue;
+            }
+            VecX u = Hll_inv_[l] * b.segment(LandmarkIndex(l), LandmarkDimOf(l));
+            for (const auto &block : Hpl_[l]) {
+                y.segment(block.pose_index, block.pose_dim).noalias() -= block.H * u;
+            }
+        }
+    };
+    int num_landmarks = static_cast<int>(NumLandmarks());
+    if (pool)
+        pool->ParallelFor(num_landmarks, reduce);
+    else
+        reduce(0, 0, num_landmarks);
+
+    VecX b_schur = b.head(dense_dim_);
+    for (const auto &p : partial) {
+        b_schur += p;
+    }
+    return b_schur;
+}
+
+std::vector<MatXX> BlockSparseHessian::SchurDiagonalBlocks(const std::vector<std::pair<ulong, int>> &pose_blocks,
+                                                           ThreadPool *pool) const {
+    assert(LandmarksInverted() && "InvertLandmarkBlocks must be called before SchurDiagonalBlocks");
+    std::vector<MatXX> diag(pose_blocks.size());
+    std::vector<int> block_of_index(dense_dim_, -1);
+    for (size_t i = 0; i < pose_blocks.size(); ++i) {
+        diag[i] = Hpp_.block(pose_blocks[i].first, pose_blocks[i].first, pose_blocks[i].second, pose_blocks[i].second);
+        block_of_index[pose_blocks[i].first] = i;
+    }
+
+    // 按 pose 块分配给各线程，每个线程只写自己的块
+    auto eliminate = [&](int thd_id, int thd_num) {
+        for (size_t l = 0; l < Hpl_.size(); ++l) {
+            for (const auto &block : Hpl_[l]) {
+                int i = block_of_index[block.pose_index];
+                if (i < 0 || i % thd_num != thd_id) continue;
+                if (scalar_landmarks_) {
+                    for (int j = 0; j < block.pose_dim; ++j) {
+                        diag[i].col(j).noalias() -= (Hll_inv_scalar_[l] * block.H(j, 0)) * block.H.col(0);
+                    }
+                    continue;
+                }
+                diag[i].noalias() -= block.H * Hll_inv_[l] * block.H.transpose();
+            }
+        }
+    };
+    if (pool)
+        pool->Run(eliminate);
+    else
+        eliminate(0, 1);
+    return diag;
+}
+
+MatXX BlockSparseHessian::ToDense() const {
+    MatXX H(MatXX::Zero(Dim(), Dim()));
+    H.topLeftCorner(dense_dim_, dense_dim_) = Hpp_;
+    for (size_t l = 0; l < Hpl_.size(); ++l) {
+        ulong idx = LandmarkIndex(l);
+        int dim = LandmarkDimOf(l);
+        H.block(idx, idx, dim, dim) = LandmarkBlock(l);
+        for (const auto &block : Hpl_[l]) {
+            H.block(block.pose_index, idx, block.pose_dim, dim) = block.H;
+            H.block(idx, block.pose_index, dim, block.pose_dim) = block.H.transpose();
+        }
+    }
+    return H;
+}
+
+}
+}
@@ -2,6 +2,7 @@
 #include "backend/edge.h"
 //#include <glog/logging.h>
 #include <iostream>
+#include <cassert>
 
 using namespace std;
 
@@ -19,9 +20,7 @@ Edge::Edge(int residual_dimension, int num_verticies,
     jacobians_.resize(num_verticies);
     id_ = global_edge_id++;
 
-    Eigen::MatrixXd information(residual_dimension, residual_dimension);
-    information.setIdentity();
-    information_ = information;
+    information_.setIdentity(residual_dimension, residual_dimension);
 
     lossfunction_ = NULL;
 //    cout<<"Edge construct residual_dimension="<<residual_dimension
@@ -73,6 +72,30 @@ void Edge::RobustInfo(double &drho, MatXX &info) const{
     }
 }
 
+void Edge::LinearizeBlocks(const std::vector<int> &index, std::vector<MatXX> &hessians,
+                           std::vector<VecX> &gradients) const {
+    size_t n = verticies_.size();
+    assert(index.size() == n && jacobians_.size() == n);
+
+    // 鲁棒核函数会修改残差和信息矩阵，如果没有设置 robust cost function，就会返回原来的
+    double drho;
+    MatXX robustInfo(information_.rows(), information_.cols());
+    RobustInfo(drho, robustInfo);
+    VecX weighted_residual = drho * information_ * residual_;
+
+    for (size_t i = 0; i < n; ++i) {
+        if (index[i] < 0) continue;
+        MatXX JtW = jacobians_[i].transpose() * robustInfo;
+        for (size_t j = i; j < n; ++j) {
+            if (index[j] < 0) continue;
+            hessians[i * n + j].noalias() = JtW * jacobians_[j];
+            if (j != i)
+                hessians[j * n + i] = hessians[i * n + j].transpose();
+        }
+        gradients[i].noalias() = jacobians_[i].transpose() * weighted_residual;
+    }
+}
+
 bool Edge::CheckValid() {
     if (!verticies_types_.empty()) {
         // check type info
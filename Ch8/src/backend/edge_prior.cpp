@@ -37,7 +37,7 @@ static Eigen::Matrix<typename Derived::Scalar, 4, 4> Qleft(const Eigen::Quaterni
 #endif
 
 void EdgeSE3Prior::ComputeResidual() {
-    VecX param_i = verticies_[0]->Parameters();
+    auto param_i = VertexParameters<7>(0);
     Qd Qi(param_i[6], param_i[3], param_i[4], param_i[5]);
     Vec3 Pi = param_i.head<3>();
 
@@ -58,7 +58,7 @@ void EdgeSE3Prior::ComputeResidual() {
 
 void EdgeSE3Prior::ComputeJacobians() {
 
-    VecX param_i = verticies_[0]->Parameters();
+    auto param_i = VertexParameters<7>(0);
     Qd Qi(param_i[6], param_i[3], param_i[4], param_i[5]);
 
     // w.r.t. pose i
@@ -75,7 +75,7 @@ void EdgeSE3Prior::ComputeJacobians() {
 #endif
     jacobian_pose_i.block<3,3>(3,0) = Mat33::Identity();
 
-    jacobians_[0] = jacobian_pose_i;
+    Jacobian<0>() = jacobian_pose_i;
 //    std::cout << jacobian_pose_i << std::endl;
 }
 
@@ -1,201 +1,250 @@
-#include "../thirdparty/Sophus/sophus/se3.hpp"
-#include "backend/vertex_pose.h"
-#include "backend/edge_reprojection.h"
-#include "utility/utility.h"
-
-#include <iostream>
-
-namespace myslam {
-namespace backend {
-
-/*    std::vector<std::shared_ptr<Vertex>> verticies_; // 该边对应的顶点
-    VecX residual_;                 // 残差
-    std::vector<MatXX> jacobians_;  // 雅可比，每个雅可比维度是 residual x vertex[i]
-    MatXX information_;             // 信息矩阵
-    VecX observation_;              // 观测信息
-    */
-
-void EdgeReprojection::ComputeResidual() {
-//    std::cout << pts_i_.transpose() <<" "<<pts_j_.transpose()  <<std::endl;
-
-    double inv_dep_i = verticies_[0]->Parameters()[0];
-
-    VecX param_i = verticies_[1]->Parameters();
-    Qd Qi(param_i[6], param_i[3], param_i[4], param_i[5]);
-    Vec3 Pi = param_i.head<3>();
-
-    VecX param_j = verticies_[2]->Parameters();
-    Qd Qj(param_j[6], param_j[3], param_j[4], param_j[5]);
-    Vec3 Pj = param_j.head<3>();
-
-    VecX param_ext = verticies_[3]->Parameters();
-    Qd qic(param_ext[6], param_ext[3], param_ext[4], param_ext[5]);
-    Vec3 tic = param_ext.head<3>();
-
-    Vec3 pts_camera_i = pts_i_ / inv_dep_i;
-    Vec3 pts_imu_i = qic * pts_camera_i + tic;
-    Vec3 pts_w = Qi * pts_imu_i + Pi;
-    Vec3 pts_imu_j = Qj.inverse() * (pts_w - Pj);
-    Vec3 pts_camera_j = qic.inverse() * (pts_imu_j - tic);
-
-    double dep_j = pts_camera_j.z();
-    residual_ = (pts_camera_j / dep_j).head<2>() - pts_j_.head<2>();   /// J^t * J * delta_x = - J^t * r
-//    residual_ = information_ * residual_;   // remove information here, we multi information matrix in problem solver
-}
-
-//void EdgeReprojection::SetTranslationImuFromCamera(Eigen::Quaterniond &qic_, Vec3 &tic_) {
-//    qic = qic_;
-//    tic = tic_;
-//}
-
-void EdgeReprojection::ComputeJacobians() {
-    double inv_dep_i = verticies_[0]->Parameters()[0];
-
-    VecX param_i = verticies_[1]->Parameters();
-    Qd Qi(param_i[6], param_i[3], param_i[4], param_i[5]);
-    Vec3 Pi = param_i.head<3>();
-
-    VecX param_j = verticies_[2]->Parameters();
-    Qd Qj(param_j[6], param_j[3], param_j[4], param_j[5]);
-    Vec3 Pj = param_j.head<3>();
-
-    VecX param_ext = verticies_[3]->Parameters();
-    Qd qic(param_ext[6], param_ext[3], param_ext[4], param_ext[5]);
-    Vec3 tic = param_ext.head<3>();
-
-    Vec3 pts_camera_i = pts_i_ / inv_dep_i;
-    Vec3 pts_imu_i = qic * pts_camera_i + tic;
-    Vec3 pts_w = Qi * pts_imu_i + Pi;
-    Vec3 pts_imu_j = Qj.inverse() * (pts_w - Pj);
-    Vec3 pts_camera_j = qic.inverse() * (pts_imu_j - tic);
-
-    double dep_j = pts_camera_j.z();
-
-    Mat33 Ri = Qi.toRotationMatrix();
-    Mat33 Rj = Qj.toRotationMatrix();
-    Mat33 ric = qic.toRotationMatrix();
-    Mat23 reduce(2, 3);
-    reduce << 1. / dep_j, 0, -pts_camera_j(0) / (dep_j * dep_j),
-        0, 1. / dep_j, -pts_camera_j(1) / (dep_j * dep_j);
-//    reduce = information_ * reduce;
-
-    Eigen::Matrix<double, 2, 6> jacobian_pose_i;
-    Eigen::Matrix<double, 3, 6> jaco_i;
-    jaco_i.leftCols<3>() = ric.transpose() * Rj.transpose();
-    jaco_i.rightCols<3>() = ric.transpose() * Rj.transpose() * Ri * -Sophus::SO3d::hat(pts_imu_i);
-    jacobian_pose_i.leftCols<6>() = reduce * jaco_i;
-
-    Eigen::Matrix<double, 2, 6> jacobian_pose_j;
-    Eigen::Matrix<double, 3, 6> jaco_j;
-    jaco_j.leftCols<3>() = ric.transpose() * -Rj.transpose();
-    jaco_j.rightCols<3>() = ric.transpose() * Sophus::SO3d::hat(pts_imu_j);
-    jacobian_pose_j.leftCols<6>() = reduce * jaco_j;
-
-    Eigen::Vector2d jacobian_feature;
-    jacobian_feature = reduce * ric.transpose() * Rj.transpose() * Ri * ric * pts_i_ * -1.0 / (inv_dep_i * inv_dep_i);
-
-    Eigen::Matrix<double, 2, 6> jacobian_ex_pose;
-    Eigen::Matrix<double, 3, 6> jaco_ex;
-    jaco_ex.leftCols<3>() = ric.transpose() * (Rj.transpose() * Ri - Eigen::Matrix3d::Identity());
-    Eigen::Matrix3d tmp_r = ric.transpose() * Rj.transpose() * Ri * ric;
-    jaco_ex.rightCols<3>() = -tmp_r * Utility::skewSymmetric(pts_camera_i) + Utility::skewSymmetric(tmp_r * pts_camera_i) +
-                             Utility::skewSymmetric(ric.transpose() * (Rj.transpose() * (Ri * tic + Pi - Pj) - tic));
-    jacobian_ex_pose.leftCols<6>() = reduce * jaco_ex;
-
-    jacobians_[0] = jacobian_feature;
-    jacobians_[1] = jacobian_pose_i;
-    jacobians_[2] = jacobian_pose_j;
-    jacobians_[3] = jacobian_ex_pose;
-
-    ///------------- check jacobians -----------------
-//    {
-//        std::cout << jacobians_[0] <<std::endl;
-//        const double eps = 1e-6;
-//        inv_dep_i += eps;
-//        Eigen::Vector3d pts_camera_i = pts_i_ / inv_dep_i;
-//        Eigen::Vector3d pts_imu_i = qic * pts_camera_i + tic;
-//        Eigen::Vector3d pts_w = Qi * pts_imu_i + Pi;
-//        Eigen::Vector3d pts_imu_j = Qj.inverse() * (pts_w - Pj);
-//        Eigen::Vector3d pts_camera_j = qic.inverse() * (pts_imu_j - tic);
-//
-//        Eigen::Vector2d tmp_residual;
-//        double dep_j = pts_camera_j.z();
-//        tmp_residual = (pts_camera_j / dep_j).head<2>() - pts_j_.head<2>();
-//        tmp_residual = information_ * tmp_residual;
-//        std::cout <<"num jacobian: "<<  (tmp_residual - residual_) / eps <<std::endl;
-//    }
-
-}
-
-void EdgeReprojectionXYZ::ComputeResidual() {
-    Vec3 pts_w = verticies_[0]->Parameters();
-
-    VecX param_i = verticies_[1]->Parameters();
-    Qd Qi(param_i[6], param_i[3], param_i[4], param_i[5]);
-    Vec3 Pi = param_i.head<3>();
-
-    Vec3 pts_imu_i = Qi.inverse() * (pts_w - Pi);
-    Vec3 pts_camera_i = qic.inverse() * (pts_imu_i - tic);
-
-    double dep_i = pts_camera_i.z();
-    residual_ = (pts_camera_i / dep_i).head<2>() - obs_.head<2>();
-}
-
-void EdgeReprojectionXYZ::SetTranslationImuFromCamera(Eigen::Quaterniond &qic_, Vec3 &tic_) {
-    qic = qic_;
-    tic = tic_;
-}
-
-void EdgeReprojectionXYZ::ComputeJacobians() {
-
-    Vec3 pts_w = verticies_[0]->Parameters();
-
-    VecX param_i = verticies_[1]->Parameters();
-    Qd Qi(param_i[6], param_i[3], param_i[4], param_i[5]);
-    Vec3 Pi = param_i.head<3>();
-
-    Vec3 pts_imu_i = Qi.inverse() * (pts_w - Pi);
-    Vec3 pts_camera_i = qic.inverse() * (pts_imu_i - tic);
-
-    double dep_i = pts_camera_i.z();
-
-    Mat33 Ri = Qi.toRotationMatrix();
-    Mat33 ric = qic.toRotationMatrix();
-    Mat23 reduce(2, 3);
-    reduce << 1. / dep_i, 0, -pts_camera_i(0) / (dep_i * dep_i),
-        0, 1. / dep_i, -pts_camera_i(1) / (dep_i * dep_i);
-
-    Eigen::Matrix<double, 2, 6> jacobian_pose_i;
-    Eigen::Matrix<double, 3, 6> jaco_i;
-    jaco_i.leftCols<3>() = ric.transpose() * -Ri.transpose();
-    jaco_i.rightCols<3>() = ric.transpose() * Sophus::SO3d::hat(pts_imu_i);
-    jacobian_pose_i.leftCols<6>() = reduce * jaco_i;
-
-    Eigen::Matrix<double, 2, 3> jacobian_feature;
-    jacobian_feature = reduce * ric.transpose() * Ri.transpose();
-
-    jacobians_[0] = jacobian_feature;
-    jacobians_[1] = jacobian_pose_i;
-
-}
-
-void EdgeReprojectionPoseOnly::ComputeResidual() {
-    VecX pose_params = verticies_[0]->Parameters();
-    Sophus::SE3d pose(
-        Qd(pose_params[6], pose_params[3], pose_params[4], pose_params[5]),
-        pose_params.head<3>()
-    );
-
-    Vec3 pc = pose * landmark_world_;
-    pc = pc / pc[2];
-    Vec2 pixel = (K_ * pc).head<2>() - observation_;
-    // TODO:: residual_ = ????
-    residual_ = pixel;
-}
-
-void EdgeReprojectionPoseOnly::ComputeJacobians() {
-    // TODO implement jacobian here
-}
-
-}
+#include "../thirdparty/Sophus/sophus/se3.hpp"
+#include "backend/vertex_pose.h"
+#include "backend/edge_reprojection.h"
+#include "utility/utility.h"
+
+#include <iostream>
+
+namespace myslam {
+namespace backend {
+
+/*    std::vector<std::shared_ptr<Vertex>> verticies_; // 该边对应的顶点
+    VecX residual_;                 // 残差
+    std::vector<MatXX> jacobians_;  // 雅可比，每个雅可比维度是 residual x vertex[i]
+    MatXX information_;             // 信息矩阵
+    VecX observation_;              // 观测信息
+    */
+
+void EdgeReprojection::Evaluate(bool need_jacobians) {
+//    std::cout << pts_i_.transpose() <<" "<<pts_j_.transpose()  <<std::endl;
+
+    double inv_dep_i = VertexParameters<1>(0)[0];
+
+    auto param_i = VertexParameters<7>(1);
+    Qd Qi(param_i[6], param_i[3], param_i[4], param_i[5]);
+    Vec3 Pi = param_i.head<3>();
+
+    auto param_j = VertexParameters<7>(2);
+    Qd Qj(param_j[6], param_j[3], param_j[4], param_j[5]);
+    Vec3 Pj = param_j.head<3>();
+
+    auto param_ext = VertexParameters<7>(3);
+    Qd qic(param_ext[6], param_ext[3], param_ext[4], param_ext[5]);
+    Vec3 tic = param_ext.head<3>();
+
+    Vec3 pts_camera_i = pts_i_ / inv_dep_i;
+    Vec3 pts_imu_i = qic * pts_camera_i + tic;
+    Vec3 pts_w = Qi * pts_imu_i + Pi;
+    Vec3 pts_imu_j = Qj.inverse() * (pts_w - Pj);
+    Vec3 pts_camera_j = qic.inverse() * (pts_imu_j - tic);
+
+    double dep_j = pts_camera_j.z();
+    residual_ = (pts_camera_j / dep_j).head<2>() - pts_j_.head<2>();   /// J^t * J * delta_x = - J^t * r
+//    residual_ = information_ * residual_;   // remove information here, we multi information matrix in problem solver
+
+    if (!need_jacobians)
+        return;
+
+    Mat33 Ri = Qi.toRotationMatrix();
+    Mat33 Rj = Qj.toRotationMatrix();
+    Mat33 ric = qic.toRotationMatrix();
+    Mat23 reduce(2, 3);
+    reduce << 1. / dep_j, 0, -pts_camera_j(0) / (dep_j * dep_j),
+        0, 1. / dep_j, -pts_camera_j(1) / (dep_j * dep_j);
+//    reduce = information_ * reduce;
+
+    Eigen::Matrix<double, 2, 6> jacobian_pose_i;
+    Eigen::Matrix<double, 3, 6> jaco_i;
+    jaco_i.leftCols<3>() = ric.transpose() * Rj.transpose();
+    jaco_i.rightCols<3>() = ric.transpose() * Rj.transpose() * Ri * -Sophus::SO3d::hat(pts_imu_i);
+    jacobian_pose_i.leftCols<6>() = reduce * jaco_i;
+
+    Eigen::Matrix<double, 2, 6> jacobian_pose_j;
+    Eigen::Matrix<double, 3, 6> jaco_j;
+    jaco_j.leftCols<3>() = ric.transpose() * -Rj.transpose();
+    jaco_j.rightCols<3>() = ric.transpose() * Sophus::SO3d::hat(pts_imu_j);
+    jacobian_pose_j.leftCols<6>() = reduce * jaco_j;
+
+    Eigen::Vector2d jacobian_feature;
+    jacobian_feature = reduce * ric.transpose() * Rj.transpose() * Ri * ric * pts_i_ * -1.0 / (inv_dep_i * inv_dep_i);
+
+    Eigen::Matrix<double, 2, 6> jacobian_ex_pose;
+    Eigen::Matrix<double, 3, 6> jaco_ex;
+    jaco_ex.leftCols<3>() = ric.transpose() * (Rj.transpose() * Ri - Eigen::Matrix3d::Identity());
+    Eigen::Matrix3d tmp_r = ric.transpose() * Rj.transpose() * Ri * ric;
+    jaco_ex.rightCols<3>() = -tmp_r * Utility::skewSymmetric(pts_camera_i) + Utility::skewSymmetric(tmp_r * pts_camera_i) +
+                             Utility::skewSymmetric(ric.transpose() * (Rj.transpose() * (Ri * tic + Pi - Pj) - tic));
+    jacobian_ex_pose.leftCols<6>() = reduce * jaco_ex;
+
+    Jacobian<0>() = jacobian_feature;
+    Jacobian<1>() = jacobian_pose_i;
+    Jacobian<2>() = jacobian_pose_j;
+    Jacobian<3>() = jacobian_ex_pose;
+
+    ///------------- check jacobians -----------------
+//    {
+//        std::cout << jacobians_[0] <<std::endl;
+//        const double eps = 1e-6;
+//        inv_dep_i += eps;
+//        Eigen::Vector3d pts_camera_i = pts_i_ / inv_dep_i;
+//        Eigen::Vector3d pts_imu_i = qic * pts_camera_i + tic;
+//        Eigen::Vector3d pts_w = Qi * pts_imu_i + Pi;
+//        Eigen::Vector3d pts_imu_j = Qj.inverse() * (pts_w - Pj);
+//        Eigen::Vector3d pts_camera_j = qic.inverse() * (pts_imu_j - tic);
+//
+//        Eigen::Vector2d tmp_residual;
+//        double dep_j = pts_camera_j.z();
+//        tmp_residual = (pts_camera_j / dep_j).head<2>() - pts_j_.head<2>();
+//        tmp_residual = information_ * tmp_residual;
+//        std::cout <<"num jacobian: "<<  (tmp_residual - residual_) / eps <<std::endl;
+//    }
+
+}
+
+void EdgeReprojection::PackBatch(ReprojectionBatch &batch, int lane) const {
+    batch.inv_dep[lane] = VertexParameters<1>(0)[0];
+    for (int k = 0; k < 3; ++k) {
+        batch.pts_i[k][lane] = pts_i_[k];
+    }
+    for (int k = 0; k < 2; ++k) {
+        batch.pts_j[k][lane] = pts_j_[k];
+    }
+
+    // 参数为 tx ty tz qx qy qz qw
+    auto param_i = VertexParameters<7>(1);
+    auto param_j = VertexParameters<7>(2);
+    auto param_ext = VertexParameters<7>(3);
+    for (int k = 0; k < 3; ++k) {
+        batch.pi[k][lane] = param_i[k];
+        batch.pj[k][lane] = param_j[k];
+        batch.tic[k][lane] = param_ext[k];
+    }
+    for (int k = 0; k < 4; ++k) {
+        batch.qi[k][lane] = param_i[3 + k];
+        batch.qj[k][lane] = param_j[3 + k];
+        batch.qic[k][lane] = param_ext[3 + k];
+    }
+}
+
+void EdgeReprojection::UnpackBatch(const ReprojectionBatch &batch, int lane, bool need_jacobians) {
+    residual_[0] = batch.residual[0][lane];
+    residual_[1] = batch.residual[1][lane];
+    if (!need_jacobians)
+        return;
+
+    double *jacobian = jacobian_.data();
+    for (int k = 0; k < ReprojectionBatch::kResidualDimension * ReprojectionBatch::kJacobianCols; ++k) {
+        jacobian[k] = batch.jacobian[k][lane];
+    }
+}
+
+void EdgeReprojection::PackHessianBatch(ReprojectionBatch &batch, int lane, const std::vector<int> &index,
+                                        std::vector<VecX> &gradients) const {
+    double drho;
+    InformationType robust_info = RobustInformation(drho);
+    // 信息矩阵各向同性时 W 本身是对称的
+    batch.weight[0][lane] = robust_info(0, 0);
+    batch.weight[1][lane] = 0.5 * (robust_info(0, 1) + robust_info(1, 0));
+    batch.weight[2][lane] = robust_info(1, 1);
+    LinearizeGradients(index, drho, gradients);
+}
+
+void EdgeReprojection::UnpackHessianBatch(const ReprojectionBatch &batch, int lane, const std::vector<int> &index,
+                                          std::vector<MatXX> &hessians) const {
+    const int dims[] = {VertexDimension<0>::value, VertexDimension<1>::value,
+                        VertexDimension<2>::value, VertexDimension<3>::value};
+    const int offsets[] = {VertexOffset<0>::value, VertexOffset<1>::value,
+                           VertexOffset<2>::value, VertexOffset<3>::value};
+    const int n = kNumVertices;
+    for (int i = 0; i < n; ++i) {
+        if (index[i] < 0) continue;
+        for (int j = i; j < n; ++j) {
+            if (index[j] < 0) continue;
+            MatXX &block = hessians[i * n + j];
+            block.resize(dims[i], dims[j]);
+            for (int c = 0; c < dims[j]; ++c) {
+                for (int r = 0; r < dims[i]; ++r) {
+                    // 对角块的下三角由对称性得到
+                    int a = offsets[i] + r, b = offsets[j] + c;
+                    block(r, c) = a <= b ? batch.hessian[ReprojectionBatch::HessianIndex(a, b)][lane]
+                                         : batch.hessian[ReprojectionBatch::HessianIndex(b, a)][lane];
+                }
+            }
+            if (j != i)
+                hessians[j * n + i] = block.transpose();
+        }
+    }
+}
+
+void EdgeReprojectionXYZ::ComputeResidual() {
+    Vec3 pts_w = VertexParameters<3>(0);
+
+    auto param_i = VertexParameters<7>(1);
+    Qd Qi(param_i[6], param_i[3], param_i[4], param_i[5]);
+    Vec3 Pi = param_i.head<3>();
+
+    Vec3 pts_imu_i = Qi.inverse() * (pts_w - Pi);
+    Vec3 pts_camera_i = qic.inverse() * (pts_imu_i - tic);
+
+    double dep_i = pts_camera_i.z();
+    residual_ = (pts_camera_i / dep_i).head<2>() - obs_.head<2>();
+}
+
+void EdgeReprojectionXYZ::SetTranslationImuFromCamera(Eigen::Quaterniond &qic_, Vec3 &tic_) {
+    qic = qic_;
+    tic = tic_;
+}
+
+void EdgeReprojectionXYZ::ComputeJacobians() {
+
+    Vec3 pts_w = VertexParameters<3>(0);
+
+    auto param_i = VertexParameters<7>(1);
+    Qd Qi(param_i[6], param_i[3], param_i[4], param_i[5]);
+    Vec3 Pi = param_i.head<3>();
+
+    Vec3 pts_imu_i = Qi.inverse() * (pts_w - Pi);
+    Vec3 pts_camera_i = qic.inverse() * (pts_imu_i - tic);
+
+    double dep_i = pts_camera_i.z();
+
+    Mat33 Ri = Qi.toRotationMatrix();
+    Mat33 ric = qic.toRotationMatrix();
+    Mat23 reduce(2, 3);
+    reduce << 1. / dep_i, 0, -pts_camera_i(0) / (dep_i * dep_i),
+        0, 1. / dep_i, -pts_camera_i(1) / (dep_i * dep_i);
+
+    Eigen::Matrix<double, 2, 6> jacobian_pose_i;
+    Eigen::Matrix<double, 3, 6> jaco_i;
+    jaco_i.leftCols<3>() = ric.transpose() * -Ri.transpose();
+    jaco_i.rightCols<3>() = ric.transpose() * Sophus::SO3d::hat(pts_imu_i);
+    jacobian_pose_i.leftCols<6>() = reduce * jaco_i;
+
+    Eigen::Matrix<double, 2, 3> jacobian_feature;
+    jacobian_feature = reduce * ric.transpose() * Ri.transpose();
+
+    Jacobian<0>() = jacobian_feature;
+    Jacobian<1>() = jacobian_pose_i;
+
+}
+
+void EdgeReprojectionPoseOnly::ComputeResidual() {
+    auto pose_params = VertexParameters<7>(0);
+    Sophus::SE3d pose(
+        Qd(pose_params[6], pose_params[3], pose_params[4], pose_params[5]),
+        pose_params.head<3>()
+    );
+
+    Vec3 pc = pose * landmark_world_;
+    pc = pc / pc[2];
+    Vec2 pixel = (K_ * pc).head<2>() - observation_;
+    // TODO:: residual_ = ????
+    residual_ = pixel;
+}
+
+void EdgeReprojectionPoseOnly::ComputeJacobians() {
+    // TODO implement jacobian here
+}
+
+}
 }
\ No newline at end of file
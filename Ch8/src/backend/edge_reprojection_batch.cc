@@ -0,0 +1,130 @@
+#include "backend/edge_reprojection_batch.h"
+#include "backend/edge_reprojection_kernel_impl.h"
+
+namespace myslam {
+namespace backend {
+
+void ReprojectionBatch::Resize(int n) {
+    size_ = n;
+    inv_dep.resize(n);
+    for (int k = 0; k < 3; ++k) {
+        pts_i[k].resize(n);
+        pi[k].resize(n);
+        pj[k].resize(n);
+        tic[k].resize(n);
+    }
+    for (int k = 0; k < 2; ++k) {
+        pts_j[k].resize(n);
+        residual[k].resize(n);
+    }
+    for (int k = 0; k < 4; ++k) {
+        qi[k].resize(n);
+        qj[k].resize(n);
+        qic[k].resize(n);
+    }
+    for (int k = 0; k < kResidualDimension * kJacobianCols; ++k) {
+        jacobian[k].resize(n);
+    }
+    for (int k = 0; k < 3; ++k) {
+        weight[k].resize(n);
+    }
+    for (int k = 0; k < kHessianSize; ++k) {
+        hessian[k].resize(n);
+    }
+}
+
+namespace {
+
+static_assert(ReprojectionBatch::kJacobianCols == ReprojectionBatchData::kJacobianCols &&
+              ReprojectionBatch::kHessianSize == ReprojectionBatchData::kHessianSize,
+              "ReprojectionBatch and ReprojectionBatchData must agree");
+
+ReprojectionBatchData MakeBatchData(ReprojectionBatch &batch) {
+    ReprojectionBatchData data;
+    data.size = batch.Size();
+    data.inv_dep = batch.inv_dep.data();
+    for (int k = 0; k < 3; ++k) {
+        data.pts_i[k] = batch.pts_i[k].data();
+        data.pi[k] = batch.pi[k].data();
+        data.pj[k] = batch.pj[k].data();
+        data.tic[k] = batch.tic[k].data();
+        data.weight[k] = batch.weight[k].data();
+    }
+    for (int k = 0; k < 2; ++k) {
+        data.pts_j[k] = batch.pts_j[k].data();
+        data.residual[k] = batch.residual[k].data();
+    }
+    for (int k = 0; k < 4; ++k) {
+        data.qi[k] = batch.qi[k].data();
+        data.qj[k] = batch.qj[k].data();
+        data.qic[k] = batch.qic[k].data();
+    }
+    for (int k = 0; k < ReprojectionBatch::kResidualDimension * ReprojectionBatch::kJacobianCols; ++k) {
+        data.jacobian[k] = batch.jacobian[k].data();
+    }
+    for (int k = 0; k < ReprojectionBatch::kHessianSize; ++k) {
+        data.hessian[k] = batch.hessian[k].data();
+    }
+    return data;
+}
+
+/// 运行时选用的实现
+struct ReprojectionKernel {
+    void (*evaluate)(const ReprojectionBatchData &, bool);
+    void (*hessian)(const ReprojectionBatchData &);
+    int width;
+    const char *isa;
+};
+
+/*
+ * 按 CPU 实际支持的指令集选择，只在第一次调用时检测
+ * 编译时没有打开 USE_AVX2 / USE_AVX512 的版本不会被选中，都不支持时使用标量实现
+ */
+ReprojectionKernel DetectKernel() {
+#if defined(MYSLAM_REPROJECTION_AVX512) || defined(MYSLAM_REPROJECTION_AVX2)
+    __builtin_cpu_init();
+#endif
+#ifdef MYSLAM_REPROJECTION_AVX512
+    if (__builtin_cpu_supports("avx512f"))
+        return ReprojectionKernel{EvaluateReprojectionAvx512, EvaluateReprojectionHessianAvx512, 8, "AVX-512"};
+#endif
+#ifdef MYSLAM_REPROJECTION_AVX2
+    if (__builtin_cpu_supports("avx2"))
+        return ReprojectionKernel{EvaluateReprojectionAvx2, EvaluateReprojectionHessianAvx2, 4, "AVX2"};
+#endif
+    return ReprojectionKernel{EvaluateReprojectionScalar, EvaluateReprojectionHessianScalar, 1, "scalar"};
+}
+
+const ReprojectionKernel &GetKernel() {
+    static const ReprojectionKernel kernel = DetectKernel();
+    return kernel;
+}
+
+}
+
+void EvaluateReprojectionScalar(const ReprojectionBatchData &data, bool need_jacobians) {
+    EvaluateRange<PacketScalar>(data, need_jacobians);
+}
+
+void EvaluateReprojectionHessianScalar(const ReprojectionBatchData &data) {
+    HessianRange<PacketScalarF>(data);
+}
+
+void EvaluateReprojectionHessianBatch(ReprojectionBatch &batch) {
+    GetKernel().hessian(MakeBatchData(batch));
+}
+
+void EvaluateReprojectionBatch(ReprojectionBatch &batch, bool need_jacobians) {
+    GetKernel().evaluate(MakeBatchData(batch), need_jacobians);
+}
+
+int ReprojectionBatchWidth() {
+    return GetKernel().width;
+}
+
+const char *ReprojectionBatchIsa() {
+    return GetKernel().isa;
+}
+
+}
+}
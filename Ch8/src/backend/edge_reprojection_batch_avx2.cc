@@ -0,0 +1,23 @@
+/*
+ * AVX2 版本的重投影边批量计算，以 -mavx2 单独编译
+ * 只能通过 ReprojectionBatchData 的裸指针访问数据，不要在这里使用标准库或 Eigen
+ */
+#include "backend/edge_reprojection_kernel_impl.h"
+
+#ifndef __AVX2__
+#error "edge_reprojection_batch_avx2.cc must be compiled with -mavx2"
+#endif
+
+namespace myslam {
+namespace backend {
+
+void EvaluateReprojectionAvx2(const ReprojectionBatchData &data, bool need_jacobians) {
+    EvaluateRange<PacketAvx2>(data, need_jacobians);
+}
+
+void EvaluateReprojectionHessianAvx2(const ReprojectionBatchData &data) {
+    HessianRange<PacketAvx2F>(data);
+}
+
+}
+}
@@ -0,0 +1,23 @@
+/*
+ * AVX-512 版本的重投影边批量计算，以 -mavx512f 单独编译
+ * 只能通过 ReprojectionBatchData 的裸指针访问数据，不要在这里使用标准库或 Eigen
+ */
+#include "backend/edge_reprojection_kernel_impl.h"
+
+#ifndef __AVX512F__
+#error "edge_reprojection_batch_avx512.cc must be compiled with -mavx512f"
+#endif
+
+namespace myslam {
+namespace backend {
+
+void EvaluateReprojectionAvx512(const ReprojectionBatchData &data, bool need_jacobians) {
+    EvaluateRange<PacketAvx512>(data, need_jacobians);
+}
+
+void EvaluateReprojectionHessianAvx512(const ReprojectionBatchData &data) {
+    HessianRange<PacketAvx512F>(data);
+}
+
+}
+}
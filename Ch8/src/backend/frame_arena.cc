@@ -0,0 +1,110 @@
+#include <cstdlib>
+#include <new>
+#include "backend/frame_arena.h"
+
+namespace myslam {
+namespace backend {
+
+namespace {
+
+void *AlignedMalloc(size_t bytes) {
+    void *p = nullptr;
+    if (posix_memalign(&p, FrameArena::kAlignment, bytes) != 0)
+        throw std::bad_alloc();
+    return p;
+}
+
+}
+
+FrameArena::FrameArena(size_t block_bytes) : block_bytes_(RoundUp(block_bytes)) {}
+
+FrameArena::~FrameArena() {
+    for (char *block : blocks_) {
+        free(block);
+    }
+}
+
+void *FrameArena::Allocate(size_t bytes) {
+    size_t size = RoundUp(bytes > 0 ? bytes : 1);
+    ++frame_.allocations;
+    frame_.bytes += size;
+    ++live_allocations_;
+    live_bytes_ += size;
+
+    // 大块不切分，也不进入空闲链表
+    if (size > block_bytes_ / 4) {
+        ++frame_.system_allocations;
+        reserved_bytes_ += size;
+        return AlignedMalloc(size);
+    }
+
+    size_t k = size / kAlignment - 1;
+    if (k < free_lists_.size() && free_lists_[k]) {
+        void *p = free_lists_[k];
+        free_lists_[k] = *static_cast<void **>(p);
+        ++frame_.reused;
+        return p;
+    }
+
+    if (size_t(end_ - cursor_) < size) {
+        // 当前块剩余的部分不再使用，换到下一块
+        size_t next = cursor_ ? block_index_ + 1 : 0;
+        if (next == blocks_.size()) {
+            blocks_.push_back(static_cast<char *>(AlignedMalloc(block_bytes_)));
+            ++frame_.system_allocations;
+            reserved_bytes_ += block_bytes_;
+        }
+        block_index_ = next;
+        cursor_ = blocks_[next];
+        end_ = cursor_ + block_bytes_;
+    }
+    void *p = cursor_;
+    cursor_ += size;
+    return p;
+}
+
+void FrameArena::Deallocate(void *p, size_t bytes) {
+    if (!p)
+        return;
+    size_t size = RoundUp(bytes > 0 ? bytes : 1);
+    --live_allocations_;
+    live_bytes_ -= size;
+
+    if (size > block_bytes_ / 4) {
+        reserved_bytes_ -= size;
+        free(p);
+    } else {
+        size_t k = size / kAlignment - 1;
+        if (k >= free_lists_.size())
+            free_lists_.resize(k + 1, nullptr);
+        *static_cast<void **>(p) = free_lists_[k];
+        free_lists_[k] = p;
+    }
+
+    if (live_allocations_ == 0)
+        Rewind();
+}
+
+void FrameArena::Rewind() {
+    // 所有内存块都已空闲，空闲链表中的块都落在这些内存块中，一并丢弃
+    free_lists_.assign(free_lists_.size(), nullptr);
+    block_index_ = 0;
+    cursor_ = blocks_.empty() ? nullptr : blocks_[0];
+    end_ = blocks_.empty() ? nullptr : blocks_[0] + block_bytes_;
+}
+
+FrameArena::Stats FrameArena::CurrentFrame() const {
+    Stats stats = frame_;
+    stats.live_bytes = live_bytes_;
+    stats.reserved_bytes = reserved_bytes_;
+    return stats;
+}
+
+FrameArena::Stats FrameArena::EndFrame() {
+    Stats stats = CurrentFrame();
+    frame_ = Stats();
+    return stats;
+}
+
+}
+}
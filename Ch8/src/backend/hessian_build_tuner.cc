@@ -0,0 +1,55 @@
+#include <cassert>
+#include "backend/hessian_build_tuner.h"
+
+namespace myslam {
+namespace backend {
+
+HessianBuildTuner::HessianBuildTuner(const std::vector<int> &candidates)
+    : candidates_(candidates) {
+    assert(!candidates_.empty());
+}
+
+int HessianBuildTuner::Bucket(unsigned long num_edges, unsigned long dim) {
+    int edge_bucket = 0, dim_bucket = 0;
+    while (num_edges >>= 1) ++edge_bucket;
+    while (dim >>= 1) ++dim_bucket;
+    return edge_bucket * 64 + dim_bucket;
+}
+
+int HessianBuildTuner::Select(unsigned long num_edges, unsigned long dim) {
+    int bucket = Bucket(num_edges, dim);
+    std::map<int, Timing> &timings = timings_[bucket];
+    int call = calls_[bucket]++;
+
+    // 预热：还有没测够的候选时先测它
+    for (int strategy : candidates_) {
+        if (timings[strategy].count < kWarmupRuns)
+            return strategy;
+    }
+
+    // 定期轮流重新测量一个候选
+    if (call % kExploreInterval == 0) {
+        return candidates_[(call / kExploreInterval) % candidates_.size()];
+    }
+
+    int best = candidates_.front();
+    for (int strategy : candidates_) {
+        if (timings[strategy].mean_ms < timings[best].mean_ms)
+            best = strategy;
+    }
+    return best;
+}
+
+void HessianBuildTuner::Record(unsigned long num_edges, unsigned long dim, int strategy, double time_ms) {
+    Timing &timing = timings_[Bucket(num_edges, dim)][strategy];
+    // 第一次运行包含内存分配等开销，由第二次的结果直接覆盖
+    if (timing.count <= 1) {
+        timing.mean_ms = time_ms;
+    } else {
+        timing.mean_ms = 0.8 * timing.mean_ms + 0.2 * time_ms;
+    }
+    ++timing.count;
+}
+
+}
+}
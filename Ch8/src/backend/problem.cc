@@ -2,7 +2,11 @@
 #include <iomanip>
 #include <sys/stat.h>
 #include <iterator>
+#include <algorithm>
+#include <typeinfo>
 #include "backend/problem.h"
+#include "backend/edge_reprojection.h"
+#include "backend/edge_imu.h"
 #include "utility/tic_toc.h"
 
 #define USE_OPENMP
@@ -20,6 +24,8 @@ using namespace std;
      initializer(omp_priv=VecX::Zero(omp_orig.size()))
 #pragma omp declare reduction (+: MatXX: omp_out=omp_out+omp_in)\
      initializer(omp_priv=MatXX::Zero(omp_orig.rows(), omp_orig.cols()))
+#pragma omp declare reduction (+: myslam::backend::BlockSparseHessian: omp_out+=omp_in)\
+     initializer(omp_priv=omp_orig.ZeroLike())
 //#endi
 
 // define the format you want, you only need one instance of this...
@@ -32,6 +38,51 @@ void writeToCSVfile(std::string name, Eigen::MatrixXd matrix) {
 
 namespace myslam {
 namespace backend {
+
+namespace {
+
+/**
+ * 对称半正定矩阵的 LDLT 分解 A = P^T L D L^T P，D 中不大于 eps 的元素视为 0
+ * marg 时代替特征值分解求伪逆和先验的平方根
+ */
+class PriorFactor {
+public:
+    PriorFactor(const MatXX &A, double eps) : ldlt_(A) {
+        VecX d = ldlt_.vectorD();
+        d_ = (d.array() > eps).select(d.array(), 0);
+        d_inv_ = (d.array() > eps).select(d.array().inverse(), 0);
+
+        // L^{-1} P
+        int n = A.rows();
+        Linv_P_ = ldlt_.transpositionsP() * MatXX::Identity(n, n);
+        ldlt_.matrixL().solveInPlace(Linv_P_);
+    }
+
+    /// A^+ = P^T L^{-T} D^+ L^{-1} P
+    MatXX PseudoInverse() const {
+        return Linv_P_.transpose() * d_inv_.asDiagonal() * Linv_P_;
+    }
+
+    /// J^{-T} = sqrt(D^+) L^{-1} P，其中 J = sqrt(D) L^T P
+    MatXX SqrtInverse() const {
+        return d_inv_.cwiseSqrt().asDiagonal() * Linv_P_;
+    }
+
+    /// J^T J，去掉了 A 中非正的部分
+    MatXX Reconstruct() const {
+        MatXX PtL = ldlt_.transpositionsP().transpose() * MatXX(ldlt_.matrixL());
+        return PtL * d_.asDiagonal() * PtL.transpose();
+    }
+
+private:
+    Eigen::LDLT<MatXX> ldlt_;
+    VecX d_;
+    VecX d_inv_;
+    MatXX Linv_P_;
+};
+
+}
+
 void Problem::LogoutVectorSize() {
     // LOG(INFO) <<
     //           "1 problem::LogoutVectorSize verticies_:" << verticies_.size() <<
@@ -50,11 +101,14 @@ Problem::~Problem() {
 }
 
 bool Problem::AddVertex(std::shared_ptr<Vertex> vertex) {
-    if (verticies_.find(vertex->Id()) != verticies_.end()) {
+    if (vertex_slot_.find(vertex->Id()) != vertex_slot_.end()) {
         // LOG(WARNING) << "Vertex " << vertex->Id() << " has been added before";
         return false;
     } else {
-        verticies_.insert(pair<unsigned long, shared_ptr<Vertex>>(vertex->Id(), vertex));
+        vertex_slot_[vertex->Id()] = vertex_arena_.size();
+        vertex_arena_.push_back(vertex);
+        ++num_vertices_;
+        topology_changed_ = true;
     }
 
     if (problemType_ == ProblemType::SLAM_PROBLEM) {
@@ -112,36 +166,121 @@ bool Problem::IsLandmarkVertex(std::shared_ptr<myslam::backend::Vertex> v) {
 }
 
 bool Problem::AddEdge(shared_ptr<Edge> edge) {
-    if (edges_.find(edge->Id()) == edges_.end()) {
-        edges_.insert(pair<ulong, std::shared_ptr<Edge>>(edge->Id(), edge));
+    if (edge_slot_.find(edge->Id()) == edge_slot_.end()) {
+        // 邻接表在下次 CompactTopology 时重建，在此之前 GetConnectedEdges 逐条检查新增的边
+        edge_slot_[edge->Id()] = edge_arena_.size();
+        edge_arena_.push_back(edge);
+        ++num_edges_;
+        topology_changed_ = true;
     } else {
         // LOG(WARNING) << "Edge " << edge->Id() << " has been added before!";
         return false;
     }
-
-    for (auto &vertex: edge->Verticies()) {
-        vertexToEdge_.insert(pair<ulong, shared_ptr<Edge>>(vertex->Id(), edge));
-    }
     return true;
 }
 
 vector<shared_ptr<Edge>> Problem::GetConnectedEdges(std::shared_ptr<Vertex> vertex) {
     vector<shared_ptr<Edge>> edges;
-    auto range = vertexToEdge_.equal_range(vertex->Id());
-    for (auto iter = range.first; iter != range.second; ++iter) {
-
-        // 并且这个edge还需要存在，而不是已经被remove了
-        if (edges_.find(iter->second->Id()) == edges_.end())
-            continue;
+    auto slot = vertex_slot_.find(vertex->Id());
+    if (slot == vertex_slot_.end())
+        return edges;
+
+    // 建表时已有的边，已被 remove 的位置为空
+    int v = slot->second;
+    if (v + 1 < int(adjacency_offsets_.size())) {
+        for (int k = adjacency_offsets_[v]; k < adjacency_offsets_[v + 1]; ++k) {
+            const shared_ptr<Edge> &edge = edge_arena_[adjacency_edges_[k]];
+            if (edge)
+                edges.push_back(edge);
+        }
+    }
 
-        edges.emplace_back(iter->second);
+    // 建表之后新增的边
+    for (size_t k = size_t(adjacency_num_edges_); k < edge_arena_.size(); ++k) {
+        const shared_ptr<Edge> &edge = edge_arena_[k];
+        if (!edge) continue;
+        for (const auto &v_i : edge->Verticies()) {
+            if (v_i->Id() == vertex->Id()) {
+                edges.push_back(edge);
+                break;
+            }
+        }
     }
     return edges;
 }
 
+void Problem::CompactTopology() {
+    if (!topology_changed_)
+        return;
+
+    // 顶点按 id 排序，与 ordering 的分配顺序一致
+    vertex_arena_.erase(std::remove(vertex_arena_.begin(), vertex_arena_.end(), nullptr), vertex_arena_.end());
+    std::sort(vertex_arena_.begin(), vertex_arena_.end(),
+              [](const shared_ptr<Vertex> &a, const shared_ptr<Vertex> &b) { return a->Id() < b->Id(); });
+    vertex_slot_.clear();
+    for (size_t v = 0; v < vertex_arena_.size(); ++v) {
+        vertex_slot_[vertex_arena_[v]->Id()] = v;
+    }
+
+    // 同类型的边放在一起（组内按 id 排序），线性化时每一段使用同一个静态分发的实现
+    std::vector<std::pair<std::pair<int, ulong>, shared_ptr<Edge>>> typed_edges;
+    typed_edges.reserve(num_edges_);
+    for (auto &edge: edge_arena_) {
+        if (!edge) continue;
+        const std::type_info &type = typeid(*edge);
+        EdgeKernel kernel = type == typeid(EdgeReprojection) ? EdgeKernel::REPROJECTION :
+                            type == typeid(EdgeImu) ? EdgeKernel::IMU : EdgeKernel::GENERIC;
+        typed_edges.push_back(std::make_pair(std::make_pair(int(kernel), edge->Id()), edge));
+    }
+    std::sort(typed_edges.begin(), typed_edges.end(),
+              [](const std::pair<std::pair<int, ulong>, shared_ptr<Edge>> &a,
+                 const std::pair<std::pair<int, ulong>, shared_ptr<Edge>> &b) { return a.first < b.first; });
+
+    edge_arena_.clear();
+    edge_slot_.clear();
+    edge_groups_.clear();
+    for (size_t k = 0; k < typed_edges.size(); ++k) {
+        edge_slot_[typed_edges[k].second->Id()] = k;
+        edge_arena_.push_back(typed_edges[k].second);
+        EdgeKernel kernel = EdgeKernel(typed_edges[k].first.first);
+        if (edge_groups_.empty() || edge_groups_.back().kernel != kernel) {
+            EdgeGroup group;
+            group.kernel = kernel;
+            group.begin = k;
+            edge_groups_.push_back(group);
+        }
+        edge_groups_.back().end = k + 1;
+    }
+
+    // CSR：先统计每个顶点的边数，再按前缀和填入
+    adjacency_offsets_.assign(vertex_arena_.size() + 1, 0);
+    for (const auto &edge: edge_arena_) {
+        for (const auto &vertex: edge->Verticies()) {
+            auto slot = vertex_slot_.find(vertex->Id());
+            if (slot != vertex_slot_.end())
+                ++adjacency_offsets_[slot->second + 1];
+        }
+    }
+    for (size_t v = 0; v < vertex_arena_.size(); ++v) {
+        adjacency_offsets_[v + 1] += adjacency_offsets_[v];
+    }
+    adjacency_edges_.resize(adjacency_offsets_.back());
+    std::vector<int> fill(adjacency_offsets_.begin(), adjacency_offsets_.end() - 1);
+    for (size_t k = 0; k < edge_arena_.size(); ++k) {
+        for (const auto &vertex: edge_arena_[k]->Verticies()) {
+            auto slot = vertex_slot_.find(vertex->Id());
+            if (slot != vertex_slot_.end())
+                adjacency_edges_[fill[slot->second]++] = k;
+        }
+    }
+    adjacency_num_edges_ = edge_arena_.size();
+    topology_changed_ = false;
+}
+
 bool Problem::RemoveVertex(std::shared_ptr<Vertex> vertex) {
     //check if the vertex is in map_verticies_
-    if (verticies_.find(vertex->Id()) == verticies_.end()) {
+    auto slot = vertex_slot_.find(vertex->Id());
+    if (slot == vertex_slot_.end()) {
         // LOG(WARNING) << "The vertex " << vertex->Id() << " is not in the problem!" << endl;
         return false;
     }
@@ -158,31 +297,38 @@ bool Problem::RemoveVertex(std::shared_ptr<Vertex> vertex) {
         idx_landmark_vertices_.erase(vertex->Id());
 
     vertex->SetOrderingId(-1);      // used to debug
-    verticies_.erase(vertex->Id());
-    vertexToEdge_.erase(vertex->Id());
+    vertex_arena_[slot->second].reset();
+    vertex_slot_.erase(slot);
+    --num_vertices_;
+    topology_changed_ = true;
 
     return true;
 }
 
 bool Problem::RemoveEdge(std::shared_ptr<Edge> edge) {
     //check if the edge is in map_edges_
-    if (edges_.find(edge->Id()) == edges_.end()) {
+    auto slot = edge_slot_.find(edge->Id());
+    if (slot == edge_slot_.end()) {
         // LOG(WARNING) << "The edge " << edge->Id() << " is not in the problem!" << endl;
         return false;
     }
 
-    edges_.erase(edge->Id());
+    // problem 会在多帧之间复用，空出的位置在下次 CompactTopology 时回收
+    edge_arena_[slot->second].reset();
+    edge_slot_.erase(slot);
+    --num_edges_;
+    topology_changed_ = true;
     return true;
 }
 
-bool Problem::Solve(int type, int iterations){
+bool Problem::Solve(int type, int iterations, double max_time_ms){
     switch (type)
     {
     case 0:
-        return(SolveLM(iterations));
+        return(SolveLM(iterations, max_time_ms));
         break;
     case 1:
-        return(SolveDogLeg(iterations));
+        return(SolveDogLeg(iterations, max_time_ms));
         break;
     default:
         cerr << "Wrong option for solver type! Solver type should only be 0 or 1 !\n";
@@ -191,8 +337,8 @@ bool Problem::Solve(int type, int iterations){
     }
 }
 
-bool Problem::SolveDogLeg(int itertaions){
-    if(edges_.size()==0 || verticies_.size() ==0){
+bool Problem::SolveDogLeg(int itertaions, double max_time_ms){
+    if(num_edges_ == 0 || num_vertices_ == 0){
         cerr << "\n Cannot solve problem without edges or vertices !\n";
         return false;
     }
@@ -200,28 +346,56 @@ bool Problem::SolveDogLeg(int itertaions){
     TicToc t_solver;
     // 对变量进行排序（位姿在前，路标在后）
     SetOrdering();
+    BuildHessianStructure();
     // 构建Hessian矩阵
     MakeHessian();
     // 初始化chi和radius
     ComputeRadiusInitDogLeg();
+    uint64_t solve_id = solver_stats_ ? solver_stats_->BeginSolve() : 0;
+    double linear_cost = 0., residual_cost = 0.;
+    // 预测的单次尝试耗时，还没有尝试时用构建 Hessian 的耗时加上一次求解的平均线性求解和残差耗时
+    double step_ms = t_hessian_cost_ + step_solve_ms_;
+    int attempts = 0;
+    bool timeout = false;
     // 迭代优化
     bool stop = false; // 是否停止迭代
     int iter = 0; // 当前迭代次数
     double last_chi = 0; // 上一次的误差，用于判断是否停止
     // 一直迭代到大于最大迭代次数或满足终止条件
     while((iter < itertaions) && !stop){
-        // 输出当前结果
-        std::cout << "iter: " << iter << " , chi= " << currentChi_ << " , currentRadius= " << currentRadius_ << std::endl;
         bool oneStepSuccess = false; // 当前迭代是否成功
         int false_cnt = 0; // 迭代失败次数
         // 多次尝试直到成功或大于最大尝试次数
         while(!oneStepSuccess && false_cnt < 10){
+            // 预计超出时间预算，停在上一次被接受的状态（失败的尝试已经回滚）
+            if (max_time_ms > 0 && t_solver.toc() + step_ms > max_time_ms) {
+                timeout = true;
+                break;
+            }
+            TicToc t_step;
+            SolverRecord record;
+            record.solve_id = solve_id;
+            record.solver = 1;
+            record.iteration = iter;
+            record.lambda = currentRadius_;
+            double hessian_cost = t_hessian_cost_;
+            double schur_cost = t_schur_cost_;
+
             // 求解delta_x
-            SolveDogLegStep();
+            TicToc t_linear;
+            bool has_step = SolveDogLegStep();
+            record.linear_ms = t_linear.toc();
+            if (!has_step) {
+                // 梯度为零，当前状态已经收敛
+                stop = true;
+                break;
+            }
             // 更新状态
+            TicToc t_residual;
             UpdateStates();
             // 判断步长是否合适
             oneStepSuccess = IsGoodStepInDogLeg();
+            record.residual_ms = t_residual.toc();
             // 迭代成功则保持状态更新，否则回滚
             if(oneStepSuccess){
                 MakeHessian(); // 在新的线性化点计算Hessian
@@ -231,11 +405,22 @@ bool Problem::SolveDogLeg(int itertaions){
                 false_cnt++;
                 RollbackStates();
             }
+
+            record.accepted = oneStepSuccess;
+            record.chi2 = currentChi_;
+            record.hessian_ms = t_hessian_cost_ - hessian_cost;
+            record.schur_ms = t_schur_cost_ - schur_cost;
+            RecordStatistics(record);
+            linear_cost += record.linear_ms;
+            residual_cost += record.residual_ms;
+            attempts++;
+            step_ms = std::max(step_ms, t_step.toc());
         }
+        if (timeout)
+            break;
         iter++; // 总迭代次数+1
 
         if(last_chi - currentChi_ < 1e-5 || b_.norm() < 1e-5){
-            cout << "DogLeg: currnet chi small, found result.\n";
             stop = true;
         }
 
@@ -243,18 +428,32 @@ bool Problem::SolveDogLeg(int itertaions){
     }
 
     solve_cost_ = t_solver.toc();
-    saveCost({solve_cost_, t_hessian_cost_});
-    // ofs_time_ << solve_cost << endl;
-    std::cout << "problem solve cost: " << solve_cost_ << " ms" << std::endl;
-    std::cout << "   makeHessian cost: " << t_hessian_cost_ << " ms" << std::endl;
+    solve_status_ = timeout ? SolveStatus::TIME_BUDGET : (stop ? SolveStatus::CONVERGED : SolveStatus::MAX_ITERATIONS);
+    if (attempts > 0)
+        step_solve_ms_ = (linear_cost + residual_cost) / attempts;
+    SolverRecord record;
+    record.type = SolverRecord::SOLVE;
+    record.solve_id = solve_id;
+    record.solver = 1;
+    record.iteration = iter;
+    record.accepted = stop;
+    record.chi2 = currentChi_;
+    record.lambda = currentRadius_;
+    record.hessian_ms = t_hessian_cost_;
+    record.schur_ms = t_schur_cost_;
+    record.linear_ms = linear_cost;
+    record.residual_ms = residual_cost;
+    record.total_ms = solve_cost_;
+    RecordStatistics(record);
     t_hessian_cost_ = 0.;
+    t_schur_cost_ = 0.;
     return true;
 }
 
-bool Problem::SolveLM(int iterations) {
+bool Problem::SolveLM(int iterations, double max_time_ms) {
 
 
-    if (edges_.size() == 0 || verticies_.size() == 0) {
+    if (num_edges_ == 0 || num_vertices_ == 0) {
         std::cerr << "\nCannot solve problem without edges or verticies" << std::endl;
         return false;
     }
@@ -262,25 +461,43 @@ bool Problem::SolveLM(int iterations) {
     TicToc t_solve;
     // 统计优化变量的维数，为构建 H 矩阵做准备
     SetOrdering();
+    BuildHessianStructure();
     // 遍历edge, 构建 H 矩阵
     MakeHessian();
     // LM 初始化
     ComputeLambdaInitLM();
+    uint64_t solve_id = solver_stats_ ? solver_stats_->BeginSolve() : 0;
+    double linear_cost = 0., residual_cost = 0.;
+    // 预测的单次尝试耗时，还没有尝试时用构建 Hessian 的耗时加上一次求解的平均线性求解和残差耗时
+    double step_ms = t_hessian_cost_ + step_solve_ms_;
+    int attempts = 0;
+    bool timeout = false;
     // LM 算法迭代求解
     bool stop = false;
     int iter = 0;
     double last_chi_ = 1e20;
     while (!stop && (iter < iterations)) {
-        std::cout << "iter: " << iter << " , chi= " << currentChi_ << " , Lambda= " << currentLambda_ << std::endl;
         bool oneStepSuccess = false;
         int false_cnt = 0;
         while (!oneStepSuccess && false_cnt < 10)  // 不断尝试 Lambda, 直到成功迭代一步
         {
+            // 预计超出时间预算，停在上一次被接受的状态（失败的尝试已经回滚）
+            if (max_time_ms > 0 && t_solve.toc() + step_ms > max_time_ms) {
+                timeout = true;
+                break;
+            }
+            TicToc t_step;
+            SolverRecord record;
+            record.solve_id = solve_id;
+            record.solver = 0;
+            record.iteration = iter;
+            record.lambda = currentLambda_;
+            double hessian_cost = t_hessian_cost_;
+            double schur_cost = t_schur_cost_;
+
             // setLambda 该函数功能被移动到了SolveLinearSystem中
 //            AddLambdatoHessianLM();
             // 第四步，解线性方程
-            SolveLinearSystem();
-            //
 //            RemoveLambdaHessianLM();
 
             // 优化退出条件1： delta_x_ 很小则退出
@@ -292,10 +509,21 @@ bool Problem::SolveLM(int iterations) {
 //                break;
 //            }
 
-            // 更新状态量
-            UpdateStates();
-            // 判断当前步是否可行以及 LM 的 lambda 怎么更新, chi2 也计算一下
-            oneStepSuccess = IsGoodStepInLM();
+            if (speculative_lm_candidates_ > 1 && problemType_ == ProblemType::SLAM_PROBLEM) {
+                // 同时尝试多个 lambda，取 chi2 最小的一个
+                oneStepSuccess = SpeculativeStepLM(record);
+            } else {
+                TicToc t_linear;
+                SolveLinearSystem();
+                record.linear_ms = t_linear.toc();
+
+                // 更新状态量
+                TicToc t_residual;
+                UpdateStates();
+                // 判断当前步是否可行以及 LM 的 lambda 怎么更新, chi2 也计算一下
+                oneStepSuccess = IsGoodStepInLM();
+                record.residual_ms = t_residual.toc();
+            }
             // 后续处理，
             if (oneStepSuccess) {
 //                std::cout << " get one step success\n";
@@ -314,7 +542,19 @@ bool Problem::SolveLM(int iterations) {
                 false_cnt ++;
                 RollbackStates();   // 误差没下降，回滚
             }
+
+            record.accepted = oneStepSuccess;
+            record.chi2 = currentChi_;
+            record.hessian_ms = t_hessian_cost_ - hessian_cost;
+            record.schur_ms = t_schur_cost_ - schur_cost;
+            RecordStatistics(record);
+            linear_cost += record.linear_ms;
+            residual_cost += record.residual_ms;
+            attempts++;
+            step_ms = std::max(step_ms, t_step.toc());
         }
+        if (timeout)
+            break;
         iter++;
 
         // 优化退出条件3： currentChi_ 跟第一次的 chi2 相比，下降了 1e6 倍则退出
@@ -323,38 +563,45 @@ bool Problem::SolveLM(int iterations) {
 //        if (sqrt(currentChi_) < 1e-15)
         if(last_chi_ - currentChi_ < 1e-5)
         {
-            std::cout << "sqrt(currentChi_) <= stopThresholdLM_" << std::endl;
             stop = true;
         }
         last_chi_ = currentChi_;
     }
 
     solve_cost_ = t_solve.toc();
-    saveCost({solve_cost_, t_hessian_cost_});
+    solve_status_ = timeout ? SolveStatus::TIME_BUDGET : (stop ? SolveStatus::CONVERGED : SolveStatus::MAX_ITERATIONS);
+    if (attempts > 0)
+        step_solve_ms_ = (linear_cost + residual_cost) / attempts;
+    SolverRecord record;
+    record.type = SolverRecord::SOLVE;
+    record.solve_id = solve_id;
+    record.solver = 0;
+    record.iteration = iter;
+    record.accepted = stop;
+    record.chi2 = currentChi_;
+    record.lambda = currentLambda_;
+    record.hessian_ms = t_hessian_cost_;
+    record.schur_ms = t_schur_cost_;
+    record.linear_ms = linear_cost;
+    record.residual_ms = residual_cost;
+    record.total_ms = solve_cost_;
+    RecordStatistics(record);
     // ofs_time_ << solve_cost << endl;
     // std::cout << "problem solve cost: " << solve_cost_ << " ms" << std::endl;
     // std::cout << "   makeHessian cost: " << t_hessian_cost_ << " ms" << std::endl;
     t_hessian_cost_ = 0.;
+    t_schur_cost_ = 0.;
     return true;
 }
 
-void Problem::saveCost(initializer_list<double> times){
-
-    // int n = times.size();
-    
-    FILE * fp;
-    fp = fopen("./solver_cost.txt", "a+");
-    
-    for (auto ptr = times.begin(); ptr != times.end(); ++ptr){
-        if(ptr != (times.end() - 1)){
-            fprintf(fp, "%lf ", *ptr);
-        }
-        else{
-            fprintf(fp, "%lf\n", *ptr);
-        }
-    }
-
-    fclose(fp);
+void Problem::RecordStatistics(SolverRecord record){
+    if (!solver_stats_)
+        return;
+    record.pose_dim = ordering_poses_;
+    record.landmark_dim = ordering_landmarks_;
+    record.num_edges = num_edges_;
+    record.num_vertices = num_vertices_;
+    solver_stats_->Push(record);
 }
 
 bool Problem::SolveGenericProblem(int iterations) {
@@ -363,18 +610,22 @@ bool Problem::SolveGenericProblem(int iterations) {
 
 void Problem::SetOrdering() {
 
+    CompactTopology();
+
     // 每次重新计数
     ordering_poses_ = 0;
     ordering_generic_ = 0;
     ordering_landmarks_ = 0;
+    idx_pose_vertices_.clear();
+    idx_landmark_vertices_.clear();
 
-    // Note:: verticies_ 是 map 类型的, 顺序是按照 id 号排序的
-    for (auto vertex: verticies_) {
-        ordering_generic_ += vertex.second->LocalDimension();  // 所有的优化变量总维数
+    // Note:: CompactTopology 之后 vertex_arena_ 是按照 id 号排序的
+    for (auto &vertex: vertex_arena_) {
+        ordering_generic_ += vertex->LocalDimension();  // 所有的优化变量总维数
 
         if (problemType_ == ProblemType::SLAM_PROBLEM)    // 如果是 slam 问题，还要分别统计 pose 和 landmark 的维数，后面会对他们进行排序
         {
-            AddOrderingSLAM(vertex.second);
+            AddOrderingSLAM(vertex);
         }
 
     }
@@ -408,236 +659,543 @@ bool Problem::CheckOrdering() {
     return true;
 }
 
+void Problem::BuildHessianStructure() {
+    // 本次求解中边不再变化，SetOrdering 中已经压缩过 edge_arena_，多线程直接按下标访问
+    if (problemType_ != ProblemType::SLAM_PROBLEM) {
+        // 通用问题没有 landmark，整个 H 稠密存储
+        Hessian_.Resize(ordering_generic_, std::vector<int>());
+    } else {
+        // idx_landmark_vertices_ 按 ordering 排序
+        std::vector<int> landmark_dims;
+        landmark_dims.reserve(idx_landmark_vertices_.size());
+        for (auto landmarkVertex : idx_landmark_vertices_) {
+            landmark_dims.push_back(landmarkVertex.second->LocalDimension());
+        }
+        Hessian_.Resize(ordering_poses_, landmark_dims);
+    }
+
+    // 每个非固定顶点对应 H 的一个块行，与 vertex_arena_ 下标对应，固定顶点为 -1
+    std::vector<int> vertex_row(vertex_arena_.size(), -1);
+    vertex_edges_.clear();
+    for (size_t v = 0; v < vertex_arena_.size(); ++v) {
+        if (vertex_arena_[v]->IsFixed()) continue;
+        vertex_row[v] = vertex_edges_.size();
+        VertexEdges vertex_edges;
+        vertex_edges.index = vertex_arena_[v]->OrderingId();
+        vertex_edges.dim = vertex_arena_[v]->LocalDimension();
+        vertex_edges.relinearize_threshold = -1.;
+        if (lazy_relinearization_) {
+            auto threshold = relinearize_thresholds_.find(vertex_arena_[v]->TypeInfo());
+            if (threshold != relinearize_thresholds_.end())
+                vertex_edges.relinearize_threshold = threshold->second;
+        }
+        vertex_edges_.push_back(vertex_edges);
+    }
+
+    // 按 CSR 邻接表依次登记每个顶点块行上的边
+    for (size_t v = 0; v < vertex_arena_.size(); ++v) {
+        if (vertex_row[v] < 0) continue;
+        VertexEdges &vertex_edges = vertex_edges_[vertex_row[v]];
+        vertex_edges.edges.reserve(adjacency_offsets_[v + 1] - adjacency_offsets_[v]);
+        for (int a = adjacency_offsets_[v]; a < adjacency_offsets_[v + 1]; ++a) {
+            int k = adjacency_edges_[a];
+            const auto &verticies = edge_arena_[k]->Verticies();
+            for (size_t i = 0; i < verticies.size(); ++i) {
+                if (verticies[i] == vertex_arena_[v]) {
+                    vertex_edges.edges.push_back(std::make_pair(k, int(i)));
+                    break;
+                }
+            }
+        }
+    }
+
+    edge_linearizations_.resize(edge_arena_.size());
+    for (size_t k = 0; k < edge_arena_.size(); ++k) {
+        const auto &verticies = edge_arena_[k]->Verticies();
+        EdgeLinearization &lin = edge_linearizations_[k];
+        lin.index.resize(verticies.size());
+        lin.dim.resize(verticies.size());
+        lin.hessians.resize(verticies.size() * verticies.size());
+        lin.gradients.resize(verticies.size());
+        lin.jacobian.resize(0, 0);  // 压缩后同一下标可能是另一种边
+
+        for (size_t i = 0; i < verticies.size(); ++i) {
+            auto v_i = verticies[i];
+            lin.dim[i] = v_i->LocalDimension();
+            lin.index[i] = v_i->IsFixed() ? -1 : v_i->OrderingId();
+            if (v_i->IsFixed()) continue;
+
+            // 符号分析：登记所有 pose-landmark 非零块，之后多线程累加时结构不再变化
+            if (problemType_ != ProblemType::SLAM_PROBLEM || !IsLandmarkVertex(v_i)) continue;
+            for (auto v_j : verticies) {
+                if (v_j->IsFixed() || !IsPoseVertex(v_j)) continue;
+                Hessian_.AddPoseLandmarkLink(v_j->OrderingId(), v_j->LocalDimension(), v_i->OrderingId());
+            }
+        }
+    }
+
+    // 线性化点随 ordering 一起失效，本次求解的第一次构建总是完整的
+    lazy_ready_ = false;
+    relin_step_sum_.setZero(ordering_generic_);
+}
+
 void Problem::MakeHessian(){
-    int acc_opt = 1;
-    switch (acc_opt)
+    schur_valid_ = false;
+    HessianBuildStrategy strategy = hessian_strategy_;
+    bool tuned = false;
+    if (lazy_relinearization_ || mixed_precision_) {
+        // 惰性重线性化和混合精度只有 LOCK_FREE 实现
+        strategy = HessianBuildStrategy::LOCK_FREE;
+    } else if (strategy == HessianBuildStrategy::AUTO && deterministic_) {
+        // 按耗时选择会使不同运行的累加顺序不同
+        strategy = HessianBuildStrategy::LOCK_FREE;
+    } else if (strategy == HessianBuildStrategy::AUTO) {
+        strategy = HessianBuildStrategy(
+            GetHessianBuildTuner()->Select(edge_arena_.size(), ordering_generic_));
+        tuned = true;
+    }
+
+    // 只有 LOCK_FREE 保存了各边的线性化结果，其他方式构建后不能增量更新
+    bool lazy = lazy_relinearization_ && lazy_ready_;
+    lazy_ready_ = false;
+    mixed_hessian_ = false;
+
+    TicToc t_build;
+    switch (strategy)
     {
-    case 0:
+    case HessianBuildStrategy::SINGLE_THREAD:
         MakeHessianSingle();
         break;
-    case 1:
+    case HessianBuildStrategy::MULTI_THREAD:
         MakeHessianMulti();
         break;
-    case 2:
+    case HessianBuildStrategy::OPENMP:
         MakeHessianOpenMP();
         break;
+    case HessianBuildStrategy::LOCK_FREE:
+    default:
+        // 在线性化之前确定，EvaluateReprojectionRange 与求解后的细化使用同一个判断
+        mixed_hessian_ = mixed_precision_ && problemType_ == ProblemType::SLAM_PROBLEM;
+        if (lazy)
+            MakeHessianLazy();
+        else
+            MakeHessianLockFree();
+        break;
     }
+
+    if (tuned) {
+        GetHessianBuildTuner()->Record(edge_arena_.size(), ordering_generic_, int(strategy), t_build.toc());
+    }
+}
+
+std::shared_ptr<HessianBuildTuner> Problem::GetHessianBuildTuner() {
+    if (!hessian_tuner_)
+        hessian_tuner_ = CreateHessianBuildTuner();
+    return hessian_tuner_;
+}
+
+std::shared_ptr<HessianBuildTuner> Problem::CreateHessianBuildTuner() {
+    return std::make_shared<HessianBuildTuner>(std::vector<int>{
+        int(HessianBuildStrategy::SINGLE_THREAD), int(HessianBuildStrategy::MULTI_THREAD),
+        int(HessianBuildStrategy::OPENMP), int(HessianBuildStrategy::LOCK_FREE)});
 }
 
 void Problem::MakeHessianOpenMP(){
+    if (deterministic_) {
+        MakeHessianDeterministic(true);
+        return;
+    }
     TicToc t_h;
     // 直接构造大的 H 矩阵
     ulong size = ordering_generic_;
-    MatXX H(MatXX::Zero(size, size));
+    BlockSparseHessian H = Hessian_.ZeroLike();
     VecX b(VecX::Zero(size));
 
     // TODO:: accelate, accelate, accelate
-    // 由于OpenMP不支持迭代器，需要存储所有edge的id用于后续循环调用
-    for (auto& edge: edges_ ){
-        edges_idx_.push_back( edge.first );
-    }
+    // 由于OpenMP不支持迭代器，按 edge_arena_ 的下标循环调用
     
-    // 设置openmp所使用的线程数
-    omp_set_num_threads(4);
+    // openmp所使用的线程数与线程池一致，只对本次循环生效
+    int thd_num = GetThreadPool()->NumThreads();
+    ReserveEdgeScratch(thd_num);
     // // 设置Eigen所使用线程数，可选，默认为与OpenMP一致
     // Eigen::setNbThreads(4);
     // 指定OpenMP对for循环进行加速，由于Eigen对象不是标准对象，需要手动编写reduction
-    // auto iter = edges_.begin();
-    #pragma omp parallel for reduction(+: H) reduction(+: b) 
-    for(unsigned int idx=0; idx < edges_.size(); idx++ ) {
-        auto edge = edges_[edges_idx_[idx]];
-
-        edge->ComputeResidual();
-        edge->ComputeJacobians();
-
-        // TODO:: robust cost
-        auto jacobians = edge->Jacobians();
-        auto verticies = edge->Verticies();
-        assert(jacobians.size() == verticies.size());
-
-        for (size_t i = 0; i < verticies.size(); ++i) {
-            auto v_i = verticies[i];
-            if (v_i->IsFixed()) continue;    // Hessian 里不需要添加它的信息，也就是它的雅克比为 0
-
-            auto jacobian_i = jacobians[i];
-            ulong index_i = v_i->OrderingId();
-            ulong dim_i = v_i->LocalDimension();
-
-            // 鲁棒核函数会修改残差和信息矩阵，如果没有设置 robust cost function，就会返回原来的
-            double drho;
-            MatXX robustInfo(edge->Information().rows(),edge->Information().cols());
-            edge->RobustInfo(drho,robustInfo);
-
-            MatXX JtW = jacobian_i.transpose() * robustInfo;
-            for (size_t j = i; j < verticies.size(); ++j) {
-                auto v_j = verticies[j];
-
-                if (v_j->IsFixed()) continue;
-
-                auto jacobian_j = jacobians[j];
-                ulong index_j = v_j->OrderingId();
-                ulong dim_j = v_j->LocalDimension();
-
-                assert(v_j->OrderingId() != -1);
-                MatXX hessian = JtW * jacobian_j;
-
-                // 所有的信息矩阵叠加起来
-                // 由于多线程对 H 的访问时不同块, 不会冲突, 可以不加 访问控制
-                H.block(index_i, index_j, dim_i, dim_j).noalias() += hessian;
-                if (j != i) {
-                    // 对称的下三角
-                    H.block(index_j, index_i, dim_j, dim_i).noalias() += hessian.transpose();
-                }
-            }
-            b.segment(index_i, dim_i).noalias() -= drho * jacobian_i.transpose()* edge->Information() * edge->Residual();
-        }
+    // 每个线程的 H 只保存非零块，合并的代价与边数成正比
+    #pragma omp parallel for num_threads(thd_num) reduction(+: H) reduction(+: b) 
+    for(unsigned int idx=0; idx < edge_arena_.size(); idx++ ) {
+        AddEdgeToHessian(edge_arena_[idx], edge_scratch_[omp_get_thread_num()], H, b);
     }
-    Hessian_ = H;
+    std::swap(Hessian_, H);
     b_ = b;
     t_hessian_cost_ += t_h.toc();
 
-    if(H_prior_.rows() > 0)
-    {
-        MatXX H_prior_tmp = H_prior_;
-        VecX b_prior_tmp = b_prior_;
-
-        /// 遍历所有 POSE 顶点，然后设置相应的先验维度为 0 .  fix 外参数, SET PRIOR TO ZERO
-        /// landmark 没有先验
-        for (auto vertex: verticies_) {
-           if (IsPoseVertex(vertex.second) && vertex.second->IsFixed() ) {
-                int idx = vertex.second->OrderingId();
-                int dim = vertex.second->LocalDimension();
-                H_prior_tmp.block(idx,0, dim, H_prior_tmp.cols()).setZero();
-                H_prior_tmp.block(0,idx, H_prior_tmp.rows(), dim).setZero();
-                b_prior_tmp.segment(idx,dim).setZero();
-//                std::cout << " fixed prior, set the Hprior and bprior part to zero, idx: "<<idx <<" dim: "<<dim<<std::endl;
-            }
-        }
-        Hessian_.topLeftCorner(ordering_poses_, ordering_poses_) += H_prior_tmp;
-        b_.head(ordering_poses_) += b_prior_tmp;
-    }
+    AddPriorToHessian();
 
     delta_x_ = VecX::Zero(size);  // initial delta_x = 0_n;
 
 }
 
 void Problem::MakeHessianMulti(){
+    if (deterministic_) {
+        MakeHessianDeterministic(false);
+        return;
+    }
     TicToc t_h;
     // 构造H矩阵和B矢量
     ulong size = ordering_generic_;
-    multi_H_.setZero(size, size); // 变量清零
+    multi_H_ = Hessian_.ZeroLike(); // 保留稀疏结构，数值清零
     multi_b_.setZero(size); // 变量清零
+    ReserveEdgeScratch(GetThreadPool()->NumThreads());
 
-    // 获取所有边id
-    for (auto& edge: edges_ ){
-        edges_idx_.push_back( edge.first );
-    }
-
-    int thd_num = 4; // 线程数目
-    vector<thread> all_thds; // 线程容器
-    // 循环创建线程
-    for (int i = 0; i < thd_num; i++){
-        thread t = thread(std::mem_fn(&Problem::thdCalcHessian), this, i, thd_num);
-        all_thds.emplace_back(move(t)); // 线程不能赋值只能使用move移动
-    }
-    // 等待所有线程完成Hessian计算后合并线程
-    std::for_each(all_thds.begin(), all_thds.end(), std::mem_fn(&std::thread::join));
+    // 交给常驻线程池执行，Run 返回时所有线程均已完成
+    GetThreadPool()->Run(std::bind(&Problem::thdCalcHessian, this, std::placeholders::_1, std::placeholders::_2));
     
     // 赋值
-    Hessian_ = multi_H_;
+    std::swap(Hessian_, multi_H_);
     b_ = multi_b_;
     t_hessian_cost_ += t_h.toc();
     // 后续代码与单线程相同
 
-    if(H_prior_.rows() > 0)
-    {
-        MatXX H_prior_tmp = H_prior_;
-        VecX b_prior_tmp = b_prior_;
+    AddPriorToHessian();
 
-        /// 遍历所有 POSE 顶点，然后设置相应的先验维度为 0 .  fix 外参数, SET PRIOR TO ZERO
-        /// landmark 没有先验
-        for (auto vertex: verticies_) {
-           if (IsPoseVertex(vertex.second) && vertex.second->IsFixed() ) {
-                int idx = vertex.second->OrderingId();
-                int dim = vertex.second->LocalDimension();
-                H_prior_tmp.block(idx,0, dim, H_prior_tmp.cols()).setZero();
-                H_prior_tmp.block(0,idx, H_prior_tmp.rows(), dim).setZero();
-                b_prior_tmp.segment(idx,dim).setZero();
-//                std::cout << " fixed prior, set the Hprior and bprior part to zero, idx: "<<idx <<" dim: "<<dim<<std::endl;
-            }
+    delta_x_ = VecX::Zero(size);  // initial delta_x = 0_n;
+
+}
+void Problem::MakeHessianDeterministic(bool use_openmp) {
+    TicToc t_h;
+    ulong size = ordering_generic_;
+    std::shared_ptr<ThreadPool> pool = GetThreadPool();
+    int num_parts = pool->NumThreads();
+    int num_edges = edge_arena_.size();
+    partial_H_.resize(num_parts);
+    partial_b_.resize(num_parts);
+    ReserveEdgeScratch(num_parts);
+
+    // 第 k 段固定为 [n * k / num_parts, n * (k + 1) / num_parts)，与 ThreadPool::ParallelFor 的划分相同
+    auto accumulate = [&](int k) {
+        partial_H_[k] = Hessian_.ZeroLike();
+        partial_b_[k].setZero(size);
+        int begin = static_cast<int>(static_cast<long>(num_edges) * k / num_parts);
+        int end = static_cast<int>(static_cast<long>(num_edges) * (k + 1) / num_parts);
+        for (int i = begin; i < end; ++i) {
+            AddEdgeToHessian(edge_arena_[i], edge_scratch_[k], partial_H_[k], partial_b_[k]);
         }
-        Hessian_.topLeftCorner(ordering_poses_, ordering_poses_) += H_prior_tmp;
-        b_.head(ordering_poses_) += b_prior_tmp;
+    };
+    if (use_openmp) {
+        // 段与执行它的线程无关，OpenMP 实际分配的线程数不影响结果
+        #pragma omp parallel for num_threads(num_parts) schedule(static, 1)
+        for (int k = 0; k < num_parts; ++k) {
+            accumulate(k);
+        }
+    } else {
+        pool->Run([&](int thd_id, int thd_num) {
+            accumulate(thd_id);
+        });
     }
 
-    delta_x_ = VecX::Zero(size);  // initial delta_x = 0_n;
+    // 树形归约：第 s 轮把 k + s 加到 k 上（k 为 2s 的倍数），同一轮中各对互不相交，可以并行
+    for (int stride = 1; stride < num_parts; stride *= 2) {
+        int num_pairs = (num_parts + 2 * stride - 1) / (2 * stride);
+        pool->ParallelFor(num_pairs, [&](int thd_id, int begin, int end) {
+            for (int p = begin; p < end; ++p) {
+                int k = p * 2 * stride;
+                if (k + stride >= num_parts) continue;
+                partial_H_[k] += partial_H_[k + stride];
+                partial_b_[k] += partial_b_[k + stride];
+            }
+        });
+    }
+    std::swap(Hessian_, partial_H_[0]);
+    std::swap(b_, partial_b_[0]);
+    t_hessian_cost_ += t_h.toc();
+
+    AddPriorToHessian();
 
+    delta_x_ = VecX::Zero(size);  // initial delta_x = 0_n;
 }
+
 void Problem::thdCalcHessian(int thd_id, int thd_num){
-    // 移动迭代器到起始位置
-    // auto iter = edges_.begin();
-    // advance(iter, thd_id);
-    // 依次移动直到遍历完成
-    // int cnt = thd_id;
-    int edge_num = edges_.size();
+    int edge_num = edge_arena_.size();
 
     for(int i = thd_id; i < edge_num; i = i + thd_num){
         // printf("Thread %d, edge: %d/%d.\n", thd_id, cnt, edge_num);
-        auto edge = edges_[edges_idx_[i]];
-        edge->ComputeResidual();
-        edge->ComputeJacobians();
+        // 稀疏结构已经在 BuildHessianStructure 中确定，这里累加时只需对数值加锁
+        AddEdgeToHessian(edge_arena_[i], edge_scratch_[thd_id], multi_H_, multi_b_, true, &m_hessian_);
+    }
+}
 
-        // TODO:: robust cost
-        auto jacobians = edge->Jacobians();
-        auto verticies = edge->Verticies();
-        assert(jacobians.size() == verticies.size());
+void Problem::MakeHessianLockFree() {
+    TicToc t_h;
+    ulong size = ordering_generic_;
+    std::shared_ptr<ThreadPool> pool = GetThreadPool();
+
+    // 第一步：各边相互独立，并行线性化
+    reprojection_batches_.resize(pool->NumThreads());
+    pool->ParallelFor(edge_arena_.size(), [this](int thd_id, int begin, int end) {
+        LinearizeEdges(thd_id, begin, end);
+    });
+
+    // 第二步：每个顶点对应的块行只由一个线程写入，不需要加锁
+    // pose 顶点连接的边远多于 landmark，交错分配使各线程负载均衡
+    Hessian_.SetZero();
+    b_.setZero(size);
+    pool->Run([this](int thd_id, int thd_num) {
+        for (size_t k = thd_id; k < vertex_edges_.size(); k += thd_num) {
+            AccumulateVertexRow(vertex_edges_[k]);
+        }
+    });
 
-        for (size_t i = 0; i < verticies.size(); ++i) {
-            auto v_i = verticies[i];
-            if (v_i->IsFixed()) continue;    // Hessian 里不需要添加它的信息，也就是它的雅克比为 0
+    if (lazy_relinearization_) {
+        // 记录线性化点，之后的构建在此基础上增量更新
+        for (size_t k = 0; k < edge_linearizations_.size(); ++k) {
+            edge_linearizations_[k].step_sum = GatherStepSum(edge_linearizations_[k]);
+        }
+        relin_vertex_base_ = relin_step_sum_;
+        relin_step_sum_built_ = relin_step_sum_;
+        lin_hessian_ = Hessian_;
+        lin_b_ = b_;
+        lazy_ready_ = true;
+    }
+    t_hessian_cost_ += t_h.toc();
 
-            auto jacobian_i = jacobians[i];
-            ulong index_i = v_i->OrderingId();
-            ulong dim_i = v_i->LocalDimension();
+    AddPriorToHessian();
 
-            // 鲁棒核函数会修改残差和信息矩阵，如果没有设置 robust cost function，就会返回原来的
-            double drho;
-            MatXX robustInfo(edge->Information().rows(),edge->Information().cols());
-            edge->RobustInfo(drho,robustInfo);
+    delta_x_ = VecX::Zero(size);  // initial delta_x = 0_n;
+}
 
-            MatXX JtW = jacobian_i.transpose() * robustInfo;
-            for (size_t j = i; j < verticies.size(); ++j) {
-                auto v_j = verticies[j];
+void Problem::MakeHessianLazy() {
+    TicToc t_h;
+    ulong size = ordering_generic_;
 
-                if (v_j->IsFixed()) continue;
+    // 找出自上次重新线性化以来移动超过阈值的顶点，与之相连的边都要重新线性化
+    std::vector<int> moved_vertices;
+    std::vector<char> relinearize(edge_arena_.size(), 0);
+    for (size_t r = 0; r < vertex_edges_.size(); ++r) {
+        const VertexEdges &vertex_edges = vertex_edges_[r];
+        double moved = (relin_step_sum_.segment(vertex_edges.index, vertex_edges.dim) -
+                        relin_vertex_base_.segment(vertex_edges.index, vertex_edges.dim)).lpNorm<Eigen::Infinity>();
+        if (moved <= vertex_edges.relinearize_threshold) continue;
+        moved_vertices.push_back(r);
+        for (auto &e : vertex_edges.edges) {
+            relinearize[e.first] = 1;
+        }
+    }
+    std::vector<int> edges;
+    for (size_t k = 0; k < relinearize.size(); ++k) {
+        if (relinearize[k]) edges.push_back(k);
+    }
+    if (edges.size() * 2 > edge_arena_.size()) {
+        MakeHessianLockFree();
+        return;
+    }
 
-                auto jacobian_j = jacobians[j];
-                ulong index_j = v_j->OrderingId();
-                ulong dim_j = v_j->LocalDimension();
+    // 保持原线性化的边，梯度按线性模型 g + H * dx 随状态更新
+    lin_b_ -= lin_hessian_.Multiply(relin_step_sum_ - relin_step_sum_built_);
+    relin_step_sum_built_ = relin_step_sum_;
+
+    // 重新线性化前记下旧的块，以及旧的线性化在当前状态下的梯度（即 lin_b_ 中这条边的贡献）
+    std::vector<std::vector<MatXX>> old_hessians(edges.size());
+    std::vector<std::vector<VecX>> old_gradients(edges.size());
+    GetThreadPool()->ParallelFor(edges.size(), [&](int thd_id, int begin, int end) {
+        for (int m = begin; m < end; ++m) {
+            EdgeLinearization &lin = edge_linearizations_[edges[m]];
+            size_t n = lin.index.size();
+            VecX step_sum = GatherStepSum(lin);
+            VecX dx = step_sum - lin.step_sum;
+            std::vector<int> offset(n, 0);
+            for (size_t i = 1; i < n; ++i) {
+                offset[i] = offset[i - 1] + (lin.index[i - 1] < 0 ? 0 : lin.dim[i - 1]);
+            }
+            old_gradients[m] = lin.gradients;
+            for (size_t i = 0; i < n; ++i) {
+                if (lin.index[i] < 0) continue;
+                for (size_t j = 0; j < n; ++j) {
+                    if (lin.index[j] < 0) continue;
+                    old_gradients[m][i].noalias() += lin.hessians[i * n + j] * dx.segment(offset[j], lin.dim[j]);
+                }
+            }
+            old_hessians[m] = lin.hessians;
 
-                assert(v_j->OrderingId() != -1);
-                MatXX hessian = JtW * jacobian_j;
+            LinearizeEdge(edge_arena_[edges[m]], lin);
+            lin.step_sum = step_sum;
+        }
+    });
+
+    // 用新旧贡献之差更新，各边写入的块可能重叠，串行累加
+    for (size_t m = 0; m < edges.size(); ++m) {
+        const EdgeLinearization &lin = edge_linearizations_[edges[m]];
+        size_t n = lin.index.size();
+        for (size_t i = 0; i < n; ++i) {
+            if (lin.index[i] < 0) continue;
+            for (size_t j = i; j < n; ++j) {
+                if (lin.index[j] < 0) continue;
+                lin_hessian_.AddBlock(lin.index[i], lin.dim[i], lin.index[j], lin.dim[j],
+                                      lin.hessians[i * n + j] - old_hessians[m][i * n + j]);
+            }
+            lin_b_.segment(lin.index[i], lin.dim[i]) -= lin.gradients[i] - old_gradients[m][i];
+        }
+    }
+    for (int r : moved_vertices) {
+        const VertexEdges &vertex_edges = vertex_edges_[r];
+        relin_vertex_base_.segment(vertex_edges.index, vertex_edges.dim) =
+            relin_step_sum_.segment(vertex_edges.index, vertex_edges.dim);
+    }
 
-                // 所有的信息矩阵叠加起来
-                multi_H_.block(index_i, index_j, dim_i, dim_j).noalias() += hessian;
-                if (j != i) {
-                    // 对称的下三角
-                    multi_H_.block(index_j, index_i, dim_j, dim_i).noalias() += hessian.transpose();
+    Hessian_ = lin_hessian_;
+    b_ = lin_b_;
+    lazy_ready_ = true;
+    t_hessian_cost_ += t_h.toc();
 
-                }
+    AddPriorToHessian();
+
+    delta_x_ = VecX::Zero(size);  // initial delta_x = 0_n;
+}
+
+VecX Problem::GatherStepSum(const EdgeLinearization &lin) const {
+    int dim = 0;
+    for (size_t i = 0; i < lin.index.size(); ++i) {
+        if (lin.index[i] >= 0) dim += lin.dim[i];
+    }
+    VecX step_sum(dim);
+    int offset = 0;
+    for (size_t i = 0; i < lin.index.size(); ++i) {
+        if (lin.index[i] < 0) continue;
+        step_sum.segment(offset, lin.dim[i]) = relin_step_sum_.segment(lin.index[i], lin.dim[i]);
+        offset += lin.dim[i];
+    }
+    return step_sum;
+}
+
+void Problem::LinearizeEdge(const std::shared_ptr<Edge> &edge, EdgeLinearization &lin) {
+    edge->Evaluate(true);
+    // 固定维度的边使用定长矩阵计算各块
+    edge->LinearizeBlocks(lin.index, lin.hessians, lin.gradients);
+    lin.jacobian.resize(0, 0);
+}
+
+void Problem::LinearizeEdges(int thd_id, int begin, int end) {
+    // 每个线程分到的区间按类型分段
+    for (const auto &group : edge_groups_) {
+        int b = std::max(begin, group.begin), e = std::min(end, group.end);
+        if (b >= e) continue;
+        switch (group.kernel) {
+        case EdgeKernel::REPROJECTION:
+            EvaluateReprojectionRange(reprojection_batches_[thd_id], b, e, true);
+            break;
+        case EdgeKernel::IMU:
+            LinearizeEdgeRange<EdgeImu>(b, e);
+            break;
+        default:
+            for (int k = b; k < e; ++k) {
+                LinearizeEdge(edge_arena_[k], edge_linearizations_[k]);
+            }
+            break;
+        }
+    }
+}
+
+template <typename EdgeType>
+void Problem::LinearizeEdgeRange(int begin, int end) {
+    // 类型已在 BuildHessianStructure 中确认，限定名调用不经过虚函数表
+    for (int k = begin; k < end; ++k) {
+        EdgeType *edge = static_cast<EdgeType *>(edge_arena_[k].get());
+        EdgeLinearization &lin = edge_linearizations_[k];
+        edge->EdgeType::Evaluate(true);
+        edge->EdgeType::LinearizeBlocks(lin.index, lin.hessians, lin.gradients);
+    }
+}
+
+double Problem::EdgesChi(int thd_id, int begin, int end) {
+    double chi = 0.;
+    for (const auto &group : edge_groups_) {
+        int b = std::max(begin, group.begin), e = std::min(end, group.end);
+        if (b >= e) continue;
+        switch (group.kernel) {
+        case EdgeKernel::REPROJECTION:
+            chi += EvaluateReprojectionRange(reprojection_batches_[thd_id], b, e, false);
+            break;
+        case EdgeKernel::IMU:
+            chi += EdgesChiRange<EdgeImu>(b, e);
+            break;
+        default:
+            for (int k = b; k < e; ++k) {
+                edge_arena_[k]->Evaluate(false);
+                chi += edge_arena_[k]->RobustChi2();
             }
-            std::lock_guard<std::mutex> lock(m_hessian_);
-            multi_b_.segment(index_i, dim_i).noalias() -= drho * jacobian_i.transpose()* edge->Information() * edge->Residual();
+            break;
         }
+    }
+    return chi;
+}
 
-        // cnt += thd_num;
-        
-        // if(cnt < edge_num){
-        //     advance(iter, thd_num); // 移动迭代器
-        // }
-        // else{
-        //     break;
-        // }
+template <typename EdgeType>
+double Problem::EdgesChiRange(int begin, int end) {
+    double chi = 0.;
+    for (int k = begin; k < end; ++k) {
+        EdgeType *edge = static_cast<EdgeType *>(edge_arena_[k].get());
+        edge->EdgeType::Evaluate(false);
+        chi += edge->RobustChi2();
+    }
+    return chi;
+}
+
+double Problem::EvaluateReprojectionRange(ReprojectionBatch &batch, int begin, int end, bool need_jacobians) {
+    // 分块打包，批量数据留在 L1/L2 中
+    const int kBatchSize = 64;
+    double chi = 0.;
+    for (int first = begin; first < end; first += kBatchSize) {
+        int n = std::min(kBatchSize, end - first);
+        batch.Resize(n);
+        for (int k = 0; k < n; ++k) {
+            static_cast<const EdgeReprojection *>(edge_arena_[first + k].get())->PackBatch(batch, k);
+        }
+        EvaluateReprojectionBatch(batch, need_jacobians);
+        bool mixed = need_jacobians && mixed_hessian_;
+        for (int k = 0; k < n; ++k) {
+            EdgeReprojection *edge = static_cast<EdgeReprojection *>(edge_arena_[first + k].get());
+            edge->UnpackBatch(batch, k, need_jacobians);
+            if (mixed) {
+                // 梯度用双精度，J^T W J 之后整批用 float 计算
+                EdgeLinearization &lin = edge_linearizations_[first + k];
+                edge->PackHessianBatch(batch, k, lin.index, lin.gradients);
+                lin.jacobian = edge->StackedJacobian().cast<float>();
+            } else if (need_jacobians) {
+                EdgeLinearization &lin = edge_linearizations_[first + k];
+                edge->EdgeReprojection::LinearizeBlocks(lin.index, lin.hessians, lin.gradients);
+            } else {
+                chi += edge->RobustChi2();
+            }
+        }
+        if (mixed) {
+            EvaluateReprojectionHessianBatch(batch);
+            for (int k = 0; k < n; ++k) {
+                const EdgeReprojection *edge = static_cast<const EdgeReprojection *>(edge_arena_[first + k].get());
+                EdgeLinearization &lin = edge_linearizations_[first + k];
+                edge->UnpackHessianBatch(batch, k, lin.index, lin.hessians);
+                lin.robust_info = Vec3(batch.weight[0][k], batch.weight[1][k], batch.weight[2][k]);
+            }
+        }
+    }
+    return chi;
+}
+
+void Problem::AccumulateVertexRow(const VertexEdges &vertex_edges) {
+    int index_i = vertex_edges.index;
+    int dim_i = vertex_edges.dim;
+    bool dense_i = Hessian_.IsDense(index_i);
+
+    for (auto &e: vertex_edges.edges) {
+        const EdgeLinearization &lin = edge_linearizations_[e.first];
+        size_t n = lin.index.size();
+        size_t i = e.second;
+        for (size_t j = 0; j < n; ++j) {
+            int index_j = lin.index[j];
+            if (index_j < 0) continue;
+            // pose-landmark 块存放在 landmark 一侧，由 landmark 行负责
+            if (dense_i && !Hessian_.IsDense(index_j)) continue;
+            Hessian_.AddRowBlock(index_i, dim_i, index_j, lin.dim[j], lin.hessians[i * n + j]);
+        }
+        b_.segment(index_i, dim_i) -= lin.gradients[i];
     }
 }
 
@@ -645,64 +1203,61 @@ void Problem::MakeHessianSingle() {
     TicToc t_h;
     // 直接构造大的 H 矩阵
     ulong size = ordering_generic_;
-    MatXX H(MatXX::Zero(size, size));
-    VecX b(VecX::Zero(size));
-
-    // TODO:: accelate, accelate, accelate
-//#ifdef USE_OPENMP
-//#pragma omp parallel for
-//#endif
-    for (auto &edge: edges_) {
-
-        edge.second->ComputeResidual();
-        edge.second->ComputeJacobians();
-
-        // TODO:: robust cost
-        auto jacobians = edge.second->Jacobians();
-        auto verticies = edge.second->Verticies();
-        assert(jacobians.size() == verticies.size());
-        for (size_t i = 0; i < verticies.size(); ++i) {
-            auto v_i = verticies[i];
-            if (v_i->IsFixed()) continue;    // Hessian 里不需要添加它的信息，也就是它的雅克比为 0
-
-            auto jacobian_i = jacobians[i];
-            ulong index_i = v_i->OrderingId();
-            ulong dim_i = v_i->LocalDimension();
+    Hessian_.SetZero();
+    b_.setZero(size);
 
-            // 鲁棒核函数会修改残差和信息矩阵，如果没有设置 robust cost function，就会返回原来的
-            double drho;
-            MatXX robustInfo(edge.second->Information().rows(),edge.second->Information().cols());
-            edge.second->RobustInfo(drho,robustInfo);
+    ReserveEdgeScratch(1);
+    for (auto &edge: edge_arena_) {
+        AddEdgeToHessian(edge, edge_scratch_[0], Hessian_, b_);
+    }
+    t_hessian_cost_ += t_h.toc();
 
-            MatXX JtW = jacobian_i.transpose() * robustInfo;
-            for (size_t j = i; j < verticies.size(); ++j) {
-                auto v_j = verticies[j];
+    AddPriorToHessian();
 
-                if (v_j->IsFixed()) continue;
+    delta_x_ = VecX::Zero(size);  // initial delta_x = 0_n;
 
-                auto jacobian_j = jacobians[j];
-                ulong index_j = v_j->OrderingId();
-                ulong dim_j = v_j->LocalDimension();
 
-                assert(v_j->OrderingId() != -1);
-                MatXX hessian = JtW * jacobian_j;
+}
 
-                // 所有的信息矩阵叠加起来
-                H.block(index_i, index_j, dim_i, dim_j).noalias() += hessian;
-                if (j != i) {
-                    // 对称的下三角
-                    H.block(index_j, index_i, dim_j, dim_i).noalias() += hessian.transpose();
+void Problem::AddEdgeToHessian(const std::shared_ptr<Edge> &edge, EdgeLinearization &scratch, BlockSparseHessian &H,
+                               VecX &b, bool skip_fixed, std::mutex *m_hessian) {
+    edge->Evaluate(true);
+
+    const auto &verticies = edge->Verticies();
+    size_t n = verticies.size();
+    std::vector<int> &index = scratch.index;
+    index.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        // Hessian 里不需要添加固定顶点的信息，也就是它的雅克比为 0
+        index[i] = (skip_fixed && verticies[i]->IsFixed()) ? -1 : verticies[i]->OrderingId();
+    }
 
-                }
-            }
-            b.segment(index_i, dim_i).noalias() -= drho * jacobian_i.transpose()* edge.second->Information() * edge.second->Residual();
+    // 鲁棒核函数的处理在 LinearizeBlocks 中完成，固定维度的边使用定长矩阵计算
+    // 缓冲区中的块已是上一条同类边的大小，赋值时不会重新分配
+    std::vector<MatXX> &hessians = scratch.hessians;
+    std::vector<VecX> &gradients = scratch.gradients;
+    hessians.resize(n * n);
+    gradients.resize(n);
+    edge->LinearizeBlocks(index, hessians, gradients);
+
+    for (size_t i = 0; i < n; ++i) {
+        if (index[i] < 0) continue;
+        ulong index_i = index[i];
+        ulong dim_i = verticies[i]->LocalDimension();
+
+        // 所有的信息矩阵叠加起来
+        std::unique_lock<std::mutex> lock;
+        if (m_hessian)
+            lock = std::unique_lock<std::mutex>(*m_hessian);
+        for (size_t j = i; j < n; ++j) {
+            if (index[j] < 0) continue;
+            H.AddBlock(index_i, dim_i, index[j], verticies[j]->LocalDimension(), hessians[i * n + j]);
         }
-
+        b.segment(index_i, dim_i).noalias() -= gradients[i];
     }
-    Hessian_ = H;
-    b_ = b;
-    t_hessian_cost_ += t_h.toc();
+}
 
+void Problem::AddPriorToHessian() {
     if(H_prior_.rows() > 0)
     {
         MatXX H_prior_tmp = H_prior_;
@@ -710,62 +1265,278 @@ void Problem::MakeHessianSingle() {
 
         /// 遍历所有 POSE 顶点，然后设置需要fixed的顶点先验维度为 0 .  fix 外参数, SET PRIOR TO ZERO
         /// landmark 没有先验
-        for (auto vertex: verticies_) {
-            if (IsPoseVertex(vertex.second) && vertex.second->IsFixed() ) {
-                int idx = vertex.second->OrderingId();
-                int dim = vertex.second->LocalDimension();
+        for (auto &vertex: vertex_arena_) {
+            if (IsPoseVertex(vertex) && vertex->IsFixed() ) {
+                int idx = vertex->OrderingId();
+                int dim = vertex->LocalDimension();
                 H_prior_tmp.block(idx,0, dim, H_prior_tmp.cols()).setZero();
                 H_prior_tmp.block(0,idx, H_prior_tmp.rows(), dim).setZero();
                 b_prior_tmp.segment(idx,dim).setZero();
 //                std::cout << " fixed prior, set the Hprior and bprior part to zero, idx: "<<idx <<" dim: "<<dim<<std::endl;
             }
         }
-        Hessian_.topLeftCorner(ordering_poses_, ordering_poses_) += H_prior_tmp;
+        Hessian_.DenseBlock().topLeftCorner(ordering_poses_, ordering_poses_) += H_prior_tmp;
         b_.head(ordering_poses_) += b_prior_tmp;
+        if (mixed_hessian_)
+            H_prior_masked_ = H_prior_tmp;
+    } else {
+        H_prior_masked_.resize(0, 0);
     }
+}
 
-    delta_x_ = VecX::Zero(size);  // initial delta_x = 0_n;
+double Problem::ComputeEdgesChi() {
+    // 每个线程累加自己的部分和，最后按线程顺序相加，结果可复现
+    std::shared_ptr<ThreadPool> pool = GetThreadPool();
+    std::vector<double> chi(pool->NumThreads(), 0.);
+    reprojection_batches_.resize(pool->NumThreads());
+    pool->ParallelFor(edge_arena_.size(), [&](int thd_id, int begin, int end) {
+        chi[thd_id] += EdgesChi(thd_id, begin, end);
+    });
 
+    double tempChi = 0.;
+    for (double c : chi) {
+        tempChi += c;
+    }
+    return tempChi;
+}
 
+std::shared_ptr<ThreadPool> Problem::GetThreadPool() {
+    if (!thread_pool_)
+        thread_pool_ = std::make_shared<ThreadPool>(4);
+    return thread_pool_;
 }
 
-void Problem::SolveLinearWithSchur(MatXX & Hessian, VecX &b, VecX & delta_x, int reserve_size, int schur_size ,
-                            std::map<unsigned long, std::shared_ptr<Vertex>> & schur_vertices, double lambda){
-    // cout << "solve linear with schur, current pose_ordering is: " << ordering_poses_ << 
-        // " and current landmark ordering is " << ordering_landmarks_ << endl;
-    // 取Hessian矩阵的对应分块
-    MatXX Hrr = Hessian.block(0, 0, reserve_size, reserve_size);
-    MatXX Hss = Hessian.block(reserve_size, reserve_size, schur_size, schur_size);
-    MatXX Hrs = Hessian.block(0, reserve_size, reserve_size, schur_size);
-    MatXX Hsr = Hessian.block(reserve_size, 0, schur_size, reserve_size);
-    // 取b的对应分块
-    VecX brr = b.head(reserve_size);
-    VecX bss = b.tail(schur_size);
-    // 求Hss的逆()
-    MatXX Hss_inv(MatXX::Zero(schur_size, schur_size));
-    for (auto schurVertex : schur_vertices) {
-        int idx = schurVertex.second->OrderingId() - reserve_size;
-        int size = schurVertex.second->LocalDimension();
-        Hss_inv.block(idx, idx, size, size) = Hss.block(idx, idx, size, size).inverse();
-    }
-    // schur complement
-    MatXX tempH = Hrs * Hss_inv;
-    MatXX Hrr_schur = Hrr - tempH * Hsr;
-    VecX brr_schur = brr - tempH * bss;
+void Problem::SolveLinearWithSchur(BlockSparseHessian &Hessian, const VecX &b, VecX &delta_x, double lambda){
+    if (linear_solver_type_ == LinearSolverType::PCG) {
+        SolveLinearWithPCG(Hessian, b, delta_x, lambda);
+        return;
+    }
+
+    int reserve_size = Hessian.DenseDim();
+    // schur complement，landmark 部分是块对角的，直接按块消去。同一线性化点只做一次
+    UpdateSchurCache(Hessian, b);
+    bool refine = mixed_hessian_ && &Hessian == &Hessian_;
     // 求解x_rr
-    VecX x_rr(VecX::Zero(reserve_size));
- 
-    for(int i = 0; i < reserve_size; i++){
-        Hrr_schur(i, i) += currentLambda_;
+    if (linear_solver_type_ == LinearSolverType::SPARSE_LDLT) {
+        delta_x.head(reserve_size) = SolveSparseLDLT(H_pp_schur_, b_pp_schur_, lambda);
+        // 求解x_ss
+        Hessian.BackSubstitute(b, delta_x, GetThreadPool().get());
+        if (refine) {
+            RefineMixedPrecision(b, delta_x, lambda, [this, lambda](const VecX &r) -> VecX {
+                if (sparse_ldlt_.info() == Eigen::Success)
+                    return VecX(sparse_ldlt_.solve(r));
+                return VecX(FactorizeDenseLDLT(lambda).solve(r));
+            });
+        }
+    } else {
+        Eigen::LDLT<MatXX> ldlt = FactorizeDenseLDLT(lambda);
+        delta_x.head(reserve_size) = ldlt.solve(b_pp_schur_);
+        // 求解x_ss
+        Hessian.BackSubstitute(b, delta_x, GetThreadPool().get());
+        if (refine) {
+            RefineMixedPrecision(b, delta_x, lambda, [&ldlt](const VecX &r) { return VecX(ldlt.solve(r)); });
+        }
+    }
+}
+
+VecX Problem::SolveDenseLDLT(double lambda) const {
+    return FactorizeDenseLDLT(lambda).solve(b_pp_schur_);
+}
+
+Eigen::LDLT<MatXX> Problem::FactorizeDenseLDLT(double lambda) const {
+    MatXX H_damped = H_pp_schur_;
+    for(int i = 0; i < H_damped.rows(); i++){
+        H_damped(i, i) += lambda;
+    }
+    return H_damped.ldlt();
+}
+
+void Problem::RefineMixedPrecision(const VecX &b, VecX &delta_x, double lambda,
+                                   const std::function<VecX(const VecX &)> &solve_schur) {
+    ThreadPool *pool = GetThreadPool().get();
+    int reserve_size = Hessian_.DenseDim();
+    double tolerance = mixed_refinement_tolerance_ * b.norm();
+    for (int k = 0; k < mixed_refinement_steps_; ++k) {
+        // 残差按双精度累加，阻尼只在 pose 部分。float 的舍入误差通常远小于阈值，此时不需要修正
+        VecX r = b - MultiplyLinearizedHessian(delta_x);
+        r.head(reserve_size) -= lambda * delta_x.head(reserve_size);
+        if (r.norm() <= tolerance)
+            break;
+        VecX correction(VecX::Zero(delta_x.size()));
+        correction.head(reserve_size) = solve_schur(Hessian_.SchurRhs(r, pool));
+        Hessian_.BackSubstitute(r, correction, pool);
+        delta_x += correction;
     }
+}
 
-    x_rr = Hrr_schur.ldlt().solve(brr_schur);
-    delta_x.head(reserve_size) = x_rr;
+VecX Problem::MultiplyLinearizedHessian(const VecX &x) {
+    // 每个线程累加自己的部分和，最后按线程顺序相加
+    std::shared_ptr<ThreadPool> pool = GetThreadPool();
+    std::vector<VecX> partial(pool->NumThreads(), VecX::Zero(x.size()));
+    pool->ParallelFor(edge_linearizations_.size(), [&](int thd_id, int begin, int end) {
+        VecX &y = partial[thd_id];
+        VecX Jx, WJx(2);
+        for (int k = begin; k < end; ++k) {
+            const EdgeLinearization &lin = edge_linearizations_[k];
+            size_t n = lin.index.size();
+            if (lin.jacobian.size() > 0) {
+                Jx.setZero(lin.jacobian.rows());
+                for (size_t i = 0, offset = 0; i < n; offset += lin.dim[i], ++i) {
+                    if (lin.index[i] < 0) continue;
+                    Jx.noalias() += lin.jacobian.middleCols(offset, lin.dim[i]).cast<double>() * x.segment(lin.index[i], lin.dim[i]);
+                }
+                const Vec3 &w = lin.robust_info;
+                WJx << w[0] * Jx[0] + w[1] * Jx[1], w[1] * Jx[0] + w[2] * Jx[1];
+                for (size_t i = 0, offset = 0; i < n; offset += lin.dim[i], ++i) {
+                    if (lin.index[i] < 0) continue;
+                    y.segment(lin.index[i], lin.dim[i]).noalias() += lin.jacobian.middleCols(offset, lin.dim[i]).transpose().cast<double>() * WJx;
+                }
+                continue;
+            }
+            for (size_t i = 0; i < n; ++i) {
+                if (lin.index[i] < 0) continue;
+                for (size_t j = 0; j < n; ++j) {
+                    if (lin.index[j] < 0) continue;
+                    y.segment(lin.index[i], lin.dim[i]).noalias() += lin.hessians[i * n + j] * x.segment(lin.index[j], lin.dim[j]);
+                }
+            }
+        }
+    });
+
+    VecX y = partial[0];
+    for (size_t t = 1; t < partial.size(); ++t) {
+        y += partial[t];
+    }
+    if (H_prior_masked_.rows() > 0)
+        y.head(ordering_poses_).noalias() += H_prior_masked_ * x.head(ordering_poses_);
+    return y;
+}
+
+VecX Problem::SolveSparseLDLT(const MatXX &H_schur, const VecX &b_schur, double lambda){
+    // pose 顶点划分的块，以及不全为零的下三角块
+    std::vector<std::pair<ulong, int>> pose_blocks;
+    for (auto &vertex : idx_pose_vertices_) {
+        pose_blocks.push_back(std::make_pair(vertex.second->OrderingId(), int(vertex.second->LocalDimension())));
+    }
+    std::vector<std::pair<int, int>> block_pattern;
+    for (int i = 0; i < int(pose_blocks.size()); ++i) {
+        for (int j = 0; j <= i; ++j) {
+            if (j == i || !H_schur.block(pose_blocks[i].first, pose_blocks[j].first,
+                                         pose_blocks[i].second, pose_blocks[j].second).isZero(0.)) {
+                block_pattern.push_back(std::make_pair(i, j));
+            }
+        }
+    }
+
+    // 块结构变化时重新建立稀疏矩阵并做符号分析，否则只更新数值
+    if (pose_blocks != sparse_pose_blocks_ || block_pattern != sparse_block_pattern_ ||
+        sparse_schur_.rows() != H_schur.rows()) {
+        std::vector<Eigen::Triplet<double>> triplets;
+        for (const auto &block : block_pattern) {
+            const std::pair<ulong, int> &row = pose_blocks[block.first];
+            const std::pair<ulong, int> &col = pose_blocks[block.second];
+            for (int c = 0; c < col.second; ++c) {
+                for (int r = block.first == block.second ? c : 0; r < row.second; ++r) {
+                    triplets.push_back(Eigen::Triplet<double>(row.first + r, col.first + c, 0.));
+                }
+            }
+        }
+        sparse_schur_.resize(H_schur.rows(), H_schur.cols());
+        sparse_schur_.setFromTriplets(triplets.begin(), triplets.end());
+        sparse_schur_.makeCompressed();
+        sparse_ldlt_.analyzePattern(sparse_schur_);
+        sparse_pose_blocks_ = pose_blocks;
+        sparse_block_pattern_ = block_pattern;
+    }
+    for (int k = 0; k < sparse_schur_.outerSize(); ++k) {
+        for (Eigen::SparseMatrix<double>::InnerIterator it(sparse_schur_, k); it; ++it) {
+            it.valueRef() = H_schur(it.row(), it.col());
+            if (it.row() == it.col())
+                it.valueRef() += lambda;
+        }
+    }
+
+    sparse_ldlt_.factorize(sparse_schur_);
+    if (sparse_ldlt_.info() == Eigen::Success)
+        return sparse_ldlt_.solve(b_schur);
+
+    // 出现零主元（例如没有阻尼时的固定顶点）时退回稠密 LDLT
+    MatXX H_damped = H_schur;
+    H_damped.diagonal().array() += lambda;
+    return H_damped.ldlt().solve(b_schur);
+}
+
+void Problem::UpdateSchurCache(BlockSparseHessian &Hessian, const VecX &b){
+    bool cacheable = &Hessian == &Hessian_;
+    if (schur_valid_ && cacheable)
+        return;
+
+    TicToc t_schur;
+    ThreadPool *pool = GetThreadPool().get();
+    if (linear_solver_type_ == LinearSolverType::PCG) {
+        Hessian.InvertLandmarkBlocks(pool);
+        b_pp_schur_ = Hessian.SchurRhs(b, pool);
+
+        // 块 Jacobi 预条件：每个 pose 顶点一个块。固定顶点的块为零，LDLT 求出的增量也为零
+        schur_pose_blocks_.clear();
+        for (auto &vertex : idx_pose_vertices_) {
+            schur_pose_blocks_.push_back(std::make_pair(vertex.second->OrderingId(), int(vertex.second->LocalDimension())));
+        }
+        schur_diag_blocks_ = Hessian.SchurDiagonalBlocks(schur_pose_blocks_, pool);
+    } else {
+        Hessian.SchurComplement(b, H_pp_schur_, b_pp_schur_, pool);
+    }
+    schur_valid_ = cacheable;
+    t_schur_cost_ += t_schur.toc();
+}
+
+void Problem::SolveLinearWithPCG(BlockSparseHessian &Hessian, const VecX &b, VecX &delta_x, double lambda){
+    ThreadPool *pool = GetThreadPool().get();
+    int reserve_size = Hessian.DenseDim();
+    // landmark 块的逆、b_schur 和预条件的对角块与 lambda 无关，同一线性化点只算一次
+    UpdateSchurCache(Hessian, b);
+    const std::vector<std::pair<ulong, int>> &pose_blocks = schur_pose_blocks_;
+    const VecX &b_schur = b_pp_schur_;
+    std::vector<Eigen::LDLT<MatXX>> precond(schur_diag_blocks_.size());
+    for (size_t i = 0; i < schur_diag_blocks_.size(); ++i) {
+        MatXX diag = schur_diag_blocks_[i];
+        diag.diagonal().array() += lambda;
+        precond[i].compute(diag);
+    }
+    auto apply_precond = [&](const VecX &r) {
+        VecX z(reserve_size);
+        for (size_t i = 0; i < pose_blocks.size(); ++i) {
+            z.segment(pose_blocks[i].first, pose_blocks[i].second) =
+                precond[i].solve(r.segment(pose_blocks[i].first, pose_blocks[i].second));
+        }
+        return z;
+    };
+
+    VecX x(VecX::Zero(reserve_size));
+    VecX r(b_schur);    // initial r = b - A*0 = b
+    VecX z = apply_precond(r);
+    VecX p(z);
+    double rz = r.dot(z);
+    double threshold = 1e-6 * r.norm();
+    for (int i = 0; i < reserve_size && r.norm() > threshold; ++i) {
+        VecX w = Hessian.SchurMultiply(p, pool) + lambda * p;
+        double pw = p.dot(w);
+        if (pw <= 0.)
+            break;
+        double alpha = rz / pw;
+        x += alpha * p;
+        r -= alpha * w;
+        z = apply_precond(r);
+        double rz_new = r.dot(z);
+        p = z + (rz_new / rz) * p;
+        rz = rz_new;
+    }
+
+    delta_x.head(reserve_size) = x;
     // 求解x_ss
-    VecX x_ss(VecX::Zero(schur_size));
-    x_ss = Hss_inv * (bss - Hsr * x_rr);
-    delta_x.tail(schur_size) = x_ss;
+    Hessian.BackSubstitute(b, delta_x, pool);
 }
+
 /*
  * Solve Hx = b, we can use PCG iterative method or use sparse Cholesky
  */
@@ -774,8 +1545,8 @@ void Problem::SolveLinearSystem() {
 
     if (problemType_ == ProblemType::GENERIC_PROBLEM) {
         // PCG solver
-        MatXX H = Hessian_;
-        for (size_t i = 0; i < Hessian_.cols(); ++i) {
+        MatXX H = Hessian_.DenseBlock();
+        for (size_t i = 0; i < H.cols(); ++i) {
             H(i, i) += currentLambda_;
         }
         // delta_x_ = PCGSolver(H, b_, H.rows() * 2);
@@ -784,59 +1555,15 @@ void Problem::SolveLinearSystem() {
     } else {
         
         //TicToc t_Hmminv;
-        int reserve_size = ordering_poses_;
-        int marg_size = ordering_landmarks_;
-        
-        SolveLinearWithSchur(Hessian_, b_, delta_x_, reserve_size, marg_size, idx_landmark_vertices_, currentLambda_);
-    /*
-        // 取各元素
-        MatXX Hmm = Hessian_.block(reserve_size, reserve_size, marg_size, marg_size);
-        MatXX Hpm = Hessian_.block(0, reserve_size, reserve_size, marg_size);
-        MatXX Hmp = Hessian_.block(reserve_size, 0, marg_size, reserve_size);
-        // MatXX Hmm = currentHessian.block(reserve_size, reserve_size, marg_size, marg_size);
-        // MatXX Hpm = currentHessian.block(0, reserve_size, reserve_size, marg_size);
-        // MatXX Hmp = currentHessian.block(reserve_size, 0, marg_size, reserve_size);
-        VecX bpp = b_.segment(0, reserve_size);
-        VecX bmm = b_.segment(reserve_size, marg_size);
-
-        // Hmm 是对角线矩阵，它的求逆可以直接为对角线块分别求逆，如果是逆深度，对角线块为1维的，则直接为对角线的倒数，这里可以加速
-        MatXX Hmm_inv(MatXX::Zero(marg_size, marg_size));
-        // TODO:: use openMP
-        for (auto landmarkVertex : idx_landmark_vertices_) {
-            int idx = landmarkVertex.second->OrderingId() - reserve_size;
-            int size = landmarkVertex.second->LocalDimension();
-            Hmm_inv.block(idx, idx, size, size) = Hmm.block(idx, idx, size, size).inverse();
-        }
-
-        MatXX tempH = Hpm * Hmm_inv;
-        // H_pp_schur_ = currentHessian.block(0, 0, ordering_poses_, ordering_poses_) - tempH * Hmp;
-        H_pp_schur_ = Hessian_.block(0, 0, ordering_poses_, ordering_poses_) - tempH * Hmp;
-        b_pp_schur_ = bpp - tempH * bmm;
-        
-        // step2: solve Hpp * delta_x = bpp
-        VecX delta_x_pp(VecX::Zero(reserve_size));
-
-        for (ulong i = 0; i < ordering_poses_; ++i) {
-            H_pp_schur_(i, i) += currentLambda_;              // LM Method
-        }
-
-        // TicToc t_linearsolver;
-        delta_x_pp =  H_pp_schur_.ldlt().solve(b_pp_schur_);//  SVec.asDiagonal() * svd.matrixV() * Ub;    
-        delta_x_.head(reserve_size) = delta_x_pp;
-        // std::cout << " Linear Solver Time Cost: " << t_linearsolver.toc() << std::endl;
-        
-        // step3: solve Hmm * delta_x = bmm - Hmp * delta_x_pp;
-        VecX delta_x_ll(marg_size);
-        delta_x_ll = Hmm_inv * (bmm - Hmp * delta_x_pp);
-        delta_x_.tail(marg_size) = delta_x_ll;
-
-        //std::cout << "schur time cost: "<< t_Hmminv.toc()<<std::endl;
-    */
+        SolveLinearWithSchur(Hessian_, b_, delta_x_, currentLambda_);
     }
 
 }
 
-void Problem::SolveDogLegStep(){
+bool Problem::SolveDogLegStep(){
+    if (trust_region_step_ == TrustRegionStep::STEIHAUG_CG && problemType_ == ProblemType::SLAM_PROBLEM) {
+        return SolveSteihaugStep();
+    }
     // ----- 求解h_gn -----//
     // 对于普通问题，直接采用ldlt求解，
     // 对于SLAM问题，可采用schur Complement加速
@@ -844,20 +1571,17 @@ void Problem::SolveDogLegStep(){
 
     if (problemType_ == ProblemType::GENERIC_PROBLEM) {
         // PCG solver
-        MatXX H = Hessian_;
-        // for (size_t i = 0; i < Hessian_.cols(); ++i) {
+        MatXX H = Hessian_.DenseBlock();
+        // for (size_t i = 0; i < H.cols(); ++i) {
         //     H(i, i) += currentLambda_;
         // }
         // delta_x_ = PCGSolver(H, b_, H.rows() * 2);
         h_gn_ = H.ldlt().solve(b_);
     } else {
-        int reserve_size = ordering_poses_;
-        int schur_size = ordering_landmarks_;
-
-        SolveLinearWithSchur(Hessian_, b_, h_gn_, reserve_size, schur_size, idx_landmark_vertices_, currentLambda_); 
+        SolveLinearWithSchur(Hessian_, b_, h_gn_, currentLambda_);
     }
     // ----- 求解h_sd 和alpha
-    alpha_ = b_.squaredNorm() / (b_.transpose() * Hessian_ * b_);
+    alpha_ = b_.squaredNorm() / b_.dot(Hessian_.Multiply(b_));
     h_sd_ = b_;
     // ----- 求解步长 ----- //
     double h_gn_norm = h_gn_.norm();
@@ -885,18 +1609,82 @@ void Problem::SolveDogLegStep(){
        h_dl_ = a + beta_ * (b - a);
     }
     delta_x_ = h_dl_;
+    return true;
+}
+
+bool Problem::SolveSteihaugStep(){
+    ThreadPool *pool = GetThreadPool().get();
+    int reserve_size = Hessian_.DenseDim();
+    UpdateSchurCache(Hessian_, b_);
+    // PCG 时不构造 H_schur，通过 landmark 块隐式相乘
+    auto schur_multiply = [&](const VecX &p) -> VecX {
+        if (linear_solver_type_ == LinearSolverType::PCG)
+            return Hessian_.SchurMultiply(p, pool);
+        return H_pp_schur_ * p;
+    };
+    // |x + tau * p| = radius 的正根
+    auto to_boundary = [&](const VecX &x, const VecX &p) {
+        double xp = x.dot(p), pp = p.squaredNorm();
+        return (-xp + sqrt(xp * xp + pp * (currentRadius_ * currentRadius_ - x.squaredNorm()))) / pp;
+    };
+
+    const VecX &g = b_pp_schur_;
+    // 梯度为零或低于 SolveDogLeg 的收敛阈值时 CG 不会迭代，模型下降量为零，直接视为收敛
+    if (g.norm() < 1e-5) {
+        steihaug_model_decrease_ = 0.;
+        delta_x_ = VecX::Zero(b_.size());
+        h_dl_ = delta_x_;
+        return false;
+    }
+    VecX x(VecX::Zero(reserve_size));
+    VecX r(g);
+    VecX p(r);
+    double rr = r.squaredNorm();
+    double threshold = 1e-6 * r.norm();
+    for (int i = 0; i < reserve_size && sqrt(rr) > threshold; ++i) {
+        VecX w = schur_multiply(p);
+        double pw = p.dot(w);
+        if (pw <= 0.) {
+            // 负曲率，沿 p 走到边界
+            x += to_boundary(x, p) * p;
+            break;
+        }
+        double alpha = rr / pw;
+        if ((x + alpha * p).norm() >= currentRadius_) {
+            // 超出信赖域，截断在边界上
+            x += to_boundary(x, p) * p;
+            break;
+        }
+        x += alpha * p;
+        r -= alpha * w;
+        double rr_new = r.squaredNorm();
+        p = r + (rr_new / rr) * p;
+        rr = rr_new;
+    }
+
+    // landmark 取给定 pose 增量下的最优值，完整模型的下降量等于 schur 之后的模型下降量
+    steihaug_model_decrease_ = g.dot(x) - 0.5 * x.dot(schur_multiply(x));
+    delta_x_ = VecX::Zero(b_.size());
+    delta_x_.head(reserve_size) = x;
+    Hessian_.BackSubstitute(b_, delta_x_, pool);
+    h_dl_ = delta_x_;
+    return true;
 }
 
 void Problem::UpdateStates() {
 
     // update vertex
-    for (auto vertex: verticies_) {
-        vertex.second->BackUpParameters();    // 保存上次的估计值
+    for (auto &vertex: vertex_arena_) {
+        vertex->BackUpParameters();    // 保存上次的估计值
 
-        ulong idx = vertex.second->OrderingId();
-        ulong dim = vertex.second->LocalDimension();
-        VecX delta = delta_x_.segment(idx, dim);
-        vertex.second->Plus(delta);
+        ulong idx = vertex->OrderingId();
+        ulong dim = vertex->LocalDimension();
+        vertex->Plus(delta_x_.segment(idx, dim));
+    }
+
+    if (lazy_relinearization_ && relin_step_sum_.size() == delta_x_.size()) {
+        relin_step_sum_backup_ = relin_step_sum_;
+        relin_step_sum_ += delta_x_;
     }
 
     // update prior
@@ -919,8 +1707,12 @@ void Problem::UpdateStates() {
 void Problem::RollbackStates() {
 
     // update vertex
-    for (auto vertex: verticies_) {
-        vertex.second->RollBackParameters();
+    for (auto &vertex: vertex_arena_) {
+        vertex->RollBackParameters();
+    }
+
+    if (lazy_relinearization_ && relin_step_sum_backup_.size() == relin_step_sum_.size()) {
+        relin_step_sum_ = relin_step_sum_backup_;
     }
 
     // Roll back prior_
@@ -936,8 +1728,8 @@ void Problem::ComputeLambdaInitLM() {
     currentLambda_ = -1.;
     currentChi_ = 0.0;
 
-    for (auto edge: edges_) {
-        currentChi_ += edge.second->RobustChi2();
+    for (auto &edge: edge_arena_) {
+        currentChi_ += edge->RobustChi2();
     }
     if (err_prior_.rows() > 0)
         // currentChi_ += err_prior_.norm();
@@ -946,12 +1738,7 @@ void Problem::ComputeLambdaInitLM() {
 
     stopThresholdLM_ = 1e-10 * currentChi_;          // 迭代条件为 误差下降 1e-6 倍
 
-    double maxDiagonal = 0;
-    ulong size = Hessian_.cols();
-    assert(Hessian_.rows() == Hessian_.cols() && "Hessian is not square");
-    for (ulong i = 0; i < size; ++i) {
-        maxDiagonal = std::max(fabs(Hessian_(i, i)), maxDiagonal);
-    }
+    double maxDiagonal = Hessian_.MaxDiagonal();
 
     maxDiagonal = std::min(5e10, maxDiagonal);
     double tau = 1e-5;  // 1e-5
@@ -964,9 +1751,9 @@ void Problem::ComputeRadiusInitDogLeg(){
     // ----- 初始化Chi ----- //
     currentChi_ = 0.0;
     // 计算当前chi
-    for(auto edge:edges_){
+    for(auto &edge: edge_arena_){
         // 此处不需要计算residual，因为MakeHessian时已经计算过
-        currentChi_ += edge.second->RobustChi2();
+        currentChi_ += edge->RobustChi2();
     }
     // 计算先验chi
     if(err_prior_.rows() > 0){
@@ -982,58 +1769,39 @@ void Problem::ComputeRadiusInitDogLeg(){
 }
 
 void Problem::AddLambdatoHessianLM() {
-    ulong size = Hessian_.cols();
-    assert(Hessian_.rows() == Hessian_.cols() && "Hessian is not square");
-    for (ulong i = 0; i < size; ++i) {
-        Hessian_(i, i) += currentLambda_;
-    }
+    Hessian_.AddDiagonal(currentLambda_);
 }
 
 void Problem::RemoveLambdaHessianLM() {
-    ulong size = Hessian_.cols();
-    assert(Hessian_.rows() == Hessian_.cols() && "Hessian is not square");
     // TODO:: 这里不应该减去一个，数值的反复加减容易造成数值精度出问题？而应该保存叠加lambda前的值，在这里直接赋值
-    for (ulong i = 0; i < size; ++i) {
-        Hessian_(i, i) -= currentLambda_;
-    }
+    Hessian_.AddDiagonal(-currentLambda_);
 }
 
-bool Problem::IsGoodStepInLM() {
-    double scale = 0;
-    scale = 0.5 * delta_x_.transpose() * (currentLambda_ * delta_x_ + b_);
-//    scale += 1e-3;    // make sure it's non-zero :)
-    // scale = 0.5 * delta_x_.transpose() * (currentLambda_ * diagHessian_ * delta_x_ + b_); // 这里上下是否乘以0.5不会影响结果
-    scale += 1e-6;    // make sure it's non-zero :)
-
+double Problem::ComputeStepChiLM() {
     // recompute residuals after update state
-    double tempChi = 0.0;
-    for (auto edge: edges_) {
-        edge.second->ComputeResidual();
-        tempChi += edge.second->RobustChi2();
-    }
+    double tempChi = ComputeEdgesChi();
     if (err_prior_.size() > 0)
         // 使用进行平方好像区别不大 ??
         // tempChi += err_prior_.norm();
         tempChi += err_prior_.squaredNorm();
     tempChi *= 0.5;          // 1/2 * err^2；上下同时乘以0.5不会影响结果，但需要同时！！
+    return tempChi;
+}
 
-    double rho = (currentChi_ - tempChi) / scale;
+double Problem::GainRatioLM(double tempChi, double lambda) const {
+    double scale = 0;
+    scale = 0.5 * delta_x_.transpose() * (lambda * delta_x_ + b_);
+//    scale += 1e-3;    // make sure it's non-zero :)
+    // scale = 0.5 * delta_x_.transpose() * (currentLambda_ * diagHessian_ * delta_x_ + b_); // 这里上下是否乘以0.5不会影响结果
+    scale += 1e-6;    // make sure it's non-zero :)
 
-    // // ---nielsen
-    if (rho > 0 && isfinite(tempChi))   // last step was good, 误差在下降
-    {
-        double alpha = 1. - pow((2 * rho - 1), 3);
-        alpha = std::min(alpha, 2. / 3.);
-        double scaleFactor = (std::max)(1. / 3., alpha);
-        currentLambda_ *= scaleFactor;
-        ni_ = 2;
-        currentChi_ = tempChi;
-        return true;
-    } else {
-        currentLambda_ *= ni_;
-        ni_ *= 2;
-        return false;
-    }
+    return (currentChi_ - tempChi) / scale;
+}
+
+bool Problem::IsGoodStepInLM() {
+    double tempChi = ComputeStepChiLM();
+    double rho = GainRatioLM(tempChi, currentLambda_);
+    return UpdateLambdaLM(rho, tempChi);
     // --- quadratic
     // double diff = currentChi_ - tempChi;
     // double h = b_.transpose() * delta_x_;
@@ -1062,13 +1830,97 @@ bool Problem::IsGoodStepInLM() {
     // }
 }
 
-bool Problem::IsGoodStepInDogLeg(){
-    double tempChi = 0.;
-    for(auto edge : edges_){
-        // 由于执行过updateState，需要重新计算残差
-        edge.second->ComputeResidual(); 
-        tempChi += edge.second->RobustChi2();
+bool Problem::UpdateLambdaLM(double rho, double tempChi) {
+    // // ---nielsen
+    if (rho > 0 && isfinite(tempChi))   // last step was good, 误差在下降
+    {
+        double alpha = 1. - pow((2 * rho - 1), 3);
+        alpha = std::min(alpha, 2. / 3.);
+        double scaleFactor = (std::max)(1. / 3., alpha);
+        currentLambda_ *= scaleFactor;
+        ni_ = 2;
+        currentChi_ = tempChi;
+        return true;
+    } else {
+        currentLambda_ *= ni_;
+        ni_ *= 2;
+        return false;
     }
+}
+
+bool Problem::SpeculativeStepLM(SolverRecord &record) {
+    // 候选 lambda: lambda / ni, lambda, lambda * ni, ...，即串行时连续失败会依次尝试的阻尼
+    int n = speculative_lm_candidates_;
+    std::vector<double> lambdas(n);
+    for (int k = 0; k < n; ++k) {
+        lambdas[k] = currentLambda_ * std::pow(ni_, k - 1);
+    }
+    std::vector<VecX> deltas(n, VecX::Zero(delta_x_.size()));
+
+    TicToc t_linear;
+    // 第一次求解时完成 schur 消元并缓存，其余候选只需重解加了不同阻尼的 pose 部分
+    SolveLinearWithSchur(Hessian_, b_, deltas[1], lambdas[1]);
+    std::shared_ptr<ThreadPool> pool = GetThreadPool();
+    if (linear_solver_type_ == LinearSolverType::LDLT && schur_valid_) {
+        int reserve_size = Hessian_.DenseDim();
+        pool->ParallelFor(n, [&](int thd_id, int begin, int end) {
+            for (int k = begin; k < end; ++k) {
+                if (k != 1)
+                    deltas[k].head(reserve_size) = SolveDenseLDLT(lambdas[k]);
+            }
+        });
+        for (int k = 0; k < n; ++k) {
+            if (k == 1) continue;
+            Hessian_.BackSubstitute(b_, deltas[k], pool.get());
+            if (mixed_hessian_) {
+                // 细化需要在线程池上计算 H * x，只能逐个候选进行，分解重新计算一次
+                Eigen::LDLT<MatXX> ldlt = FactorizeDenseLDLT(lambdas[k]);
+                RefineMixedPrecision(b_, deltas[k], lambdas[k], [&ldlt](const VecX &r) { return VecX(ldlt.solve(r)); });
+            }
+        }
+    } else {
+        // PCG 内部使用线程池，稀疏 LDLT 共享同一个分解，只能逐个求解
+        for (int k = 0; k < n; ++k) {
+            if (k != 1)
+                SolveLinearWithSchur(Hessian_, b_, deltas[k], lambdas[k]);
+        }
+    }
+    record.linear_ms = t_linear.toc();
+
+    // 残差直接读取顶点参数，所以逐个候选更新状态、计算 chi2 后回滚，chi2 本身在线程池上并行计算
+    TicToc t_residual;
+    int best = -1;
+    double best_chi = 0.;
+    for (int k = 0; k < n; ++k) {
+        delta_x_ = deltas[k];
+        UpdateStates();
+        double tempChi = ComputeStepChiLM();
+        RollbackStates();
+        double rho = GainRatioLM(tempChi, lambdas[k]);
+        if (rho > 0 && isfinite(tempChi) && (best < 0 || tempChi < best_chi)) {
+            best = k;
+            best_chi = tempChi;
+        }
+    }
+
+    bool success = best >= 0;
+    if (success) {
+        currentLambda_ = lambdas[best];
+        delta_x_ = deltas[best];
+        UpdateStates();
+        UpdateLambdaLM(GainRatioLM(best_chi, currentLambda_), best_chi);
+    } else {
+        // 所有候选都失败，从最大的阻尼继续增大
+        currentLambda_ = lambdas[n - 1];
+        UpdateLambdaLM(0., best_chi);
+    }
+    record.residual_ms = t_residual.toc();
+    return success;
+}
+
+bool Problem::IsGoodStepInDogLeg(){
+    // 由于执行过updateState，需要重新计算残差
+    double tempChi = ComputeEdgesChi();
     // 先验残差
     if(err_prior_.size() > 0){
         tempChi += err_prior_.squaredNorm();
@@ -1081,6 +1933,12 @@ bool Problem::IsGoodStepInDogLeg(){
     double rho = 0;
     double scale = 0.;
     int option = 0; // 选择论文策略或g20策略
+    // Steihaug 步长：信赖域只约束 pose 部分，模型下降量在求解时已算出
+    bool steihaug = trust_region_step_ == TrustRegionStep::STEIHAUG_CG && problemType_ == ProblemType::SLAM_PROBLEM;
+    if (steihaug) {
+        scale = steihaug_model_decrease_;
+        option = -1;
+    }
     // 根据不同策略计算线性化模型误差
     switch (option)
     {
@@ -1094,13 +1952,15 @@ bool Problem::IsGoodStepInDogLeg(){
         }
         break;
     case 1:
-        scale = -double(delta_x_.transpose() * Hessian_ * delta_x_) + 2 * b_.transpose() * delta_x_;
+        scale = -delta_x_.dot(Hessian_.Multiply(delta_x_)) + 2 * b_.dot(delta_x_);
         break;
     }
-    rho = (currentChi_ - tempChi) / scale;
+    // 模型预测不下降时不接受这一步，避免除零得到 inf/NaN
+    rho = scale > 0. ? (currentChi_ - tempChi) / scale : 0.;
+    double step_norm = steihaug ? delta_x_.head(Hessian_.DenseDim()).norm() : delta_x_.norm();
     // 更新radius
      if (rho > 0.75 && isfinite(tempChi)) {
-        currentRadius_ = std::max(currentRadius_, 3 * delta_x_.norm());
+        currentRadius_ = std::max(currentRadius_, 3 * step_norm);
     }
     else if (rho < 0.25) {
         currentRadius_ = std::max(currentRadius_ * 0.5, 1e-7);
@@ -1164,6 +2024,7 @@ bool Problem::Marginalize(const std::vector<std::shared_ptr<Vertex> > margVertex
     std::vector<shared_ptr<Edge>> marg_edges = GetConnectedEdges(margVertexs[0]);
 
     std::unordered_map<int, shared_ptr<Vertex>> margLandmark;
+    std::vector<int> margLandmarkDims;
     // 构建 Hessian 的时候 pose 的顺序不变，landmark的顺序要重新设定
     int marg_landmark_size = 0;
 //    std::cout << "\n marg edge 1st id: "<< marg_edges.front()->Id() << " end id: "<<marg_edges.back()->Id()<<std::endl;
@@ -1174,150 +2035,90 @@ bool Problem::Marginalize(const std::vector<std::shared_ptr<Vertex> > margVertex
             if (IsLandmarkVertex(iter) && margLandmark.find(iter->Id()) == margLandmark.end()) {
                 iter->SetOrderingId(pose_dim + marg_landmark_size);
                 margLandmark.insert(make_pair(iter->Id(), iter));
+                margLandmarkDims.push_back(iter->LocalDimension());
                 marg_landmark_size += iter->LocalDimension();
             }
         }
     }
 //    std::cout << "pose dim: " << pose_dim <<std::endl;
-    int cols = pose_dim + marg_landmark_size;
     /// 构建误差 H 矩阵 H = H_marg + H_pp_prior
-    MatXX H_marg(MatXX::Zero(cols, cols));
-    VecX b_marg(VecX::Zero(cols));
-    int ii = 0;
+    BlockSparseHessian H_marg;
+    H_marg.Resize(pose_dim, margLandmarkDims);
     for (auto edge: marg_edges) {
-        edge->ComputeResidual();
-        edge->ComputeJacobians();
-        auto jacobians = edge->Jacobians();
-        auto verticies = edge->Verticies();
-        ii++;
-
-        assert(jacobians.size() == verticies.size());
-        for (size_t i = 0; i < verticies.size(); ++i) {
-            auto v_i = verticies[i];
-            auto jacobian_i = jacobians[i];
-            ulong index_i = v_i->OrderingId();
-            ulong dim_i = v_i->LocalDimension();
-
-            double drho;
-            MatXX robustInfo(edge->Information().rows(),edge->Information().cols());
-            edge->RobustInfo(drho,robustInfo);
-
-            for (size_t j = i; j < verticies.size(); ++j) {
-                auto v_j = verticies[j];
-                auto jacobian_j = jacobians[j];
-                ulong index_j = v_j->OrderingId();
-                ulong dim_j = v_j->LocalDimension();
-
-                MatXX hessian = jacobian_i.transpose() * robustInfo * jacobian_j;
-
-                assert(hessian.rows() == v_i->LocalDimension() && hessian.cols() == v_j->LocalDimension());
-                // 所有的信息矩阵叠加起来
-                H_marg.block(index_i, index_j, dim_i, dim_j) += hessian;
-                if (j != i) {
-                    // 对称的下三角
-                    H_marg.block(index_j, index_i, dim_j, dim_i) += hessian.transpose();
-                }
+        for (auto v_i : edge->Verticies()) {
+            if (!IsLandmarkVertex(v_i)) continue;
+            for (auto v_j : edge->Verticies()) {
+                if (IsPoseVertex(v_j))
+                    H_marg.AddPoseLandmarkLink(v_j->OrderingId(), v_j->LocalDimension(), v_i->OrderingId());
             }
-            b_marg.segment(index_i, dim_i) -= drho * jacobian_i.transpose() * edge->Information() * edge->Residual();
         }
-
+    }
+    VecX b_marg(VecX::Zero(H_marg.Dim()));
+    ReserveEdgeScratch(1);
+    for (auto &edge: marg_edges) {
+        AddEdgeToHessian(edge, edge_scratch_[0], H_marg, b_marg, false);
     }
         // std::cout << "edge factor cnt: " << ii <<std::endl;
 
     /// marg landmark
     int reserve_size = pose_dim;
-    if (marg_landmark_size > 0) {
-        int marg_size = marg_landmark_size;
-        MatXX Hmm = H_marg.block(reserve_size, reserve_size, marg_size, marg_size);
-        MatXX Hpm = H_marg.block(0, reserve_size, reserve_size, marg_size);
-        MatXX Hmp = H_marg.block(reserve_size, 0, marg_size, reserve_size);
-        VecX bpp = b_marg.segment(0, reserve_size);
-        VecX bmm = b_marg.segment(reserve_size, marg_size);
-
-        // Hmm 是对角线矩阵，它的求逆可以直接为对角线块分别求逆，如果是逆深度，对角线块为1维的，则直接为对角线的倒数，这里可以加速
-        MatXX Hmm_inv(MatXX::Zero(marg_size, marg_size));
-        // TODO:: use openMP
-        for (auto iter: margLandmark) {
-            int idx = iter.second->OrderingId() - reserve_size;
-            int size = iter.second->LocalDimension();
-            Hmm_inv.block(idx, idx, size, size) = Hmm.block(idx, idx, size, size).inverse();
-        }
-
-        MatXX tempH = Hpm * Hmm_inv;
-        MatXX Hpp = H_marg.block(0, 0, reserve_size, reserve_size) - tempH * Hmp;
-        bpp = bpp - tempH * bmm;
-        H_marg = Hpp;
-        b_marg = bpp;
-    }
+    MatXX H_marg_pp;
+    VecX b_marg_pp;
+    H_marg.SchurComplement(b_marg, H_marg_pp, b_marg_pp);
 
     VecX b_prior_before = b_prior_;
     if(H_prior_.rows() > 0)
     {
-        H_marg += H_prior_;
-        b_marg += b_prior_;
+        H_marg_pp += H_prior_;
+        b_marg_pp += b_prior_;
     }
 
     /// marg frame and speedbias
-    int marg_dim = 0;
-
-    // index 大的先移动
-    for (int k = margVertexs.size() -1 ; k >= 0; --k)
-    {
-
+    // 按下标把保留的变量放前面、要 marg 的变量按 margVertexs 的顺序放后面，一次拷贝完成重排
+    std::vector<int> order;
+    std::vector<bool> is_marg(reserve_size, false);
+    order.reserve(reserve_size);
+    for (size_t k = 0; k < margVertexs.size(); ++k) {
+        int idx = margVertexs[k]->OrderingId();
+        for (int i = 0; i < margVertexs[k]->LocalDimension(); ++i)
+            is_marg[idx + i] = true;
+    }
+    for (int i = 0; i < reserve_size; ++i) {
+        if (!is_marg[i]) order.push_back(i);
+    }
+    int n2 = order.size();
+    for (size_t k = 0; k < margVertexs.size(); ++k) {
         int idx = margVertexs[k]->OrderingId();
-        int dim = margVertexs[k]->LocalDimension();
-//        std::cout << k << " "<<idx << std::endl;
-        marg_dim += dim;
-        // move the marg pose to the Hmm bottown right
-        // 将 row i 移动矩阵最下面
-        Eigen::MatrixXd temp_rows = H_marg.block(idx, 0, dim, reserve_size);
-        Eigen::MatrixXd temp_botRows = H_marg.block(idx + dim, 0, reserve_size - idx - dim, reserve_size);
-        H_marg.block(idx, 0, reserve_size - idx - dim, reserve_size) = temp_botRows;
-        H_marg.block(reserve_size - dim, 0, dim, reserve_size) = temp_rows;
-
-        // 将 col i 移动矩阵最右边
-        Eigen::MatrixXd temp_cols = H_marg.block(0, idx, reserve_size, dim);
-        Eigen::MatrixXd temp_rightCols = H_marg.block(0, idx + dim, reserve_size, reserve_size - idx - dim);
-        H_marg.block(0, idx, reserve_size, reserve_size - idx - dim) = temp_rightCols;
-        H_marg.block(0, reserve_size - dim, reserve_size, dim) = temp_cols;
-
-        Eigen::VectorXd temp_b = b_marg.segment(idx, dim);
-        Eigen::VectorXd temp_btail = b_marg.segment(idx + dim, reserve_size - idx - dim);
-        b_marg.segment(idx, reserve_size - idx - dim) = temp_btail;
-        b_marg.segment(reserve_size - dim, dim) = temp_b;
+        for (int i = 0; i < margVertexs[k]->LocalDimension(); ++i)
+            order.push_back(idx + i);
+    }
+    int m2 = reserve_size - n2;
+
+    MatXX H_perm(reserve_size, reserve_size);
+    VecX b_perm(reserve_size);
+    for (int c = 0; c < reserve_size; ++c) {
+        for (int r = 0; r < reserve_size; ++r)
+            H_perm(r, c) = H_marg_pp(order[r], order[c]);
+        b_perm(c) = b_marg_pp(order[c]);
     }
 
     double eps = 1e-8;
-    int m2 = marg_dim;
-    int n2 = reserve_size - marg_dim;   // marg pose
-    Eigen::MatrixXd Amm = 0.5 * (H_marg.block(n2, n2, m2, m2) + H_marg.block(n2, n2, m2, m2).transpose());
-
-    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> saes(Amm);
-    Eigen::MatrixXd Amm_inv = saes.eigenvectors() * Eigen::VectorXd(
-            (saes.eigenvalues().array() > eps).select(saes.eigenvalues().array().inverse(), 0)).asDiagonal() *
-                              saes.eigenvectors().transpose();
-
-    Eigen::VectorXd bmm2 = b_marg.segment(n2, m2);
-    Eigen::MatrixXd Arm = H_marg.block(0, n2, n2, m2);
-    Eigen::MatrixXd Amr = H_marg.block(n2, 0, m2, n2);
-    Eigen::MatrixXd Arr = H_marg.block(0, 0, n2, n2);
-    Eigen::VectorXd brr = b_marg.segment(0, n2);
-    Eigen::MatrixXd tempB = Arm * Amm_inv;
-    H_prior_ = Arr - tempB * Amr;
-    b_prior_ = brr - tempB * bmm2;
-
-    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> saes2(H_prior_);
-    Eigen::VectorXd S = Eigen::VectorXd((saes2.eigenvalues().array() > eps).select(saes2.eigenvalues().array(), 0));
-    Eigen::VectorXd S_inv = Eigen::VectorXd(
-            (saes2.eigenvalues().array() > eps).select(saes2.eigenvalues().array().inverse(), 0));
-    // 从b中反解误差r
-    Eigen::VectorXd S_sqrt = S.cwiseSqrt();
-    Eigen::VectorXd S_inv_sqrt = S_inv.cwiseSqrt();
-    Jt_prior_inv_ = S_inv_sqrt.asDiagonal() * saes2.eigenvectors().transpose();
+    MatXX Amm = 0.5 * (H_perm.block(n2, n2, m2, m2) + H_perm.block(n2, n2, m2, m2).transpose());
+    VecX bmm2 = b_perm.segment(n2, m2);
+    MatXX Arm = H_perm.block(0, n2, n2, m2);
+
+    // Amm 只有一帧的 15 维，LDLT 求伪逆后做 Schur 补
+    PriorFactor Amm_factor(Amm, eps);
+    MatXX tempB = Arm * Amm_factor.PseudoInverse();
+    H_prior_ = H_perm.block(0, 0, n2, n2) - tempB * H_perm.block(n2, 0, m2, n2);
+    b_prior_ = b_perm.head(n2) - tempB * bmm2;
+
+    // H_prior = P^T L D L^T P = J^T J, J = sqrt(D) L^T P, 从 b 中反解误差 r = -J^{-T} b
+    PriorFactor prior_factor(H_prior_, eps);
+    Jt_prior_inv_ = prior_factor.SqrtInverse();
     err_prior_ = -Jt_prior_inv_ * b_prior_;
 
-    MatXX J = S_sqrt.asDiagonal() * saes2.eigenvectors().transpose();
-    H_prior_ = J.transpose() * J;
+    H_prior_ = prior_factor.Reconstruct();
     MatXX tmp_h = MatXX( (H_prior_.array().abs() > 1e-9).select(H_prior_.array(),0) );
     H_prior_ = tmp_h;
 
@@ -0,0 +1,396 @@
+#include <algorithm>
+#include <cstring>
+#include "backend/problem.h"
+#include "backend/vertex_pose.h"
+#include "backend/vertex_speedbias.h"
+#include "backend/vertex_inverse_depth.h"
+#include "backend/vertex_point_xyz.h"
+#include "backend/edge_reprojection.h"
+#include "backend/edge_imu.h"
+#include "backend/edge_prior.h"
+
+/**
+ * 问题快照的二进制格式（小端，与本机的内存布局一致）
+ *
+ *   头部      : "VIOSNAP\0" | uint32 版本 | int32 问题类型 | double G[3]
+ *   顶点      : uint64 个数，每个顶点 uint64 id | int32 类型 | int32 是否固定 | int32 维度 | double 参数[维度]
+ *   边        : uint64 个数，每条边 int32 类型 | uint32 顶点个数 | uint64 顶点 id[] | int32 核函数类型 | double 核函数参数
+ *               | int32 残差维度 | double 信息矩阵[维度*维度] | 与类型相关的观测
+ *   先验      : H_prior_ | b_prior_ | err_prior_ | Jt_prior_inv_，矩阵为 int32 行 | int32 列 | double 数据（列优先）
+ */
+
+namespace myslam {
+namespace backend {
+
+namespace {
+
+const char kSnapshotMagic[8] = {'V', 'I', 'O', 'S', 'N', 'A', 'P', '\0'};
+const uint32_t kSnapshotVersion = 1;
+
+enum SnapshotVertexType {
+    VERTEX_POSE = 0,
+    VERTEX_SPEED_BIAS,
+    VERTEX_INVERSE_DEPTH,
+    VERTEX_POINT_XYZ
+};
+
+enum SnapshotEdgeType {
+    EDGE_REPROJECTION = 0,
+    EDGE_IMU,
+    EDGE_SE3_PRIOR
+};
+
+enum SnapshotLossType {
+    LOSS_NONE = 0,
+    LOSS_TRIVAL,
+    LOSS_HUBER,
+    LOSS_CAUCHY,
+    LOSS_TUKEY
+};
+
+template <typename T>
+void Write(std::ostream &os, const T &value) {
+    os.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T>
+bool Read(std::istream &is, T &value) {
+    return bool(is.read(reinterpret_cast<char *>(&value), sizeof(T)));
+}
+
+void WriteDoubles(std::ostream &os, const double *data, size_t size) {
+    os.write(reinterpret_cast<const char *>(data), size * sizeof(double));
+}
+
+bool ReadDoubles(std::istream &is, double *data, size_t size) {
+    return bool(is.read(reinterpret_cast<char *>(data), size * sizeof(double)));
+}
+
+void WriteMatrix(std::ostream &os, const MatXX &m) {
+    Write(os, int32_t(m.rows()));
+    Write(os, int32_t(m.cols()));
+    WriteDoubles(os, m.data(), m.size());
+}
+
+bool ReadMatrix(std::istream &is, MatXX &m) {
+    int32_t rows = 0, cols = 0;
+    if (!Read(is, rows) || !Read(is, cols) || rows < 0 || cols < 0)
+        return false;
+    m.resize(rows, cols);
+    return ReadDoubles(is, m.data(), m.size());
+}
+
+bool ReadVector(std::istream &is, VecX &v) {
+    MatXX m;
+    if (!ReadMatrix(is, m) || (m.size() > 0 && m.cols() != 1))
+        return false;
+    v = m;
+    return true;
+}
+
+int VertexType(const Vertex &vertex) {
+    std::string type = vertex.TypeInfo();
+    if (type == "VertexPose") return VERTEX_POSE;
+    if (type == "VertexSpeedBias") return VERTEX_SPEED_BIAS;
+    if (type == "VertexInverseDepth") return VERTEX_INVERSE_DEPTH;
+    if (type == "VertexPointXYZ") return VERTEX_POINT_XYZ;
+    return -1;
+}
+
+std::shared_ptr<Vertex> CreateVertex(int type) {
+    switch (type) {
+        case VERTEX_POSE: return std::make_shared<VertexPose>();
+        case VERTEX_SPEED_BIAS: return std::make_shared<VertexSpeedBias>();
+        case VERTEX_INVERSE_DEPTH: return std::make_shared<VertexInverseDepth>();
+        case VERTEX_POINT_XYZ: return std::make_shared<VertexPointXYZ>();
+        default: return nullptr;
+    }
+}
+
+void WriteLoss(std::ostream &os, const LossFunction *loss) {
+    int32_t type = LOSS_NONE;
+    double delta = 0.;
+    if (auto huber = dynamic_cast<const HuberLoss *>(loss)) {
+        type = LOSS_HUBER;
+        delta = huber->Delta();
+    } else if (auto cauchy = dynamic_cast<const CauchyLoss *>(loss)) {
+        type = LOSS_CAUCHY;
+        delta = cauchy->Delta();
+    } else if (auto tukey = dynamic_cast<const TukeyLoss *>(loss)) {
+        type = LOSS_TUKEY;
+        delta = tukey->Delta();
+    } else if (loss) {
+        type = LOSS_TRIVAL;
+    }
+    Write(os, type);
+    Write(os, delta);
+}
+
+std::shared_ptr<LossFunction> CreateLoss(int type, double delta) {
+    switch (type) {
+        case LOSS_TRIVAL: return std::make_shared<TrivalLoss>();
+        case LOSS_HUBER: return std::make_shared<HuberLoss>(delta);
+        case LOSS_CAUCHY: return std::make_shared<CauchyLoss>(delta);
+        case LOSS_TUKEY: return std::make_shared<TukeyLoss>(delta);
+        default: return nullptr;
+    }
+}
+
+/// EdgeImu 计算残差只用到预积分的结果，不需要原始的 IMU 数据
+void WritePreIntegration(std::ostream &os, const IntegrationBase &pre_integration) {
+    Write(os, pre_integration.sum_dt);
+    WriteDoubles(os, pre_integration.linearized_ba.data(), 3);
+    WriteDoubles(os, pre_integration.linearized_bg.data(), 3);
+    WriteDoubles(os, pre_integration.delta_p.data(), 3);
+    WriteDoubles(os, pre_integration.delta_q.coeffs().data(), 4);
+    WriteDoubles(os, pre_integration.delta_v.data(), 3);
+    WriteDoubles(os, pre_integration.jacobian.data(), 15 * 15);
+    WriteDoubles(os, pre_integration.covariance.data(), 15 * 15);
+}
+
+std::shared_ptr<IntegrationBase> ReadPreIntegration(std::istream &is) {
+    double sum_dt;
+    Eigen::Vector3d ba, bg;
+    if (!Read(is, sum_dt) || !ReadDoubles(is, ba.data(), 3) || !ReadDoubles(is, bg.data(), 3))
+        return nullptr;
+    std::shared_ptr<IntegrationBase> pre_integration = std::make_shared<IntegrationBase>(
+        Eigen::Vector3d::Zero(), Eigen::Vector3d::Zero(), ba, bg);
+    pre_integration->sum_dt = sum_dt;
+    if (!ReadDoubles(is, pre_integration->delta_p.data(), 3) ||
+        !ReadDoubles(is, pre_integration->delta_q.coeffs().data(), 4) ||
+        !ReadDoubles(is, pre_integration->delta_v.data(), 3) ||
+        !ReadDoubles(is, pre_integration->jacobian.data(), 15 * 15) ||
+        !ReadDoubles(is, pre_integration->covariance.data(), 15 * 15))
+        return nullptr;
+    return pre_integration;
+}
+
+}
+
+bool Problem::SaveSnapshot(std::ostream &os) const {
+    os.write(kSnapshotMagic, sizeof(kSnapshotMagic));
+    Write(os, kSnapshotVersion);
+    Write(os, int32_t(problemType_));
+    WriteDoubles(os, G.data(), 3);
+
+    // 顶点和边都按 id 排序，同一个问题每次写出的文件相同
+    std::vector<std::shared_ptr<Vertex>> vertices;
+    vertices.reserve(num_vertices_);
+    for (const auto &vertex : vertex_arena_) {
+        if (vertex)
+            vertices.push_back(vertex);
+    }
+    std::sort(vertices.begin(), vertices.end(), [](const std::shared_ptr<Vertex> &a, const std::shared_ptr<Vertex> &b) {
+        return a->Id() < b->Id();
+    });
+
+    Write(os, uint64_t(vertices.size()));
+    for (const auto &item : vertices) {
+        const Vertex &vertex = *item;
+        int32_t type = VertexType(vertex);
+        if (type < 0) {
+            std::cerr << "Snapshot: unsupported vertex type " << vertex.TypeInfo() << std::endl;
+            return false;
+        }
+        Write(os, uint64_t(vertex.Id()));
+        Write(os, type);
+        Write(os, int32_t(vertex.IsFixed()));
+        Write(os, int32_t(vertex.Dimension()));
+        WriteDoubles(os, vertex.Parameters().data(), vertex.Dimension());
+    }
+
+    std::vector<std::shared_ptr<Edge>> edges;
+    edges.reserve(num_edges_);
+    for (const auto &edge : edge_arena_) {
+        if (edge)
+            edges.push_back(edge);
+    }
+    std::sort(edges.begin(), edges.end(), [](const std::shared_ptr<Edge> &a, const std::shared_ptr<Edge> &b) {
+        return a->Id() < b->Id();
+    });
+
+    Write(os, uint64_t(edges.size()));
+    for (const auto &edge : edges) {
+        std::string type_info = edge->TypeInfo();
+        int32_t type = -1;
+        if (type_info == "EdgeReprojection") type = EDGE_REPROJECTION;
+        else if (type_info == "EdgeImu") type = EDGE_IMU;
+        else if (type_info == "EdgeSE3Prior") type = EDGE_SE3_PRIOR;
+        if (type < 0) {
+            std::cerr << "Snapshot: unsupported edge type " << type_info << std::endl;
+            return false;
+        }
+
+        Write(os, type);
+        std::vector<std::shared_ptr<Vertex>> vertices = edge->Verticies();
+        Write(os, uint32_t(vertices.size()));
+        for (const auto &vertex : vertices) {
+            Write(os, uint64_t(vertex->Id()));
+        }
+        WriteLoss(os, edge->GetLossFunction());
+        MatXX information = edge->Information();
+        Write(os, int32_t(information.rows()));
+        WriteDoubles(os, information.data(), information.size());
+
+        if (type == EDGE_REPROJECTION) {
+            const EdgeReprojection &reprojection = static_cast<const EdgeReprojection &>(*edge);
+            WriteDoubles(os, reprojection.PtsI().data(), 3);
+            WriteDoubles(os, reprojection.PtsJ().data(), 3);
+        } else if (type == EDGE_IMU) {
+            WritePreIntegration(os, *static_cast<const EdgeImu &>(*edge).PreIntegration());
+        } else {
+            const EdgeSE3Prior &prior = static_cast<const EdgeSE3Prior &>(*edge);
+            WriteDoubles(os, prior.Pp().data(), 3);
+            WriteDoubles(os, prior.Qp().coeffs().data(), 4);
+        }
+    }
+
+    WriteMatrix(os, H_prior_);
+    WriteMatrix(os, b_prior_);
+    WriteMatrix(os, err_prior_);
+    WriteMatrix(os, Jt_prior_inv_);
+    return bool(os);
+}
+
+bool Problem::SaveSnapshot(const std::string &path) const {
+    std::ofstream file(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "Snapshot: cannot open " << path << std::endl;
+        return false;
+    }
+    return SaveSnapshot(file);
+}
+
+bool Problem::LoadSnapshot(std::istream &is, std::vector<std::shared_ptr<Vertex>> *vertices) {
+    if (num_vertices_ > 0 || num_edges_ > 0) {
+        std::cerr << "Snapshot: problem is not empty" << std::endl;
+        return false;
+    }
+
+    char magic[sizeof(kSnapshotMagic)];
+    uint32_t version = 0;
+    int32_t problem_type = 0;
+    Eigen::Vector3d gravity;
+    if (!is.read(magic, sizeof(magic)) || std::memcmp(magic, kSnapshotMagic, sizeof(magic)) != 0 ||
+        !Read(is, version) || version != kSnapshotVersion) {
+        std::cerr << "Snapshot: bad header" << std::endl;
+        return false;
+    }
+    if (!Read(is, problem_type) || problem_type != int32_t(problemType_) || !ReadDoubles(is, gravity.data(), 3)) {
+        std::cerr << "Snapshot: problem type mismatch" << std::endl;
+        return false;
+    }
+
+    // 按原来的 id 顺序创建顶点，新的 id 保持相同的相对顺序，ordering 也就与原问题一致
+    uint64_t num_vertices = 0;
+    if (!Read(is, num_vertices))
+        return false;
+    std::unordered_map<uint64_t, std::shared_ptr<Vertex>> id_to_vertex;
+    for (uint64_t i = 0; i < num_vertices; ++i) {
+        uint64_t id;
+        int32_t type, fixed, dim;
+        if (!Read(is, id) || !Read(is, type) || !Read(is, fixed) || !Read(is, dim))
+            return false;
+        std::shared_ptr<Vertex> vertex = CreateVertex(type);
+        if (!vertex || vertex->Dimension() != dim) {
+            std::cerr << "Snapshot: bad vertex " << id << std::endl;
+            return false;
+        }
+        if (!ReadDoubles(is, vertex->Parameters().data(), dim))
+            return false;
+        vertex->SetFixed(fixed != 0);
+        AddVertex(vertex);
+        id_to_vertex[id] = vertex;
+        if (vertices)
+            vertices->push_back(vertex);
+    }
+
+    uint64_t num_edges = 0;
+    if (!Read(is, num_edges))
+        return false;
+    bool has_imu = false;
+    std::map<std::pair<int32_t, double>, std::shared_ptr<LossFunction>> losses;
+    for (uint64_t i = 0; i < num_edges; ++i) {
+        int32_t type, loss_type, info_dim;
+        uint32_t edge_num_vertices;
+        double loss_delta;
+        if (!Read(is, type) || !Read(is, edge_num_vertices))
+            return false;
+        std::vector<std::shared_ptr<Vertex>> edge_vertices;
+        for (uint32_t j = 0; j < edge_num_vertices; ++j) {
+            uint64_t id;
+            if (!Read(is, id) || !id_to_vertex.count(id))
+                return false;
+            edge_vertices.push_back(id_to_vertex[id]);
+        }
+        if (!Read(is, loss_type) || !Read(is, loss_delta) || !Read(is, info_dim) || info_dim < 0)
+            return false;
+        MatXX information(info_dim, info_dim);
+        if (!ReadDoubles(is, information.data(), information.size()))
+            return false;
+
+        std::shared_ptr<Edge> edge;
+        if (type == EDGE_REPROJECTION) {
+            Vec3 pts_i, pts_j;
+            if (!ReadDoubles(is, pts_i.data(), 3) || !ReadDoubles(is, pts_j.data(), 3))
+                return false;
+            edge = std::make_shared<EdgeReprojection>(pts_i, pts_j);
+        } else if (type == EDGE_IMU) {
+            std::shared_ptr<IntegrationBase> pre_integration = ReadPreIntegration(is);
+            if (!pre_integration)
+                return false;
+            snapshot_pre_integrations_.push_back(pre_integration);
+            edge = std::make_shared<EdgeImu>(pre_integration.get());
+            has_imu = true;
+        } else if (type == EDGE_SE3_PRIOR) {
+            Vec3 p;
+            Qd q;
+            if (!ReadDoubles(is, p.data(), 3) || !ReadDoubles(is, q.coeffs().data(), 4))
+                return false;
+            edge = std::make_shared<EdgeSE3Prior>(p, q);
+        } else {
+            std::cerr << "Snapshot: bad edge type " << type << std::endl;
+            return false;
+        }
+
+        if (!edge->SetVertex(edge_vertices) || info_dim != edge->Residual().size()) {
+            std::cerr << "Snapshot: bad edge " << i << std::endl;
+            return false;
+        }
+        edge->SetInformation(information);
+
+        // 参数相同的核函数共用一个对象
+        if (loss_type != LOSS_NONE) {
+            std::shared_ptr<LossFunction> &loss = losses[std::make_pair(loss_type, loss_delta)];
+            if (!loss) {
+                loss = CreateLoss(loss_type, loss_delta);
+                if (!loss)
+                    return false;
+                snapshot_losses_.push_back(loss);
+            }
+            edge->SetLossFunction(loss.get());
+        }
+        AddEdge(edge);
+    }
+
+    if (!ReadMatrix(is, H_prior_) || !ReadVector(is, b_prior_) || !ReadVector(is, err_prior_) ||
+        !ReadMatrix(is, Jt_prior_inv_))
+        return false;
+
+    // IMU 残差中的重力取自全局的 G
+    if (has_imu)
+        G = gravity;
+    return true;
+}
+
+bool Problem::LoadSnapshot(const std::string &path, std::vector<std::shared_ptr<Vertex>> *vertices) {
+    std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Snapshot: cannot open " << path << std::endl;
+        return false;
+    }
+    return LoadSnapshot(file, vertices);
+}
+
+}
+}
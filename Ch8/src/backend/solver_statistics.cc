@@ -0,0 +1,117 @@
+#include <chrono>
+#include "backend/solver_statistics.h"
+
+namespace myslam {
+namespace backend {
+
+SolverStatistics::SolverStatistics(size_t capacity)
+    : head_(0), tail_(0), dropped_(0), solve_count_(0) {
+    size_t size = 1;
+    while (size < capacity) size <<= 1;
+    buffer_.resize(size);
+    mask_ = size - 1;
+}
+
+SolverStatistics::~SolverStatistics() {
+    StopFlush();
+}
+
+bool SolverStatistics::Push(const SolverRecord &record) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) > mask_) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    buffer_[head & mask_] = record;
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+bool SolverStatistics::Pop(SolverRecord &record) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail == head_.load(std::memory_order_acquire))
+        return false;
+    record = buffer_[tail & mask_];
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+size_t SolverStatistics::Drain(std::vector<SolverRecord> &records) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    size_t head = head_.load(std::memory_order_acquire);
+    for (size_t i = tail; i != head; ++i) {
+        records.push_back(buffer_[i & mask_]);
+    }
+    tail_.store(head, std::memory_order_release);
+    return head - tail;
+}
+
+bool SolverStatistics::StartFlush(const std::string &path, FileFormat format, int period_ms) {
+    StopFlush();
+
+    std::ios::openmode mode = std::ios::out | std::ios::trunc;
+    if (format == FileFormat::BINARY)
+        mode |= std::ios::binary;
+    file_.open(path.c_str(), mode);
+    if (!file_.is_open())
+        return false;
+    format_ = format;
+    if (format_ == FileFormat::CSV)
+        WriteCsvHeader(file_);
+
+    stop_flush_ = false;
+    flush_thread_ = std::thread(&SolverStatistics::FlushLoop, this, period_ms);
+    return true;
+}
+
+void SolverStatistics::StopFlush() {
+    if (!flush_thread_.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(flush_mutex_);
+        stop_flush_ = true;
+    }
+    flush_cv_.notify_all();
+    flush_thread_.join();
+    file_.close();
+}
+
+void SolverStatistics::FlushLoop(int period_ms) {
+    std::unique_lock<std::mutex> lock(flush_mutex_);
+    while (!stop_flush_) {
+        flush_cv_.wait_for(lock, std::chrono::milliseconds(period_ms));
+        FlushOnce();
+    }
+}
+
+void SolverStatistics::FlushOnce() {
+    flush_records_.clear();
+    if (Drain(flush_records_) == 0)
+        return;
+
+    if (format_ == FileFormat::BINARY) {
+        file_.write(reinterpret_cast<const char *>(flush_records_.data()),
+                    flush_records_.size() * sizeof(SolverRecord));
+    } else {
+        for (const auto &record : flush_records_) {
+            WriteCsv(file_, record);
+        }
+    }
+    file_.flush();
+}
+
+void SolverStatistics::WriteCsvHeader(std::ostream &os) {
+    os << "type,solve_id,solver,iteration,accepted,chi2,lambda,"
+          "hessian_ms,schur_ms,linear_ms,residual_ms,total_ms,pose_dim,landmark_dim,num_edges,num_vertices\n";
+}
+
+void SolverStatistics::WriteCsv(std::ostream &os, const SolverRecord &record) {
+    os << record.type << ',' << record.solve_id << ',' << record.solver << ','
+       << record.iteration << ',' << record.accepted << ','
+       << record.chi2 << ',' << record.lambda << ','
+       << record.hessian_ms << ',' << record.schur_ms << ',' << record.linear_ms << ',' << record.residual_ms << ',' << record.total_ms << ','
+       << record.pose_dim << ',' << record.landmark_dim << ',' << record.num_edges << ',' << record.num_vertices << '\n';
+}
+
+}
+}
@@ -0,0 +1,85 @@
+#include <algorithm>
+#include "backend/thread_pool.h"
+
+namespace myslam {
+namespace backend {
+
+ThreadPool::ThreadPool(int num_threads) {
+    if (num_threads <= 0)
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    num_threads_ = num_threads;
+
+    // 调用者作为 0 号线程，这里只创建其余线程
+    for (int i = 1; i < num_threads_; ++i) {
+        workers_.emplace_back(&ThreadPool::WorkerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_task_.notify_all();
+    for (auto &t : workers_) {
+        t.join();
+    }
+}
+
+void ThreadPool::Run(const Task &task) {
+    if (workers_.empty()) {
+        task(0, 1);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        task_ = &task;
+        pending_ = static_cast<int>(workers_.size());
+        ++generation_;
+    }
+    cv_task_.notify_all();
+
+    task(0, num_threads_);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_done_.wait(lock, [this] { return pending_ == 0; });
+    task_ = nullptr;
+}
+
+void ThreadPool::ParallelFor(int n, const std::function<void(int thd_id, int begin, int end)> &func) {
+    if (n <= 0)
+        return;
+    Run([n, &func](int thd_id, int thd_num) {
+        int begin = static_cast<int>(static_cast<long>(n) * thd_id / thd_num);
+        int end = static_cast<int>(static_cast<long>(n) * (thd_id + 1) / thd_num);
+        if (begin < end)
+            func(thd_id, begin, end);
+    });
+}
+
+void ThreadPool::WorkerLoop(int thd_id) {
+    unsigned long last_generation = 0;
+    while (true) {
+        const Task *task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_task_.wait(lock, [this, last_generation] { return stop_ || generation_ != last_generation; });
+            if (stop_)
+                return;
+            last_generation = generation_;
+            task = task_;
+        }
+
+        (*task)(thd_id, num_threads_);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--pending_ == 0)
+                cv_done_.notify_one();
+        }
+    }
+}
+
+}
+}
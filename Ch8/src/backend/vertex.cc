@@ -25,7 +25,7 @@ int Vertex::LocalDimension() const {
     return local_dimension_;
 }
 
-void Vertex::Plus(const VecX &delta) {
+void Vertex::Plus(const Eigen::Ref<const VecX> &delta) {
     parameters_ += delta;
 }
 
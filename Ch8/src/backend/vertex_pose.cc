@@ -1,11 +1,14 @@
+#include <cassert>
 #include "backend/vertex_pose.h"
 #include "../thirdparty/Sophus/sophus/se3.hpp"
 //#include <iostream>
 namespace myslam {
 namespace backend {
 
-void VertexPose::Plus(const VecX &delta) {
-    VecX &parameters = Parameters();
+void VertexPose::Plus(const Eigen::Ref<const VecX> &delta_x) {
+    assert(delta_x.size() == kLocalDimension);
+    Eigen::Map<const DeltaType> delta(delta_x.data());
+    Eigen::Map<ParameterType> parameters = FixedParameters();
     parameters.head<3>() += delta.head<3>();
     Qd q(parameters[6], parameters[3], parameters[4], parameters[5]);
     q = q * Sophus::SO3d::exp(Vec3(delta[3], delta[4], delta[5])).unit_quaternion();  // right multiplication with so3
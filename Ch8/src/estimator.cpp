@@ -1,13 +1,8 @@
 #include "estimator.h"
 
-#include "backend/vertex_inverse_depth.h"
-#include "backend/vertex_pose.h"
-#include "backend/vertex_speedbias.h"
-#include "backend/edge_reprojection.h"
-#include "backend/edge_imu.h"
-
 #include <ostream>
 #include <fstream>
+#include <sstream>
 
 using namespace myslam;
 
@@ -40,6 +35,14 @@ void Estimator::setParameter()
     cout << "1 Estimator::setParameter FOCAL_LENGTH: " << FOCAL_LENGTH << endl;
     f_manager.setRic(ric);
     project_sqrt_info_ = FOCAL_LENGTH / 1.5 * Matrix2d::Identity();
+    thread_pool_ = std::make_shared<backend::ThreadPool>(NUM_THREADS);
+    hessian_tuner_ = backend::Problem::CreateHessianBuildTuner();
+    // 失败重启时会再次调用 setParameter，统计文件只在第一次时清空
+    if (!solver_stats_)
+    {
+        solver_stats_ = std::make_shared<backend::SolverStatistics>();
+        solver_stats_->StartFlush("./solver_stats.csv");
+    }
     td = TD;
 }
 
@@ -94,6 +97,7 @@ void Estimator::clearState()
     last_marginalization_parameter_blocks.clear();
 
     f_manager.clearState();
+    resetBackendProblem();
 
     failure_occur = 0;
     relocalization_info = 0;
@@ -690,110 +694,312 @@ bool Estimator::failureDetection()
     return false;
 }
 
-void Estimator::MargOldFrame()
+void Estimator::resetBackendProblem()
 {
-    backend::LossFunction *lossfunction;
-    lossfunction = new backend::CauchyLoss(1.0);
+    // 先释放 problem，再释放它引用的顶点、边和核函数
+    backend_problem_.reset();
+    backend_ext_.reset();
+    for (int i = 0; i < WINDOW_SIZE + 1; i++)
+    {
+        backend_cams_[i].reset();
+        backend_vbs_[i].reset();
+        backend_imu_edges_[i].reset();
+    }
+    backend_landmarks_.clear();
+    backend_features_.clear();
+    backend_loss_.reset();
+    backend_stamp_ = 0;
+}
 
-    // step1. 构建 problem
-    backend::Problem problem(backend::Problem::ProblemType::SLAM_PROBLEM);
-    vector<shared_ptr<backend::VertexPose>> vertexCams_vec;
-    vector<shared_ptr<backend::VertexSpeedBias>> vertexVB_vec;
-    int pose_dim = 0;
+void Estimator::syncBackendStates()
+{
+    if (!backend_problem_)
+    {
+        backend_problem_.reset(new backend::Problem(backend::Problem::ProblemType::SLAM_PROBLEM));
+        backend_problem_->SetThreadPool(thread_pool_);
+        backend_problem_->SetHessianBuildStrategy(backend::Problem::HessianBuildStrategy(HESSIAN_STRATEGY));
+        backend_problem_->SetHessianBuildTuner(hessian_tuner_);
+        backend_problem_->SetDeterministic(DETERMINISTIC != 0);
+        backend_problem_->SetLinearSolverType(backend::Problem::LinearSolverType(LINEAR_SOLVER));
+        backend_problem_->SetSpeculativeLM(SPECULATIVE_LM);
+        backend_problem_->SetMixedPrecision(MIXED_PRECISION != 0);
+        if (RELINEARIZE_THRESHOLD > 0)
+        {
+            backend_problem_->SetLazyRelinearization(true);
+            for (const char *type : {"VertexPose", "VertexSpeedBias", "VertexInverseDepth"})
+                backend_problem_->SetRelinearizeThreshold(type, RELINEARIZE_THRESHOLD);
+        }
+        if ((MIXED_PRECISION != 0 || RELINEARIZE_THRESHOLD > 0) &&
+            HESSIAN_STRATEGY != int(backend::Problem::HessianBuildStrategy::LOCK_FREE))
+        {
+            // 两者只有 LOCK_FREE 实现，problem 会忽略配置的构建方式
+            std::cerr << "hessian_strategy " << HESSIAN_STRATEGY
+                      << " overridden by lock-free build (mixed_precision / relinearize_threshold)" << std::endl;
+        }
+        backend_problem_->SetTrustRegionStep(backend::Problem::TrustRegionStep(TRUST_REGION_STEP));
+        backend_problem_->SetSolverStatistics(solver_stats_);
+        backend_loss_.reset(new backend::CauchyLoss(1.0));
+        //    backend_loss_.reset(new backend::TukeyLoss(1.0));
+    }
+    if (!backend_arena_)
+        backend_arena_ = std::make_shared<backend::FrameArena>();
 
     // 先把 外参数 节点加入图优化，这个节点在以后一直会被用到，所以我们把他放在第一个
-    shared_ptr<backend::VertexPose> vertexExt(new backend::VertexPose());
+    if (!backend_ext_)
     {
-        Eigen::VectorXd pose(7);
-        pose << para_Ex_Pose[0][0], para_Ex_Pose[0][1], para_Ex_Pose[0][2], para_Ex_Pose[0][3], para_Ex_Pose[0][4], para_Ex_Pose[0][5], para_Ex_Pose[0][6];
-        vertexExt->SetParameters(pose);
-        problem.AddVertex(vertexExt);
-        pose_dim += vertexExt->LocalDimension();
+        backend_ext_ = backend::MakeArenaShared<backend::VertexPose>(backend_arena_);
+        backend_problem_->AddVertex(backend_ext_);
     }
+    backend_ext_->FixedParameters() = Eigen::Map<const Eigen::Matrix<double, 7, 1>>(para_Ex_Pose[0]);
 
+    // 新帧的顶点 id 总是最大的，ordering 中 pose 的顺序和窗口中帧的顺序、先验的顺序保持一致
     for (int i = 0; i < WINDOW_SIZE + 1; i++)
     {
-        shared_ptr<backend::VertexPose> vertexCam(new backend::VertexPose());
-        Eigen::VectorXd pose(7);
-        pose << para_Pose[i][0], para_Pose[i][1], para_Pose[i][2], para_Pose[i][3], para_Pose[i][4], para_Pose[i][5], para_Pose[i][6];
-        vertexCam->SetParameters(pose);
-        vertexCams_vec.push_back(vertexCam);
-        problem.AddVertex(vertexCam);
-        pose_dim += vertexCam->LocalDimension();
+        if (!backend_cams_[i])
+        {
+            backend_cams_[i] = backend::MakeArenaShared<backend::VertexPose>(backend_arena_);
+            backend_problem_->AddVertex(backend_cams_[i]);
+            backend_vbs_[i] = backend::MakeArenaShared<backend::VertexSpeedBias>(backend_arena_);
+            backend_problem_->AddVertex(backend_vbs_[i]);
+        }
+        backend_cams_[i]->FixedParameters() = Eigen::Map<const Eigen::Matrix<double, 7, 1>>(para_Pose[i]);
+        backend_vbs_[i]->FixedParameters() = Eigen::Map<const Eigen::Matrix<double, 9, 1>>(para_SpeedBias[i]);
+    }
+}
 
-        shared_ptr<backend::VertexSpeedBias> vertexVB(new backend::VertexSpeedBias());
-        Eigen::VectorXd vb(9);
-        vb << para_SpeedBias[i][0], para_SpeedBias[i][1], para_SpeedBias[i][2],
-            para_SpeedBias[i][3], para_SpeedBias[i][4], para_SpeedBias[i][5],
-            para_SpeedBias[i][6], para_SpeedBias[i][7], para_SpeedBias[i][8];
-        vertexVB->SetParameters(vb);
-        vertexVB_vec.push_back(vertexVB);
-        problem.AddVertex(vertexVB);
-        pose_dim += vertexVB->LocalDimension();
+void Estimator::syncBackendProblem()
+{
+    syncBackendStates();
+
+    if (!ESTIMATE_EXTRINSIC)
+    {
+        //ROS_DEBUG("fix extinsic param");
+        // TODO:: set Hessian prior to zero
+        backend_ext_->SetFixed();
+    }
+    else
+    {
+        backend_ext_->SetFixed(false);
     }
 
-    // IMU
+    // IMU, 预积分被替换(滑窗)或两端的帧变了(marg 次新帧后预积分合并)时重建
+    for (int j = 1; j < WINDOW_SIZE + 1; j++)
     {
-        if (pre_integrations[1]->sum_dt < 10.0)
+        int i = j - 1;
+        std::shared_ptr<backend::EdgeImu> &imuEdge = backend_imu_edges_[j];
+        bool valid = pre_integrations[j]->sum_dt <= 10.0;
+        if (imuEdge && (!valid || imuEdge->PreIntegration() != pre_integrations[j] ||
+                        imuEdge->GetVertex(0) != backend_cams_[i] || imuEdge->GetVertex(2) != backend_cams_[j]))
         {
-            std::shared_ptr<backend::EdgeImu> imuEdge(new backend::EdgeImu(pre_integrations[1]));
-            std::vector<std::shared_ptr<backend::Vertex>> edge_vertex;
-            edge_vertex.push_back(vertexCams_vec[0]);
-            edge_vertex.push_back(vertexVB_vec[0]);
-            edge_vertex.push_back(vertexCams_vec[1]);
-            edge_vertex.push_back(vertexVB_vec[1]);
-            imuEdge->SetVertex(edge_vertex);
-            problem.AddEdge(imuEdge);
+            backend_problem_->RemoveEdge(imuEdge);
+            imuEdge.reset();
         }
+        if (!valid || imuEdge)
+            continue;
+
+        imuEdge = backend::MakeArenaShared<backend::EdgeImu>(backend_arena_, pre_integrations[j]);
+        std::vector<std::shared_ptr<backend::Vertex>> edge_vertex;
+        edge_vertex.push_back(backend_cams_[i]);
+        edge_vertex.push_back(backend_vbs_[i]);
+        edge_vertex.push_back(backend_cams_[j]);
+        edge_vertex.push_back(backend_vbs_[j]);
+        imuEdge->SetVertex(edge_vertex);
+        backend_problem_->AddEdge(imuEdge);
     }
 
     // Visual Factor
+    ++backend_stamp_;
+    backend_features_.clear();
+    // 遍历每一个特征
+    for (auto &it_per_id : f_manager.feature)
     {
-        int feature_index = -1;
-        // 遍历每一个特征
-        for (auto &it_per_id : f_manager.feature)
+        it_per_id.used_num = it_per_id.feature_per_frame.size();
+        if (!(it_per_id.used_num >= 2 && it_per_id.start_frame < WINDOW_SIZE - 2))
+            continue;
+
+        int feature_index = backend_features_.size();
+        BackendLandmark &landmark = backend_landmarks_[it_per_id.feature_id];
+        if (!landmark.vertex)
         {
-            it_per_id.used_num = it_per_id.feature_per_frame.size();
-            if (!(it_per_id.used_num >= 2 && it_per_id.start_frame < WINDOW_SIZE - 2))
-                continue;
+            landmark.vertex = backend::MakeArenaShared<backend::VertexInverseDepth>(backend_arena_);
+            backend_problem_->AddVertex(landmark.vertex);
+        }
+        landmark.vertex->FixedParameters()[0] = para_Feature[feature_index][0];
+        landmark.stamp = backend_stamp_;
+        backend_features_.push_back(landmark.vertex);
 
-            ++feature_index;
+        // 首次观测帧变了(原来的首帧被滑出窗口)，所有边的 pts_i 都变了，全部重建
+        int imu_i = it_per_id.start_frame;
+        if (landmark.host != backend_cams_[imu_i])
+        {
+            for (auto &edge : landmark.edges)
+                backend_problem_->RemoveEdge(edge);
+            landmark.edges.clear();
+            landmark.targets.clear();
+            landmark.host = backend_cams_[imu_i];
+        }
+
+        // 已有的边和当前的观测都按帧的先后(即顶点 id)排列，依次比对，只增删变化的观测
+        std::vector<std::shared_ptr<backend::Vertex>> targets;
+        std::vector<std::shared_ptr<backend::EdgeReprojection>> edges;
+        Vector3d pts_i = it_per_id.feature_per_frame[0].point;
+        size_t k = 0;
+        for (int j = 1; j < it_per_id.used_num; j++)
+        {
+            std::shared_ptr<backend::Vertex> target = backend_cams_[imu_i + j];
+            for (; k < landmark.targets.size() && landmark.targets[k]->Id() < target->Id(); k++)
+                backend_problem_->RemoveEdge(landmark.edges[k]);
 
-            int imu_i = it_per_id.start_frame, imu_j = imu_i - 1;
-            if (imu_i != 0)
+            if (k < landmark.targets.size() && landmark.targets[k] == target)
+            {
+                targets.push_back(target);
+                edges.push_back(landmark.edges[k]);
+                k++;
                 continue;
+            }
 
-            Vector3d pts_i = it_per_id.feature_per_frame[0].point;
+            Vector3d pts_j = it_per_id.feature_per_frame[j].point;
 
-            shared_ptr<backend::VertexInverseDepth> verterxPoint(new backend::VertexInverseDepth());
-            VecX inv_d(1);
-            inv_d << para_Feature[feature_index][0];
-            verterxPoint->SetParameters(inv_d);
-            problem.AddVertex(verterxPoint);
+            std::shared_ptr<backend::EdgeReprojection> edge =
+                backend::MakeArenaShared<backend::EdgeReprojection>(backend_arena_, pts_i, pts_j);
+            std::vector<std::shared_ptr<backend::Vertex>> edge_vertex;
+            edge_vertex.push_back(landmark.vertex);
+            edge_vertex.push_back(landmark.host);
+            edge_vertex.push_back(target);
+            edge_vertex.push_back(backend_ext_);
+
+            edge->SetVertex(edge_vertex);
+            edge->SetInformation(project_sqrt_info_.transpose() * project_sqrt_info_);
+
+            edge->SetLossFunction(backend_loss_.get());
+            backend_problem_->AddEdge(edge);
+            targets.push_back(target);
+            edges.push_back(edge);
+        }
+        for (; k < landmark.targets.size(); k++)
+            backend_problem_->RemoveEdge(landmark.edges[k]);
+        landmark.targets.swap(targets);
+        landmark.edges.swap(edges);
+    }
 
-            // 遍历所有的观测
-            for (auto &it_per_frame : it_per_id.feature_per_frame)
-            {
-                imu_j++;
-                if (imu_i == imu_j)
-                    continue;
+    // 本帧不再参与优化的特征
+    for (auto it = backend_landmarks_.begin(); it != backend_landmarks_.end();)
+    {
+        if (it->second.stamp != backend_stamp_)
+        {
+            backend_problem_->RemoveVertex(it->second.vertex);
+            it = backend_landmarks_.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+void Estimator::removeBackendFrameEdges(int frame)
+{
+    std::shared_ptr<backend::Vertex> cam = backend_cams_[frame];
+    if (!backend_problem_ || !cam)
+        return;
 
-                Vector3d pts_j = it_per_frame.point;
+    for (int j = frame; j <= frame + 1 && j < WINDOW_SIZE + 1; j++)
+    {
+        if (backend_imu_edges_[j])
+        {
+            backend_problem_->RemoveEdge(backend_imu_edges_[j]);
+            backend_imu_edges_[j].reset();
+        }
+    }
 
-                std::shared_ptr<backend::EdgeReprojection> edge(new backend::EdgeReprojection(pts_i, pts_j));
-                std::vector<std::shared_ptr<backend::Vertex>> edge_vertex;
-                edge_vertex.push_back(verterxPoint);
-                edge_vertex.push_back(vertexCams_vec[imu_i]);
-                edge_vertex.push_back(vertexCams_vec[imu_j]);
-                edge_vertex.push_back(vertexExt);
+    for (auto &it : backend_landmarks_)
+    {
+        BackendLandmark &landmark = it.second;
+        bool remove_all = landmark.host == cam;
+        size_t n = 0;
+        for (size_t k = 0; k < landmark.edges.size(); k++)
+        {
+            if (remove_all || landmark.targets[k] == cam)
+            {
+                backend_problem_->RemoveEdge(landmark.edges[k]);
+                continue;
+            }
+            landmark.targets[n] = landmark.targets[k];
+            landmark.edges[n] = landmark.edges[k];
+            n++;
+        }
+        landmark.targets.resize(n);
+        landmark.edges.resize(n);
+        if (remove_all)
+            landmark.host.reset();
+    }
+}
 
-                edge->SetVertex(edge_vertex);
-                edge->SetInformation(project_sqrt_info_.transpose() * project_sqrt_info_);
+void Estimator::slideBackendProblem()
+{
+    // 还没有进行过后端优化
+    if (!backend_problem_ || !backend_cams_[0])
+        return;
 
-                edge->SetLossFunction(lossfunction);
-                problem.AddEdge(edge);
+    if (marginalization_flag == MARGIN_OLD)
+    {
+        // 以第 0 帧为首帧的特征已经在 MargOldFrame 中被 marg 掉了
+        for (auto it = backend_landmarks_.begin(); it != backend_landmarks_.end();)
+        {
+            if (it->second.host == backend_cams_[0])
+            {
+                backend_problem_->RemoveVertex(it->second.vertex);
+                it = backend_landmarks_.erase(it);
             }
+            else
+            {
+                ++it;
+            }
+        }
+        removeBackendFrameEdges(0);
+        backend_problem_->RemoveVertex(backend_cams_[0]);
+        backend_problem_->RemoveVertex(backend_vbs_[0]);
+
+        for (int i = 0; i < WINDOW_SIZE; i++)
+        {
+            backend_cams_[i].swap(backend_cams_[i + 1]);
+            backend_vbs_[i].swap(backend_vbs_[i + 1]);
+            backend_imu_edges_[i].swap(backend_imu_edges_[i + 1]);
         }
+        backend_cams_[WINDOW_SIZE].reset();
+        backend_vbs_[WINDOW_SIZE].reset();
+        backend_imu_edges_[WINDOW_SIZE].reset();
+    }
+    else
+    {
+        // 次新帧的观测直接丢弃，最新帧的顶点前移一位，其预积分在下一次同步时重建
+        removeBackendFrameEdges(WINDOW_SIZE - 1);
+        backend_problem_->RemoveVertex(backend_cams_[WINDOW_SIZE - 1]);
+        backend_problem_->RemoveVertex(backend_vbs_[WINDOW_SIZE - 1]);
+
+        backend_cams_[WINDOW_SIZE - 1] = backend_cams_[WINDOW_SIZE];
+        backend_vbs_[WINDOW_SIZE - 1] = backend_vbs_[WINDOW_SIZE];
+        backend_cams_[WINDOW_SIZE].reset();
+        backend_vbs_[WINDOW_SIZE].reset();
+    }
+
+    // 本帧 marg 之后的对象都已释放，统计这一帧的分配
+    backend_arena_stats_ = backend_arena_->EndFrame();
+}
+
+void Estimator::MargOldFrame()
+{
+    // step1. 同步 problem, double2vector 之后窗口内的状态被调整过
+    syncBackendStates();
+    for (size_t i = 0; i < backend_features_.size(); ++i)
+    {
+        backend_features_[i]->FixedParameters()[0] = para_Feature[i][0];
+    }
+    backend::Problem &problem = *backend_problem_;
+    int pose_dim = backend_ext_->LocalDimension();
+    for (int i = 0; i < WINDOW_SIZE + 1; i++)
+    {
+        pose_dim += backend_cams_[i]->LocalDimension() + backend_vbs_[i]->LocalDimension();
     }
 
     // 先验
@@ -818,9 +1024,10 @@ void Estimator::MargOldFrame()
         }
     }
 
+    // 和第 0 帧相连的边只有第 0 帧的预积分和以第 0 帧为首帧的特征的重投影边
     std::vector<std::shared_ptr<backend::Vertex>> marg_vertex;
-    marg_vertex.push_back(vertexCams_vec[0]);
-    marg_vertex.push_back(vertexVB_vec[0]);
+    marg_vertex.push_back(backend_cams_[0]);
+    marg_vertex.push_back(backend_vbs_[0]);
     problem.Marginalize(marg_vertex, pose_dim);
     Hprior_ = problem.GetHessianPrior();
     bprior_ = problem.GetbPrior();
@@ -829,43 +1036,13 @@ void Estimator::MargOldFrame()
 }
 void Estimator::MargNewFrame()
 {
-
-    // step1. 构建 problem
-    backend::Problem problem(backend::Problem::ProblemType::SLAM_PROBLEM);
-    vector<shared_ptr<backend::VertexPose>> vertexCams_vec;
-    vector<shared_ptr<backend::VertexSpeedBias>> vertexVB_vec;
-    //    vector<backend::Point3d> points;
-    int pose_dim = 0;
-
-    // 先把 外参数 节点加入图优化，这个节点在以后一直会被用到，所以我们把他放在第一个
-    shared_ptr<backend::VertexPose> vertexExt(new backend::VertexPose());
-    {
-        Eigen::VectorXd pose(7);
-        pose << para_Ex_Pose[0][0], para_Ex_Pose[0][1], para_Ex_Pose[0][2], para_Ex_Pose[0][3], para_Ex_Pose[0][4], para_Ex_Pose[0][5], para_Ex_Pose[0][6];
-        vertexExt->SetParameters(pose);
-        problem.AddVertex(vertexExt);
-        pose_dim += vertexExt->LocalDimension();
-    }
-
+    // step1. 同步 problem
+    syncBackendStates();
+    backend::Problem &problem = *backend_problem_;
+    int pose_dim = backend_ext_->LocalDimension();
     for (int i = 0; i < WINDOW_SIZE + 1; i++)
     {
-        shared_ptr<backend::VertexPose> vertexCam(new backend::VertexPose());
-        Eigen::VectorXd pose(7);
-        pose << para_Pose[i][0], para_Pose[i][1], para_Pose[i][2], para_Pose[i][3], para_Pose[i][4], para_Pose[i][5], para_Pose[i][6];
-        vertexCam->SetParameters(pose);
-        vertexCams_vec.push_back(vertexCam);
-        problem.AddVertex(vertexCam);
-        pose_dim += vertexCam->LocalDimension();
-
-        shared_ptr<backend::VertexSpeedBias> vertexVB(new backend::VertexSpeedBias());
-        Eigen::VectorXd vb(9);
-        vb << para_SpeedBias[i][0], para_SpeedBias[i][1], para_SpeedBias[i][2],
-            para_SpeedBias[i][3], para_SpeedBias[i][4], para_SpeedBias[i][5],
-            para_SpeedBias[i][6], para_SpeedBias[i][7], para_SpeedBias[i][8];
-        vertexVB->SetParameters(vb);
-        vertexVB_vec.push_back(vertexVB);
-        problem.AddVertex(vertexVB);
-        pose_dim += vertexVB->LocalDimension();
+        pose_dim += backend_cams_[i]->LocalDimension() + backend_vbs_[i]->LocalDimension();
     }
 
     // 先验
@@ -889,10 +1066,13 @@ void Estimator::MargNewFrame()
         }
     }
 
+    // 次新帧只 marg 先验，它的 imu 和视觉观测直接丢弃
+    removeBackendFrameEdges(WINDOW_SIZE - 1);
+
     std::vector<std::shared_ptr<backend::Vertex>> marg_vertex;
     // 把窗口倒数第二个帧 marg 掉
-    marg_vertex.push_back(vertexCams_vec[WINDOW_SIZE - 1]);
-    marg_vertex.push_back(vertexVB_vec[WINDOW_SIZE - 1]);
+    marg_vertex.push_back(backend_cams_[WINDOW_SIZE - 1]);
+    marg_vertex.push_back(backend_vbs_[WINDOW_SIZE - 1]);
     problem.Marginalize(marg_vertex, pose_dim);
     Hprior_ = problem.GetHessianPrior();
     bprior_ = problem.GetbPrior();
@@ -901,121 +1081,9 @@ void Estimator::MargNewFrame()
 }
 void Estimator::problemSolve()
 {
-    backend::LossFunction *lossfunction;
-    lossfunction = new backend::CauchyLoss(1.0);
-    //    lossfunction = new backend::TukeyLoss(1.0);
-
-    // step1. 构建 problem
-    backend::Problem problem(backend::Problem::ProblemType::SLAM_PROBLEM);
-    vector<shared_ptr<backend::VertexPose>> vertexCams_vec;
-    vector<shared_ptr<backend::VertexSpeedBias>> vertexVB_vec;
-    int pose_dim = 0;
-
-    // 先把 外参数 节点加入图优化，这个节点在以后一直会被用到，所以我们把他放在第一个
-    shared_ptr<backend::VertexPose> vertexExt(new backend::VertexPose());
-    {
-        Eigen::VectorXd pose(7);
-        pose << para_Ex_Pose[0][0], para_Ex_Pose[0][1], para_Ex_Pose[0][2], para_Ex_Pose[0][3], para_Ex_Pose[0][4], para_Ex_Pose[0][5], para_Ex_Pose[0][6];
-        vertexExt->SetParameters(pose);
-
-        if (!ESTIMATE_EXTRINSIC)
-        {
-            //ROS_DEBUG("fix extinsic param");
-            // TODO:: set Hessian prior to zero
-            vertexExt->SetFixed();
-        }
-        else{
-            //ROS_DEBUG("estimate extinsic param");
-        }
-        problem.AddVertex(vertexExt);
-        pose_dim += vertexExt->LocalDimension();
-    }
-
-    for (int i = 0; i < WINDOW_SIZE + 1; i++)
-    {
-        shared_ptr<backend::VertexPose> vertexCam(new backend::VertexPose());
-        Eigen::VectorXd pose(7);
-        pose << para_Pose[i][0], para_Pose[i][1], para_Pose[i][2], para_Pose[i][3], para_Pose[i][4], para_Pose[i][5], para_Pose[i][6];
-        vertexCam->SetParameters(pose);
-        vertexCams_vec.push_back(vertexCam);
-        problem.AddVertex(vertexCam);
-        pose_dim += vertexCam->LocalDimension();
-
-        shared_ptr<backend::VertexSpeedBias> vertexVB(new backend::VertexSpeedBias());
-        Eigen::VectorXd vb(9);
-        vb << para_SpeedBias[i][0], para_SpeedBias[i][1], para_SpeedBias[i][2],
-            para_SpeedBias[i][3], para_SpeedBias[i][4], para_SpeedBias[i][5],
-            para_SpeedBias[i][6], para_SpeedBias[i][7], para_SpeedBias[i][8];
-        vertexVB->SetParameters(vb);
-        vertexVB_vec.push_back(vertexVB);
-        problem.AddVertex(vertexVB);
-        pose_dim += vertexVB->LocalDimension();
-    }
-
-    // IMU
-    for (int i = 0; i < WINDOW_SIZE; i++)
-    {
-        int j = i + 1;
-        if (pre_integrations[j]->sum_dt > 10.0)
-            continue;
-
-        std::shared_ptr<backend::EdgeImu> imuEdge(new backend::EdgeImu(pre_integrations[j]));
-        std::vector<std::shared_ptr<backend::Vertex>> edge_vertex;
-        edge_vertex.push_back(vertexCams_vec[i]);
-        edge_vertex.push_back(vertexVB_vec[i]);
-        edge_vertex.push_back(vertexCams_vec[j]);
-        edge_vertex.push_back(vertexVB_vec[j]);
-        imuEdge->SetVertex(edge_vertex);
-        problem.AddEdge(imuEdge);
-    }
-
-    // Visual Factor
-    vector<shared_ptr<backend::VertexInverseDepth>> vertexPt_vec;
-    {
-        int feature_index = -1;
-        // 遍历每一个特征
-        for (auto &it_per_id : f_manager.feature)
-        {
-            it_per_id.used_num = it_per_id.feature_per_frame.size();
-            if (!(it_per_id.used_num >= 2 && it_per_id.start_frame < WINDOW_SIZE - 2))
-                continue;
-
-            ++feature_index;
-
-            int imu_i = it_per_id.start_frame, imu_j = imu_i - 1;
-            Vector3d pts_i = it_per_id.feature_per_frame[0].point;
-
-            shared_ptr<backend::VertexInverseDepth> verterxPoint(new backend::VertexInverseDepth());
-            VecX inv_d(1);
-            inv_d << para_Feature[feature_index][0];
-            verterxPoint->SetParameters(inv_d);
-            problem.AddVertex(verterxPoint);
-            vertexPt_vec.push_back(verterxPoint);
-
-            // 遍历所有的观测
-            for (auto &it_per_frame : it_per_id.feature_per_frame)
-            {
-                imu_j++;
-                if (imu_i == imu_j)
-                    continue;
-
-                Vector3d pts_j = it_per_frame.point;
-
-                std::shared_ptr<backend::EdgeReprojection> edge(new backend::EdgeReprojection(pts_i, pts_j));
-                std::vector<std::shared_ptr<backend::Vertex>> edge_vertex;
-                edge_vertex.push_back(verterxPoint);
-                edge_vertex.push_back(vertexCams_vec[imu_i]);
-                edge_vertex.push_back(vertexCams_vec[imu_j]);
-                edge_vertex.push_back(vertexExt);
-
-                edge->SetVertex(edge_vertex);
-                edge->SetInformation(project_sqrt_info_.transpose() * project_sqrt_info_);
-
-                edge->SetLossFunction(lossfunction);
-                problem.AddEdge(edge);
-            }
-        }
-    }
+    // step1. 增量地更新 problem：只加入新帧、新特征和新观测，删除已经不在窗口中的
+    syncBackendProblem();
+    backend::Problem &problem = *backend_problem_;
 
     // 先验
     {
@@ -1032,9 +1100,36 @@ void Estimator::problemSolve()
             problem.SetJtPrior(Jprior_inv_);
             problem.ExtendHessiansPriorSize(15); // 但是这个 prior 还是之前的维度，需要扩展下装新的pose
         }
+        else
+        {
+            // problem 是复用的，之前滑窗时删掉的帧不会缩小其中的先验，这里重新置零
+            int pose_dim = backend_ext_->LocalDimension();
+            for (int i = 0; i < WINDOW_SIZE + 1; i++)
+            {
+                pose_dim += backend_cams_[i]->LocalDimension() + backend_vbs_[i]->LocalDimension();
+            }
+            problem.SetHessianPrior(MatXX::Zero(pose_dim, pose_dim));
+            problem.SetbPrior(VecX::Zero(pose_dim));
+        }
     }
 
-    problem.Solve(SOLVER_TYPE, 10);
+    // 求解前先把问题写入内存，求解耗时超过阈值时再落盘，供 replay_snapshot 离线复现
+    std::ostringstream snapshot;
+    if (SNAPSHOT_THRESHOLD > 0)
+        problem.SaveSnapshot(snapshot);
+
+    TicToc t_solve;
+    // max_solver_time 以秒为单位（与 ceres 的 max_solver_time_in_seconds 一致）
+    problem.Solve(SOLVER_TYPE, 10, SOLVER_TIME * 1000.);
+    solve_status_ = problem.GetSolveStatus();
+    if (solve_status_ == backend::Problem::SolveStatus::TIME_BUDGET)
+        solve_cutoff_count_++;
+    if (SNAPSHOT_THRESHOLD > 0 && t_solve.toc() > SNAPSHOT_THRESHOLD)
+    {
+        std::ofstream file("./problem_snapshot_" + std::to_string(snapshot_count_++) + ".bin",
+                           std::ios::out | std::ios::binary | std::ios::trunc);
+        file << snapshot.str();
+    }
 
     // update bprior_,  Hprior_ do not need update
     if (Hprior_.rows() > 0)
@@ -1051,24 +1146,16 @@ void Estimator::problemSolve()
     // update parameter
     for (int i = 0; i < WINDOW_SIZE + 1; i++)
     {
-        VecX p = vertexCams_vec[i]->Parameters();
-        for (int j = 0; j < 7; ++j)
-        {
-            para_Pose[i][j] = p[j];
-        }
-
-        VecX vb = vertexVB_vec[i]->Parameters();
-        for (int j = 0; j < 9; ++j)
-        {
-            para_SpeedBias[i][j] = vb[j];
-        }
+        Eigen::Map<Eigen::Matrix<double, 7, 1>> pose(para_Pose[i]);
+        pose = backend_cams_[i]->FixedParameters();
+        Eigen::Map<Eigen::Matrix<double, 9, 1>> vb(para_SpeedBias[i]);
+        vb = backend_vbs_[i]->FixedParameters();
     }
 
     // 遍历每一个特征
-    for (int i = 0; i < vertexPt_vec.size(); ++i)
+    for (int i = 0; i < backend_features_.size(); ++i)
     {
-        VecX f = vertexPt_vec[i]->Parameters();
-        para_Feature[i][0] = f[0];
+        para_Feature[i][0] = backend_features_[i]->FixedParameters()[0];
     }
 }
 
@@ -1198,6 +1285,7 @@ void Estimator::slideWindow()
                 all_image_frame.erase(all_image_frame.begin(), it_0);
                 all_image_frame.erase(t_0);
             }
+            slideBackendProblem();
             slideWindowOld();
         }
     }
@@ -1232,6 +1320,7 @@ void Estimator::slideWindow()
             linear_acceleration_buf[WINDOW_SIZE].clear();
             angular_velocity_buf[WINDOW_SIZE].clear();
 
+            slideBackendProblem();
             slideWindowNew();
         }
     }
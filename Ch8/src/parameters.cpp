@@ -21,6 +21,15 @@ double BIAS_ACC_THRESHOLD;
 double BIAS_GYR_THRESHOLD;
 double SOLVER_TIME;
 int SOLVER_TYPE;
+int NUM_THREADS;
+int HESSIAN_STRATEGY;
+int DETERMINISTIC;
+int LINEAR_SOLVER;
+int SPECULATIVE_LM;
+double RELINEARIZE_THRESHOLD;
+int MIXED_PRECISION;
+int TRUST_REGION_STEP;
+double SNAPSHOT_THRESHOLD;
 int NUM_ITERATIONS;
 int ESTIMATE_EXTRINSIC;
 int ESTIMATE_TD;
@@ -72,6 +81,15 @@ void readParameters(string config_file)
     SOLVER_TYPE = fsSettings["solver_type"];
     SOLVER_TIME = fsSettings["max_solver_time"];
     NUM_ITERATIONS = fsSettings["max_num_iterations"];
+    NUM_THREADS = fsSettings["num_threads"];
+    HESSIAN_STRATEGY = fsSettings["hessian_strategy"];
+    DETERMINISTIC = fsSettings["deterministic"];
+    LINEAR_SOLVER = fsSettings["linear_solver"];
+    SPECULATIVE_LM = fsSettings["speculative_lm"];
+    RELINEARIZE_THRESHOLD = fsSettings["relinearize_threshold"];
+    MIXED_PRECISION = fsSettings["mixed_precision"];
+    TRUST_REGION_STEP = fsSettings["trust_region_step"];
+    SNAPSHOT_THRESHOLD = fsSettings["snapshot_threshold"];
     MIN_PARALLAX = fsSettings["keyframe_parallax"];
     MIN_PARALLAX = MIN_PARALLAX / FOCAL_LENGTH;
 
@@ -188,6 +206,15 @@ void readParameters(string config_file)
         <<  "\n  BIAS_GYR_THRESHOLD:"<<BIAS_GYR_THRESHOLD
         <<  "\n  SOLVER_TIME:"<<SOLVER_TIME
         <<  "\n  NUM_ITERATIONS:"<<NUM_ITERATIONS
+        <<  "\n  NUM_THREADS:"<<NUM_THREADS
+        <<  "\n  HESSIAN_STRATEGY:"<<HESSIAN_STRATEGY
+        <<  "\n  DETERMINISTIC:"<<DETERMINISTIC
+        <<  "\n  LINEAR_SOLVER:"<<LINEAR_SOLVER
+        <<  "\n  SPECULATIVE_LM:"<<SPECULATIVE_LM
+        <<  "\n  RELINEARIZE_THRESHOLD:"<<RELINEARIZE_THRESHOLD
+        <<  "\n  MIXED_PRECISION:"<<MIXED_PRECISION
+        <<  "\n  TRUST_REGION_STEP:"<<TRUST_REGION_STEP
+        <<  "\n  SNAPSHOT_THRESHOLD:"<<SNAPSHOT_THRESHOLD
         <<  "\n  ESTIMATE_EXTRINSIC:"<<ESTIMATE_EXTRINSIC
         <<  "\n  ESTIMATE_TD:"<<ESTIMATE_TD
         <<  "\n  ROLLING_SHUTTER:"<<ROLLING_SHUTTER
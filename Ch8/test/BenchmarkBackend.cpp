@@ -0,0 +1,680 @@
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include <ceres/ceres.h>
+
+#include "backend/problem.h"
+#include "backend/vertex_pose.h"
+#include "backend/vertex_speedbias.h"
+#include "backend/vertex_inverse_depth.h"
+#include "backend/edge_reprojection.h"
+#include "backend/edge_imu.h"
+#include "backend/loss_function.h"
+#include "parameters.h"
+#include "utility/tic_toc.h"
+
+using namespace myslam::backend;
+using namespace std;
+
+/*
+ * 滑窗后端的性能测试
+ *
+ * 仿真一段 IMU 轨迹和一组路标点，构造与 estimator 中相同形式的滑窗问题：
+ * N 帧 pose + speedbias，M 个逆深度路标，相邻帧之间的 IMU 边，以及边缘化第 0 帧得到的先验。
+ * 对不同的 N、M，分别统计各种 Hessian 构建方式和线性求解方式下的
+ * Hessian 构建、Schur 消元和线性求解耗时，并与 Ceres 求解同一问题的结果对比。
+ * multi_det、openmp_det 为确定性模式（Problem::SetDeterministic）下的同一构建方式。
+ * 边缘化总是串行构建 H，与构建方式无关，每组 N、M 只输出一行。
+ *
+ * 给出快照（Problem::SaveSnapshot 保存的实际问题）时，再对它做同样的求解器、构建方式和线性求解方式的组合测试，
+ * 这些行的 N、M 列为 snapshot 和 -。
+ *
+ * usage: testBenchmarkBackend [repeat] [snapshot.bin]
+ */
+
+/*
+ * Frame : 每帧的真值、带噪声的初值，以及与上一帧之间的预积分
+ */
+struct Frame {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    Eigen::Quaterniond qwb;
+    Eigen::Vector3d twb;
+    Eigen::Vector3d vwb;
+    Eigen::Quaterniond qwb_init;
+    Eigen::Vector3d twb_init;
+    std::shared_ptr<IntegrationBase> pre_integration;   // 第 0 帧为空
+};
+
+/*
+ * Feature : 路标在起始帧中的归一化坐标、逆深度初值，以及在后续帧中的观测
+ */
+struct Feature {
+    int host;
+    Eigen::Vector3d pts_host;
+    double inv_depth_init;
+    std::vector<std::pair<int, Eigen::Vector3d>> observations;
+};
+
+struct SimScene {
+    std::vector<Frame, Eigen::aligned_allocator<Frame>> frames;
+    std::vector<Feature> features;
+    Eigen::Quaterniond qic;
+    Eigen::Vector3d tic;
+};
+
+/*
+ * 产生仿真数据：匀加速、缓慢转动的轨迹，路标在相机前方，每个路标被起始帧之后的至多 5 帧观测到
+ */
+void GetSimScene(int frame_nums, int feature_nums, SimScene &scene) {
+    std::mt19937 generator(7);
+    std::normal_distribution<double> pixel_noise(0., 1. / 460.);
+    std::normal_distribution<double> depth_noise(0., 0.05);
+    std::normal_distribution<double> pose_noise(0., 0.02);
+
+    scene.qic = Eigen::Quaterniond(Eigen::AngleAxisd(-M_PI / 2, Eigen::Vector3d::UnitZ()));
+    scene.tic = Eigen::Vector3d(0.02, -0.06, 0.01);
+    scene.frames.clear();
+    scene.features.clear();
+
+    Frame first;
+    first.qwb = Eigen::Quaterniond::Identity();
+    first.twb = Eigen::Vector3d::Zero();
+    first.vwb = Eigen::Vector3d(1, 0, 0);
+    first.qwb_init = first.qwb;
+    first.twb_init = first.twb;
+    scene.frames.push_back(first);
+    for (int k = 1; k < frame_nums; ++k) {
+        Eigen::Vector3d acc(0.1 * sin(k), 0.2, 9.81), gyr(0.01, 0.02 * cos(k), 0.1);
+        std::shared_ptr<IntegrationBase> pre_integration(
+            new IntegrationBase(acc, gyr, Eigen::Vector3d::Zero(), Eigen::Vector3d::Zero()));
+        for (int t = 0; t < 10; ++t) {
+            pre_integration->push_back(0.01, acc, gyr);
+        }
+        const Frame &last = scene.frames.back();
+        double dt = pre_integration->sum_dt;
+        Frame frame;
+        frame.twb = last.twb + last.vwb * dt - 0.5 * G * dt * dt + last.qwb * pre_integration->delta_p;
+        frame.vwb = last.vwb - G * dt + last.qwb * pre_integration->delta_v;
+        frame.qwb = (last.qwb * pre_integration->delta_q).normalized();
+        frame.pre_integration = pre_integration;
+        scene.frames.push_back(frame);
+    }
+    // 第 0 帧的初值为真值，其余帧的初值加上噪声
+    for (size_t k = 1; k < scene.frames.size(); ++k) {
+        Frame &frame = scene.frames[k];
+        frame.qwb_init = (frame.qwb * Eigen::Quaterniond(1, pose_noise(generator), pose_noise(generator),
+                                                         pose_noise(generator))).normalized();
+        frame.twb_init = frame.twb + Eigen::Vector3d(pose_noise(generator), pose_noise(generator), pose_noise(generator));
+    }
+
+    std::uniform_real_distribution<double> xy_rand(-3., 3.), z_rand(4., 8.);
+    auto project = [&](const Eigen::Vector3d &pw, int k) {
+        Eigen::Vector3d pb = scene.frames[k].qwb.inverse() * (pw - scene.frames[k].twb);
+        return Eigen::Vector3d(scene.qic.inverse() * (pb - scene.tic));
+    };
+    for (int j = 0; j < feature_nums; ++j) {
+        Eigen::Vector3d pw(xy_rand(generator) + 0.05 * frame_nums, xy_rand(generator), z_rand(generator));
+        Feature feature;
+        feature.host = j % (frame_nums - 3);
+        Eigen::Vector3d pc_host = project(pw, feature.host);
+        if (pc_host.z() < 0.5)
+            continue;
+        feature.pts_host = pc_host / pc_host.z();
+        feature.inv_depth_init = 1. / pc_host.z() * (1. + depth_noise(generator));
+        for (int k = feature.host + 1; k < frame_nums && k < feature.host + 6; ++k) {
+            Eigen::Vector3d pc = project(pw, k);
+            if (pc.z() < 0.5)
+                continue;
+            Eigen::Vector3d pts = pc / pc.z();
+            pts.x() += pixel_noise(generator);
+            pts.y() += pixel_noise(generator);
+            feature.observations.push_back(std::make_pair(k, pts));
+        }
+        scene.features.push_back(feature);
+    }
+}
+
+/*
+ * Window : 滑窗 [first, last] 在 backend::Problem 中的顶点
+ */
+struct Window {
+    int first;
+    int last;
+    std::shared_ptr<VertexPose> ext;
+    std::vector<std::shared_ptr<VertexPose>> cams;
+    std::vector<std::shared_ptr<VertexSpeedBias>> vbs;
+    std::vector<std::shared_ptr<VertexInverseDepth>> points;
+    std::shared_ptr<LossFunction> loss;
+
+    int PoseDim() const { return 6 + 15 * (last - first + 1); }
+};
+
+VecX PoseParameters(const Eigen::Vector3d &t, const Eigen::Quaterniond &q) {
+    VecX pose(7);
+    pose << t, q.x(), q.y(), q.z(), q.w();
+    return pose;
+}
+
+VecX SpeedBiasParameters(const Eigen::Vector3d &v) {
+    VecX speed_bias(9);
+    speed_bias.setZero();
+    speed_bias.head<3>() = v;
+    return speed_bias;
+}
+
+/*
+ * 按 estimator 的顺序加入顶点：外参、各帧 pose 和 speedbias，最后是路标。
+ * 起始帧在窗口之外的路标不加入
+ */
+void BuildWindow(const SimScene &scene, int first, int last, Problem &problem, Window &window) {
+    window.first = first;
+    window.last = last;
+    window.cams.clear();
+    window.vbs.clear();
+    window.points.clear();
+    window.loss.reset(new CauchyLoss(1.0));
+
+    window.ext.reset(new VertexPose());
+    window.ext->SetParameters(PoseParameters(scene.tic, scene.qic));
+    window.ext->SetFixed();
+    problem.AddVertex(window.ext);
+
+    for (int k = first; k <= last; ++k) {
+        shared_ptr<VertexPose> cam(new VertexPose());
+        cam->SetParameters(PoseParameters(scene.frames[k].twb_init, scene.frames[k].qwb_init));
+        problem.AddVertex(cam);
+        window.cams.push_back(cam);
+
+        shared_ptr<VertexSpeedBias> vb(new VertexSpeedBias());
+        vb->SetParameters(SpeedBiasParameters(scene.frames[k].vwb));
+        problem.AddVertex(vb);
+        window.vbs.push_back(vb);
+    }
+
+    for (int k = first + 1; k <= last; ++k) {
+        int i = k - first;
+        shared_ptr<EdgeImu> edge(new EdgeImu(scene.frames[k].pre_integration.get()));
+        edge->SetVertex({window.cams[i - 1], window.vbs[i - 1], window.cams[i], window.vbs[i]});
+        problem.AddEdge(edge);
+    }
+
+    Eigen::Matrix2d sqrt_info = FOCAL_LENGTH / 1.5 * Eigen::Matrix2d::Identity();
+    for (const auto &feature : scene.features) {
+        if (feature.host < first || feature.host > last)
+            continue;
+        shared_ptr<VertexInverseDepth> point(new VertexInverseDepth());
+        VecX inv_depth(1);
+        inv_depth << feature.inv_depth_init;
+        point->SetParameters(inv_depth);
+        problem.AddVertex(point);
+        window.points.push_back(point);
+
+        for (const auto &obs : feature.observations) {
+            if (obs.first > last)
+                continue;
+            shared_ptr<EdgeReprojection> edge(new EdgeReprojection(feature.pts_host, obs.second));
+            edge->SetVertex({point, window.cams[feature.host - first], window.cams[obs.first - first], window.ext});
+            edge->SetInformation(sqrt_info.transpose() * sqrt_info);
+            edge->SetLossFunction(window.loss.get());
+            problem.AddEdge(edge);
+        }
+    }
+}
+
+/// 边缘化得到的先验，与 estimator 中的 Hprior_ 等相同
+struct Prior {
+    MatXX H;
+    VecX b;
+    VecX err;
+    MatXX Jt_inv;
+};
+
+/// 一次求解的耗时统计，由 SolverStatistics 的记录汇总得到
+struct SolveTiming {
+    double hessian_ms = 0.;
+    double schur_ms = 0.;
+    double linear_ms = 0.;
+    double total_ms = 0.;
+    double chi2 = 0.;
+    int iterations = 0;
+};
+
+/// 从求解器统计中取出最后一次求解的记录
+SolveTiming CollectTiming(const std::shared_ptr<SolverStatistics> &stats) {
+    SolveTiming timing;
+    std::vector<SolverRecord> records;
+    stats->Drain(records);
+    for (const auto &record : records) {
+        if (record.type != SolverRecord::SOLVE)
+            continue;
+        timing.hessian_ms = record.hessian_ms;
+        timing.schur_ms = record.schur_ms;
+        timing.linear_ms = record.linear_ms;
+        timing.total_ms = record.total_ms;
+        timing.chi2 = record.chi2;
+        timing.iterations = record.iteration;
+    }
+    return timing;
+}
+
+/// Hessian 构建方式，deterministic 为 true 时按固定顺序归约各线程的部分和
+struct BuildConfig {
+    Problem::HessianBuildStrategy strategy;
+    bool deterministic;
+    const char *name;
+};
+
+SolveTiming SolveWindow(const SimScene &scene, const Prior &prior, int solver_type,
+                        const BuildConfig &build, Problem::LinearSolverType linear_solver) {
+    Problem problem(Problem::ProblemType::SLAM_PROBLEM);
+    problem.SetHessianBuildStrategy(build.strategy);
+    problem.SetDeterministic(build.deterministic);
+    problem.SetLinearSolverType(linear_solver);
+    std::shared_ptr<SolverStatistics> stats = std::make_shared<SolverStatistics>();
+    problem.SetSolverStatistics(stats);
+
+    Window window;
+    BuildWindow(scene, 1, int(scene.frames.size()) - 1, problem, window);
+    problem.SetHessianPrior(prior.H);
+    problem.SetbPrior(prior.b);
+    problem.SetErrPrior(prior.err);
+    problem.SetJtPrior(prior.Jt_inv);
+    problem.ExtendHessiansPriorSize(15);
+
+    problem.Solve(solver_type, NUM_ITERATIONS);
+    return CollectTiming(stats);
+}
+
+/// 从快照恢复问题后求解，每次重新读取，保证各次求解的初值相同
+bool SolveSnapshot(const std::string &path, int solver_type, const BuildConfig &build,
+                   Problem::LinearSolverType linear_solver, SolveTiming &timing) {
+    Problem problem(Problem::ProblemType::SLAM_PROBLEM);
+    problem.SetHessianBuildStrategy(build.strategy);
+    problem.SetDeterministic(build.deterministic);
+    problem.SetLinearSolverType(linear_solver);
+    std::shared_ptr<SolverStatistics> stats = std::make_shared<SolverStatistics>();
+    problem.SetSolverStatistics(stats);
+    if (!problem.LoadSnapshot(path))
+        return false;
+
+    problem.Solve(solver_type, NUM_ITERATIONS);
+    timing = CollectTiming(stats);
+    return true;
+}
+
+/// 边缘化窗口 [0, N-1] 中的第 0 帧，返回耗时。H_marg 总是串行构建，与 Hessian 构建方式无关
+double MarginalizeWindow(const SimScene &scene, Prior &prior) {
+    Problem problem(Problem::ProblemType::SLAM_PROBLEM);
+
+    Window window;
+    BuildWindow(scene, 0, int(scene.frames.size()) - 2, problem, window);
+    int pose_dim = window.PoseDim();
+    problem.SetHessianPrior(MatXX::Zero(pose_dim, pose_dim));
+    problem.SetbPrior(VecX::Zero(pose_dim));
+
+    TicToc t_marg;
+    std::vector<std::shared_ptr<Vertex>> marg_vertex;
+    marg_vertex.push_back(window.cams[0]);
+    marg_vertex.push_back(window.vbs[0]);
+    problem.Marginalize(marg_vertex, pose_dim);
+    double marg_ms = t_marg.toc();
+
+    prior.H = problem.GetHessianPrior();
+    prior.b = problem.GetbPrior();
+    prior.err = problem.GetErrPrior();
+    prior.Jt_inv = problem.GetJtPrior();
+    return marg_ms;
+}
+
+/*
+ * 以下是用 Ceres 求解同一问题所需的代价函数
+ * 残差和雅可比直接调用 backend 的边计算，保证两边的模型一致
+ */
+
+/// 与 VertexPose::Plus 相同的更新方式：平移直接相加，旋转右乘 exp(delta)
+class PoseLocalParameterization : public ceres::LocalParameterization {
+public:
+    virtual bool Plus(const double *x, const double *delta, double *x_plus_delta) const {
+        Eigen::Map<const Eigen::Vector3d> t(x);
+        Eigen::Map<const Eigen::Quaterniond> q(x + 3);
+        Eigen::Map<const Eigen::Vector3d> dt(delta);
+        Eigen::Map<const Eigen::Vector3d> dq(delta + 3);
+        Eigen::Map<Eigen::Vector3d> t_plus(x_plus_delta);
+        Eigen::Map<Eigen::Quaterniond> q_plus(x_plus_delta + 3);
+        t_plus = t + dt;
+        q_plus = (q * Sophus::SO3d::exp(dq).unit_quaternion()).normalized();
+        return true;
+    }
+    virtual bool ComputeJacobian(const double *x, double *jacobian) const {
+        Eigen::Map<Eigen::Matrix<double, 7, 6, Eigen::RowMajor>> j(jacobian);
+        j.topRows<6>().setIdentity();
+        j.bottomRows<1>().setZero();
+        return true;
+    }
+    virtual int GlobalSize() const { return 7; }
+    virtual int LocalSize() const { return 6; }
+};
+
+/*
+ * 把 backend 的边包装成 Ceres 的代价函数
+ * 每个代价函数持有自己的边和顶点副本，Ceres 多线程计算残差时互不干扰。
+ * 雅可比对本地参数化求出，对全局参数的雅可比在多出的列上补零，配合 PoseLocalParameterization 使用
+ */
+class BackendEdgeCost : public ceres::CostFunction {
+public:
+    explicit BackendEdgeCost(const std::shared_ptr<Edge> &edge) : edge_(edge) {
+        set_num_residuals(int(edge_->Residual().size()));
+        for (const auto &vertex : edge_->Verticies()) {
+            mutable_parameter_block_sizes()->push_back(vertex->Dimension());
+        }
+    }
+
+    virtual bool Evaluate(double const *const *parameters, double *residuals, double **jacobians) const {
+        std::vector<std::shared_ptr<Vertex>> vertices = edge_->Verticies();
+        for (size_t i = 0; i < vertices.size(); ++i) {
+            VecX &params = vertices[i]->Parameters();
+            params = Eigen::Map<const VecX>(parameters[i], params.size());
+        }
+        edge_->Evaluate(jacobians != nullptr);
+        MatXX sqrt_info = edge_->SqrtInformation();
+        Eigen::Map<VecX>(residuals, num_residuals()) = sqrt_info * edge_->Residual();
+        if (!jacobians)
+            return true;
+
+        std::vector<MatXX> edge_jacobians = edge_->Jacobians();
+        for (size_t i = 0; i < vertices.size(); ++i) {
+            if (!jacobians[i])
+                continue;
+            Eigen::Map<Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>>
+                jacobian(jacobians[i], num_residuals(), vertices[i]->Dimension());
+            jacobian.setZero();
+            jacobian.leftCols(vertices[i]->LocalDimension()) = sqrt_info * edge_jacobians[i];
+        }
+        return true;
+    }
+
+private:
+    std::shared_ptr<Edge> edge_;
+};
+
+/*
+ * 边缘化先验：r = err + J * dx，J^T J = H_prior，dx 为相对边缘化时线性化点的增量
+ * 外参和各帧 pose 的旋转增量用 log(q0^-1 * q)，与 Problem 中先验随状态更新的方式一致
+ */
+class PriorCost : public ceres::CostFunction {
+public:
+    PriorCost(const Prior &prior, const std::vector<VecX> &linearization_points) : x0_(linearization_points) {
+        err_ = prior.err;
+        Eigen::SelfAdjointEigenSolver<MatXX> saes(prior.H);
+        VecX s = saes.eigenvalues();
+        for (int i = 0; i < s.size(); ++i) {
+            s(i) = s(i) > 1e-8 ? sqrt(s(i)) : 0.;
+        }
+        J_ = s.asDiagonal() * saes.eigenvectors().transpose();
+
+        set_num_residuals(int(err_.size()));
+        for (const auto &x : x0_) {
+            mutable_parameter_block_sizes()->push_back(int(x.size()));
+        }
+    }
+
+    virtual bool Evaluate(double const *const *parameters, double *residuals, double **jacobians) const {
+        VecX dx(J_.cols());
+        int offset = 0;
+        for (size_t i = 0; i < x0_.size(); ++i) {
+            if (x0_[i].size() == 7) {
+                Eigen::Map<const Eigen::Quaterniond> q0(x0_[i].data() + 3);
+                Eigen::Map<const Eigen::Quaterniond> q(parameters[i] + 3);
+                dx.segment<3>(offset) = Eigen::Map<const Eigen::Vector3d>(parameters[i]) - x0_[i].head<3>();
+                dx.segment<3>(offset + 3) = Sophus::SO3d(q0.inverse() * q).log();
+                offset += 6;
+            } else {
+                dx.segment(offset, x0_[i].size()) = Eigen::Map<const VecX>(parameters[i], x0_[i].size()) - x0_[i];
+                offset += int(x0_[i].size());
+            }
+        }
+        Eigen::Map<VecX>(residuals, num_residuals()) = err_ + J_ * dx;
+        if (!jacobians)
+            return true;
+
+        offset = 0;
+        for (size_t i = 0; i < x0_.size(); ++i) {
+            int local_dim = x0_[i].size() == 7 ? 6 : int(x0_[i].size());
+            if (jacobians[i]) {
+                Eigen::Map<Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>>
+                    jacobian(jacobians[i], num_residuals(), x0_[i].size());
+                jacobian.setZero();
+                jacobian.leftCols(local_dim) = J_.middleCols(offset, local_dim);
+            }
+            offset += local_dim;
+        }
+        return true;
+    }
+
+private:
+    std::vector<VecX> x0_;
+    VecX err_;
+    MatXX J_;
+};
+
+struct CeresResult {
+    double total_ms = 0.;
+    double chi2 = 0.;
+    int iterations = 0;
+};
+
+/*
+ * 用 Ceres 求解与 SolveWindow 相同的问题。Ceres 的 cost 为 0.5 * sum(rho)，乘 2 后与 Problem 的 chi2 对应
+ */
+CeresResult SolveWindowWithCeres(const SimScene &scene, const Prior &prior, ceres::LinearSolverType linear_solver) {
+    int first = 1, last = int(scene.frames.size()) - 1;
+    int frame_nums = last - first + 1;
+    std::vector<double> para_ex(7);
+    std::vector<std::vector<double>> para_pose(frame_nums, std::vector<double>(7));
+    std::vector<std::vector<double>> para_speed_bias(frame_nums, std::vector<double>(9));
+    std::vector<double> para_feature;
+
+    ceres::Problem::Options problem_options;
+    problem_options.local_parameterization_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+    ceres::Problem problem(problem_options);
+    PoseLocalParameterization pose_parameterization;
+    ceres::ParameterBlockOrdering *ordering = new ceres::ParameterBlockOrdering;
+
+    Eigen::Map<VecX>(para_ex.data(), 7) = PoseParameters(scene.tic, scene.qic);
+    problem.AddParameterBlock(para_ex.data(), 7, &pose_parameterization);
+    problem.SetParameterBlockConstant(para_ex.data());
+    ordering->AddElementToGroup(para_ex.data(), 1);
+    for (int i = 0; i < frame_nums; ++i) {
+        const Frame &frame = scene.frames[first + i];
+        Eigen::Map<VecX>(para_pose[i].data(), 7) = PoseParameters(frame.twb_init, frame.qwb_init);
+        Eigen::Map<VecX>(para_speed_bias[i].data(), 9) = SpeedBiasParameters(frame.vwb);
+        problem.AddParameterBlock(para_pose[i].data(), 7, &pose_parameterization);
+        problem.AddParameterBlock(para_speed_bias[i].data(), 9);
+        ordering->AddElementToGroup(para_pose[i].data(), 1);
+        ordering->AddElementToGroup(para_speed_bias[i].data(), 1);
+    }
+
+    // 先验作用在外参和除最新一帧之外的各帧上，线性化点就是边缘化时的初值
+    std::vector<VecX> x0;
+    std::vector<double *> prior_blocks;
+    x0.push_back(Eigen::Map<VecX>(para_ex.data(), 7));
+    prior_blocks.push_back(para_ex.data());
+    for (int i = 0; i + 1 < frame_nums; ++i) {
+        x0.push_back(Eigen::Map<VecX>(para_pose[i].data(), 7));
+        x0.push_back(Eigen::Map<VecX>(para_speed_bias[i].data(), 9));
+        prior_blocks.push_back(para_pose[i].data());
+        prior_blocks.push_back(para_speed_bias[i].data());
+    }
+    problem.AddResidualBlock(new PriorCost(prior, x0), NULL, prior_blocks);
+
+    // backend 的边需要顶点对象，每条边用一组新的顶点
+    for (int i = 1; i < frame_nums; ++i) {
+        shared_ptr<EdgeImu> edge(new EdgeImu(scene.frames[first + i].pre_integration.get()));
+        edge->SetVertex({std::make_shared<VertexPose>(), std::make_shared<VertexSpeedBias>(),
+                         std::make_shared<VertexPose>(), std::make_shared<VertexSpeedBias>()});
+        problem.AddResidualBlock(new BackendEdgeCost(edge), NULL, para_pose[i - 1].data(), para_speed_bias[i - 1].data(),
+                                 para_pose[i].data(), para_speed_bias[i].data());
+    }
+
+    size_t feature_nums = 0;
+    for (const auto &feature : scene.features) {
+        if (feature.host >= first && feature.host <= last)
+            ++feature_nums;
+    }
+    para_feature.resize(feature_nums);
+    ceres::LossFunction *loss = new ceres::CauchyLoss(1.0);
+    Eigen::Matrix2d sqrt_info = FOCAL_LENGTH / 1.5 * Eigen::Matrix2d::Identity();
+    size_t feature_index = 0;
+    for (const auto &feature : scene.features) {
+        if (feature.host < first || feature.host > last)
+            continue;
+        double *inv_depth = &para_feature[feature_index++];
+        *inv_depth = feature.inv_depth_init;
+        problem.AddParameterBlock(inv_depth, 1);
+        ordering->AddElementToGroup(inv_depth, 0);
+        for (const auto &obs : feature.observations) {
+            if (obs.first > last)
+                continue;
+            shared_ptr<EdgeReprojection> edge(new EdgeReprojection(feature.pts_host, obs.second));
+            edge->SetVertex({std::make_shared<VertexInverseDepth>(), std::make_shared<VertexPose>(),
+                             std::make_shared<VertexPose>(), std::make_shared<VertexPose>()});
+            edge->SetInformation(sqrt_info.transpose() * sqrt_info);
+            problem.AddResidualBlock(new BackendEdgeCost(edge), loss, inv_depth, para_pose[feature.host - first].data(),
+                                     para_pose[obs.first - first].data(), para_ex.data());
+        }
+    }
+
+    ceres::Solver::Options options;
+    options.linear_solver_type = linear_solver;
+    options.preconditioner_type = ceres::SCHUR_JACOBI;
+    options.linear_solver_ordering.reset(ordering);
+    options.trust_region_strategy_type = ceres::LEVENBERG_MARQUARDT;
+    options.max_num_iterations = NUM_ITERATIONS;
+    options.num_threads = 4;
+    ceres::Solver::Summary summary;
+    TicToc t_solve;
+    ceres::Solve(options, &problem, &summary);
+
+    CeresResult result;
+    result.total_ms = t_solve.toc();
+    result.chi2 = 2. * summary.final_cost;
+    result.iterations = int(summary.iterations.size()) - 1;
+    return result;
+}
+
+int main(int argc, char **argv) {
+    int repeat = argc > 1 ? atoi(argv[1]) : 3;
+    std::string snapshot = argc > 2 ? argv[2] : "";
+    if (repeat < 1) {
+        cout << "usage: testBenchmarkBackend [repeat] [snapshot.bin]" << endl;
+        return -1;
+    }
+
+    // 与 EuRoC 配置文件相同的 IMU 噪声，预积分的协方差依赖这些参数
+    ACC_N = 0.08;
+    GYR_N = 0.004;
+    ACC_W = 0.00004;
+    GYR_W = 2.0e-6;
+    FOCAL_LENGTH = 460;
+    NUM_ITERATIONS = 10;
+
+    const int frame_nums[] = {11, 20, 30};
+    const int feature_nums[] = {300, 1000, 2000};
+    // multi_det / openmp_det 与 multi / openmp 对比，即确定性归约的额外开销
+    const BuildConfig builds[] = {
+        {Problem::HessianBuildStrategy::SINGLE_THREAD, false, "single"},
+        {Problem::HessianBuildStrategy::MULTI_THREAD, false, "multi"},
+        {Problem::HessianBuildStrategy::MULTI_THREAD, true, "multi_det"},
+        {Problem::HessianBuildStrategy::OPENMP, false, "openmp"},
+        {Problem::HessianBuildStrategy::OPENMP, true, "openmp_det"},
+        {Problem::HessianBuildStrategy::LOCK_FREE, false, "lockfree"}};
+    const int num_builds = sizeof(builds) / sizeof(builds[0]);
+    const Problem::LinearSolverType linear_solvers[] = {Problem::LinearSolverType::LDLT,
+                                                        Problem::LinearSolverType::PCG,
+                                                        Problem::LinearSolverType::SPARSE_LDLT};
+    const char *linear_solver_names[] = {"ldlt", "pcg", "sparse_ldlt"};
+    const char *solver_names[] = {"LM", "DogLeg"};
+
+    cout << fixed << setprecision(3);
+    cout << "N,M,solver,hessian,linear_solver,iterations,chi2,hessian_ms,schur_ms,linear_ms,marg_ms,total_ms" << endl;
+    for (int N : frame_nums) {
+        for (int M : feature_nums) {
+            // 多仿真一帧：前 N 帧用于边缘化得到先验，后 N 帧用于求解
+            SimScene scene;
+            GetSimScene(N + 1, M, scene);
+
+            Prior prior;
+            double marg_ms = 0.;
+            for (int r = 0; r < repeat; ++r) {
+                marg_ms += MarginalizeWindow(scene, prior) / repeat;
+            }
+            cout << N << ',' << M << ",marginalize,-,-,-,-,-,-,-," << marg_ms << ",-" << endl;
+
+            for (int solver_type = 0; solver_type < 2; ++solver_type) {
+                for (int s = 0; s < num_builds; ++s) {
+                    for (int l = 0; l < 3; ++l) {
+                        SolveTiming mean;
+                        for (int r = 0; r < repeat; ++r) {
+                            SolveTiming timing = SolveWindow(scene, prior, solver_type, builds[s], linear_solvers[l]);
+                            mean.hessian_ms += timing.hessian_ms / repeat;
+                            mean.schur_ms += timing.schur_ms / repeat;
+                            mean.linear_ms += timing.linear_ms / repeat;
+                            mean.total_ms += timing.total_ms / repeat;
+                            mean.chi2 = timing.chi2;
+                            mean.iterations = timing.iterations;
+                        }
+                        cout << N << ',' << M << ',' << solver_names[solver_type] << ',' << builds[s].name << ','
+                             << linear_solver_names[l] << ',' << mean.iterations << ',' << mean.chi2 << ','
+                             << mean.hessian_ms << ',' << mean.schur_ms << ',' << mean.linear_ms << ",-,"
+                             << mean.total_ms << endl;
+                    }
+                }
+            }
+
+            const ceres::LinearSolverType ceres_solvers[] = {ceres::DENSE_SCHUR, ceres::ITERATIVE_SCHUR};
+            for (int l = 0; l < 2; ++l) {
+                CeresResult mean;
+                for (int r = 0; r < repeat; ++r) {
+                    CeresResult result = SolveWindowWithCeres(scene, prior, ceres_solvers[l]);
+                    mean.total_ms += result.total_ms / repeat;
+                    mean.chi2 = result.chi2;
+                    mean.iterations = result.iterations;
+                }
+                cout << N << ',' << M << ",ceres,-," << (l == 0 ? "dense_schur" : "iterative_schur") << ','
+                     << mean.iterations << ',' << mean.chi2 << ",-,-,-,-," << mean.total_ms << endl;
+            }
+        }
+    }
+
+    if (snapshot.empty())
+        return 0;
+    // 快照会把全局的 G 设为保存时的值，放在仿真问题之后
+    for (int solver_type = 0; solver_type < 2; ++solver_type) {
+        for (int s = 0; s < num_builds; ++s) {
+            for (int l = 0; l < 3; ++l) {
+                SolveTiming mean;
+                for (int r = 0; r < repeat; ++r) {
+                    SolveTiming timing;
+                    if (!SolveSnapshot(snapshot, solver_type, builds[s], linear_solvers[l], timing)) {
+                        cout << "failed to load " << snapshot << endl;
+                        return -1;
+                    }
+                    mean.hessian_ms += timing.hessian_ms / repeat;
+                    mean.schur_ms += timing.schur_ms / repeat;
+                    mean.linear_ms += timing.linear_ms / repeat;
+                    mean.total_ms += timing.total_ms / repeat;
+                    mean.chi2 = timing.chi2;
+                    mean.iterations = timing.iterations;
+                }
+                cout << "snapshot,-," << solver_names[solver_type] << ',' << builds[s].name << ','
+                     << linear_solver_names[l] << ',' << mean.iterations << ',' << mean.chi2 << ','
+                     << mean.hessian_ms << ',' << mean.schur_ms << ',' << mean.linear_ms << ",-,"
+                     << mean.total_ms << endl;
+            }
+        }
+    }
+    return 0;
+}
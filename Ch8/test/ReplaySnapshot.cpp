@@ -0,0 +1,97 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include "backend/problem.h"
+#include "backend/vertex_pose.h"
+#include "backend/vertex_speedbias.h"
+#include "parameters.h"
+#include "utility/tic_toc.h"
+
+using namespace myslam::backend;
+using namespace std;
+
+/*
+ * 离线复现一次后端求解或边缘化
+ *
+ * 快照由 Estimator::problemSolve 在求解耗时超过 snapshot_threshold 时保存，
+ * 也可以在任意位置调用 Problem::SaveSnapshot 得到。
+ *
+ * usage: replay_snapshot snapshot.bin [solve|marg] [solver_type] [hessian_strategy] [linear_solver] [iterations] [max_time_ms]
+ *   solve : 重新求解，solver_type 0 LM, 1 DogLeg，max_time_ms 为时间预算，0 不限制
+ *   marg  : 边缘化最老的一帧（id 最小的 speedbias 和它之前的 pose）
+ */
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        cout << "usage: replay_snapshot snapshot.bin [solve|marg] [solver_type] [hessian_strategy] "
+                "[linear_solver] [iterations] [max_time_ms]" << endl;
+        return -1;
+    }
+    string mode = argc > 2 ? argv[2] : "solve";
+    int solver_type = argc > 3 ? atoi(argv[3]) : 0;
+    int hessian_strategy = argc > 4 ? atoi(argv[4]) : int(Problem::HessianBuildStrategy::LOCK_FREE);
+    int linear_solver = argc > 5 ? atoi(argv[5]) : int(Problem::LinearSolverType::LDLT);
+    int iterations = argc > 6 ? atoi(argv[6]) : 10;
+    double max_time_ms = argc > 7 ? atof(argv[7]) : 0.;
+
+    Problem problem(Problem::ProblemType::SLAM_PROBLEM);
+    problem.SetHessianBuildStrategy(Problem::HessianBuildStrategy(hessian_strategy));
+    problem.SetLinearSolverType(Problem::LinearSolverType(linear_solver));
+    std::shared_ptr<SolverStatistics> stats = std::make_shared<SolverStatistics>();
+    problem.SetSolverStatistics(stats);
+
+    std::vector<std::shared_ptr<Vertex>> vertices;
+    if (!problem.LoadSnapshot(argv[1], &vertices)) {
+        cout << "failed to load " << argv[1] << endl;
+        return -1;
+    }
+
+    cout << fixed << setprecision(3);
+    if (mode == "marg") {
+        int pose_dim = 0;
+        std::vector<std::shared_ptr<Vertex>> marg_vertex;
+        for (size_t i = 0; i < vertices.size(); ++i) {
+            std::string type = vertices[i]->TypeInfo();
+            if (type != "VertexPose" && type != "VertexSpeedBias")
+                continue;
+            pose_dim += vertices[i]->LocalDimension();
+            if (marg_vertex.empty() && type == "VertexSpeedBias" && i > 0 &&
+                vertices[i - 1]->TypeInfo() == "VertexPose") {
+                marg_vertex.push_back(vertices[i - 1]);
+                marg_vertex.push_back(vertices[i]);
+            }
+        }
+        if (marg_vertex.empty()) {
+            cout << "no frame to marginalize" << endl;
+            return -1;
+        }
+        if (problem.GetHessianPrior().rows() != pose_dim) {
+            problem.SetHessianPrior(MatXX::Zero(pose_dim, pose_dim));
+            problem.SetbPrior(VecX::Zero(pose_dim));
+        }
+
+        TicToc t_marg;
+        problem.Marginalize(marg_vertex, pose_dim);
+        double marg_ms = t_marg.toc();
+        cout << "marginalize: " << marg_ms << " ms, prior rows " << problem.GetHessianPrior().rows()
+             << ", |H| " << problem.GetHessianPrior().norm() << ", |b| " << problem.GetbPrior().norm() << endl;
+        return 0;
+    }
+
+    problem.Solve(solver_type, iterations, max_time_ms);
+    const char *status[] = {"converged", "max iterations", "time budget"};
+
+    std::vector<SolverRecord> records;
+    stats->Drain(records);
+    for (const auto &record : records) {
+        if (record.type == SolverRecord::ITERATION) {
+            cout << "iter " << record.iteration << (record.accepted ? " accepted" : " rejected")
+                 << "  chi2 " << record.chi2 << "  lambda " << record.lambda << "  hessian " << record.hessian_ms
+                 << " ms  schur " << record.schur_ms << " ms  linear " << record.linear_ms << " ms" << endl;
+        } else {
+            cout << "solve: " << record.total_ms << " ms, " << record.iteration << " iterations, chi2 " << record.chi2
+                 << ", pose dim " << record.pose_dim << ", landmark dim " << record.landmark_dim
+                 << ", edges " << record.num_edges << ", " << status[int(problem.GetSolveStatus())] << endl;
+        }
+    }
+    return 0;
+}
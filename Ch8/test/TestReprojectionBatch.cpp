@@ -0,0 +1,128 @@
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "backend/vertex_pose.h"
+#include "backend/vertex_inverse_depth.h"
+#include "backend/edge_reprojection.h"
+#include "backend/edge_reprojection_batch.h"
+#include "utility/tic_toc.h"
+
+using namespace myslam::backend;
+using namespace std;
+
+/*
+ * 检查批量重投影计算与 EdgeReprojection::Evaluate 的结果是否一致，并比较两者的耗时
+ *
+ * 边数取不是批宽整数倍的值，尾部的标量路径也会被覆盖到。
+ * 另外检查混合精度下 float 计算的 J^T W J 与 LinearizeBlocks 的相对误差在 float 精度以内。
+ *
+ * usage: testReprojectionBatch [num_edges]
+ */
+
+static shared_ptr<VertexPose> RandomPose(std::mt19937 &gen) {
+    std::uniform_real_distribution<double> u(-1., 1.);
+    Eigen::Quaterniond q(1., 0.3 * u(gen), 0.3 * u(gen), 0.3 * u(gen));
+    q.normalize();
+    VecX pose(7);
+    pose << 0.5 * u(gen), 0.5 * u(gen), 0.5 * u(gen), q.x(), q.y(), q.z(), q.w();
+    shared_ptr<VertexPose> vertex(new VertexPose());
+    vertex->SetParameters(pose);
+    return vertex;
+}
+
+int main(int argc, char **argv) {
+    int num_edges = argc > 1 ? atoi(argv[1]) : 1003;
+    std::mt19937 gen(1);
+    std::uniform_real_distribution<double> u(-1., 1.);
+
+    shared_ptr<VertexPose> ext = RandomPose(gen);
+    vector<shared_ptr<EdgeReprojection>> edges;
+    for (int i = 0; i < num_edges; ++i) {
+        shared_ptr<VertexInverseDepth> point(new VertexInverseDepth());
+        VecX inv_dep(1);
+        inv_dep << 0.2 + 0.1 * (u(gen) + 1.);
+        point->SetParameters(inv_dep);
+
+        Vec3 pts_i(0.5 * u(gen), 0.5 * u(gen), 1.);
+        Vec3 pts_j(0.5 * u(gen), 0.5 * u(gen), 1.);
+        shared_ptr<EdgeReprojection> edge(new EdgeReprojection(pts_i, pts_j));
+        edge->SetVertex({point, RandomPose(gen), RandomPose(gen), ext});
+        edges.push_back(edge);
+    }
+
+    // 逐条计算
+    vector<VecX> residuals(num_edges);
+    vector<MatXX> jacobians(num_edges);
+    TicToc t_scalar;
+    for (int i = 0; i < num_edges; ++i) {
+        edges[i]->Evaluate(true);
+    }
+    double scalar_ms = t_scalar.toc();
+    for (int i = 0; i < num_edges; ++i) {
+        residuals[i] = edges[i]->Residual();
+        jacobians[i] = edges[i]->StackedJacobian();
+    }
+
+    // 批量计算
+    ReprojectionBatch batch;
+    batch.Resize(num_edges);
+    TicToc t_batch;
+    for (int i = 0; i < num_edges; ++i) {
+        edges[i]->PackBatch(batch, i);
+    }
+    EvaluateReprojectionBatch(batch, true);
+    for (int i = 0; i < num_edges; ++i) {
+        edges[i]->UnpackBatch(batch, i, true);
+    }
+    double batch_ms = t_batch.toc();
+
+    double max_residual_err = 0., max_jacobian_err = 0.;
+    for (int i = 0; i < num_edges; ++i) {
+        double residual_scale = std::max(1., residuals[i].cwiseAbs().maxCoeff());
+        max_residual_err = std::max(max_residual_err,
+                                    (edges[i]->Residual() - residuals[i]).cwiseAbs().maxCoeff() / residual_scale);
+        MatXX diff = MatXX(edges[i]->StackedJacobian()) - jacobians[i];
+        double scale = std::max(1., jacobians[i].cwiseAbs().maxCoeff());
+        max_jacobian_err = std::max(max_jacobian_err, diff.cwiseAbs().maxCoeff() / scale);
+    }
+
+    // 混合精度：J^T W J 用 float 计算，梯度仍为双精度
+    std::vector<int> index{0, 1, 7, 13};
+    vector<MatXX> hessians(16), hessians_float(16);
+    vector<VecX> gradients(4), gradients_mixed(4);
+    TicToc t_float;
+    for (int i = 0; i < num_edges; ++i) {
+        edges[i]->PackHessianBatch(batch, i, index, gradients_mixed);
+    }
+    EvaluateReprojectionHessianBatch(batch);
+    double float_ms = t_float.toc();
+    double max_hessian_err = 0., max_gradient_err = 0.;
+    for (int i = 0; i < num_edges; ++i) {
+        edges[i]->PackHessianBatch(batch, i, index, gradients_mixed);
+        edges[i]->UnpackHessianBatch(batch, i, index, hessians_float);
+        edges[i]->LinearizeBlocks(index, hessians, gradients);
+        double scale = 1.;
+        for (const auto &h : hessians) {
+            scale = std::max(scale, h.cwiseAbs().maxCoeff());
+        }
+        for (size_t k = 0; k < hessians.size(); ++k) {
+            max_hessian_err = std::max(max_hessian_err, (hessians_float[k] - hessians[k]).cwiseAbs().maxCoeff() / scale);
+        }
+        for (size_t k = 0; k < gradients.size(); ++k) {
+            max_gradient_err = std::max(max_gradient_err, (gradients_mixed[k] - gradients[k]).cwiseAbs().maxCoeff());
+        }
+    }
+
+    cout << "isa " << ReprojectionBatchIsa() << ", width " << ReprojectionBatchWidth() << ", edges " << num_edges << endl;
+    cout << "evaluate " << scalar_ms << " ms, batch " << batch_ms << " ms" << endl;
+    cout << "max relative residual error " << max_residual_err << ", max relative jacobian error " << max_jacobian_err << endl;
+
+    cout << "float J^T W J " << float_ms << " ms, max relative hessian error " << max_hessian_err
+         << ", max gradient error " << max_gradient_err << endl;
+
+    bool ok = max_residual_err < 1e-12 && max_jacobian_err < 1e-12 && max_hessian_err < 1e-5 && max_gradient_err == 0.;
+    cout << (ok ? "PASSED" : "FAILED") << endl;
+    return ok ? 0 : 1;
+}
@@ -11,16 +11,36 @@ print("load %d files of solver time recorder." %(N-1))
 fiilenames = sys.argv[1:]
 x_labels = list()
 
+# 与 backend/solver_statistics.h 中的 SolverRecord 一致
+RECORD_DTYPE = np.dtype([('chi2', '<f8'), ('lambda', '<f8'), ('hessian_ms', '<f8'), ('schur_ms', '<f8'),
+                         ('linear_ms', '<f8'), ('residual_ms', '<f8'), ('total_ms', '<f8'), ('solve_id', '<u8'), ('type', '<i4'),
+                         ('solver', '<i4'), ('iteration', '<i4'), ('accepted', '<i4'), ('pose_dim', '<i4'),
+                         ('landmark_dim', '<i4'), ('num_edges', '<i4'), ('num_vertices', '<i4')])
+RECORD_SOLVE = 1
 
+def load_solver_time(file):
+    """返回每次求解的总耗时和 hessian 耗时，支持 solver_stats 的 csv/二进制文件和旧的 solver_cost.txt"""
+    if os.path.splitext(file)[1] == '.bin':
+        records = np.fromfile(file, dtype=RECORD_DTYPE)
+        records = records[records['type'] == RECORD_SOLVE]
+        return records['total_ms'], records['hessian_ms']
+    with open(file) as f:
+        header = f.readline()
+    if header.startswith('type'):
+        records = pd.read_csv(file)
+        records = records[records['type'] == RECORD_SOLVE]
+        return records['total_ms'].values, records['hessian_ms'].values
+    tmp_time = np.loadtxt(file, dtype=np.float32)
+    return tmp_time[...,0], tmp_time[...,1]
 
 # 读取文件
 solver_time = list() # 每帧求解时间
 hessian_time = list() # hessian时间
 i=1
 for file in fiilenames:
-    tmp_time = np.loadtxt(file, dtype=np.float32)
-    solver_time.append(tmp_time[...,0])
-    hessian_time.append(tmp_time[...,1])
+    tmp_solver, tmp_hessian = load_solver_time(file)
+    solver_time.append(tmp_solver)
+    hessian_time.append(tmp_hessian)
     # 获取文件名
     filepath, tmpfilename = os.path.split(sys.argv[i])
     shotname, extention = os.path.splitext(tmpfilename)
@@ -32,7 +52,7 @@ df_hessian = pd.DataFrame(hessian_time)
 print(df_solver.mean(1))
 print(df_hessian.mean(1))
 # 绘制求解器耗时统计图
-#solver_time = np.loadtxt("../build/solver_cost.txt", dtype=np.float32)
+#solver_time, hessian_time = load_solver_time("../build/solver_stats.csv")
 fig, axes = plot.subplots(nrows = 2, ncols = 1, figsize=(10,8)) # 两行一列
 
 